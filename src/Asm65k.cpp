@@ -10,248 +10,935 @@
 
 #include <Asm65k.h>
 #include <sstream>
-#include <regex>
 #include <iostream>
+#include <array>
+#include <algorithm>
+#include <optional>
+#include <thread>
+#include <cstring>
 
 using namespace std;
 
 std::vector<Segment> *AsmA65k::Assemble(stringstream &source)
 {
-    InitializeOpcodetable();
+    const string buffer = source.str();
 
-    segments.clear();
+    return Assemble(std::string_view(buffer));
+}
+
+void AsmA65k::SetEncoderThreadCount(unsigned int threadCount)
+{
+    encoderThreadCount = threadCount;
+}
 
-    while (getline(source, actLine))
+void AsmA65k::SetJumpRelaxation(bool isEnabled)
+{
+    relaxJumps = isEnabled;
+}
+
+void AsmA65k::SetOptimization(bool isEnabled)
+{
+    optimize = isEnabled;
+}
+
+void AsmA65k::SetLineCache(bool isEnabled)
+{
+    useLineCache = isEnabled;
+    if (isEnabled == false)
+        lineCache.Clear();
+}
+
+void AsmA65k::SetRelocatable(bool isEnabled)
+{
+    relocatable = isEnabled;
+}
+
+void AsmA65k::SetErrorCollection(bool isEnabled)
+{
+    collectErrors = isEnabled;
+}
+
+const std::vector<AsmError> &AsmA65k::GetErrors() const
+{
+    return errors;
+}
+
+void AsmA65k::SetStatistics(bool isEnabled)
+{
+    collectStats = isEnabled;
+}
+
+const AsmStats &AsmA65k::GetStatistics() const
+{
+    return stats;
+}
+
+const char *AsmA65k::GetOperandTypeName(int operandType)
+{
+    static const char *names[] = {
+        "none",
+        "constant", "label", "register", "indirect_constant", "indirect_register", "indirect_label",
+        "indirect_register_plus_constant", "indirect_constant_plus_register", "indirect_register_plus_label", "indirect_label_plus_register",
+        "register__register", "register__constant", "register__label", "indirect_register__register", "indirect_label__register",
+        "indirect_constant__register", "indirect_register_plus_label__register", "indirect_register_plus_constant__register",
+        "indirect_label_plus_register__register", "indirect_constant_plus_register__register",
+        "indirect_register__constant", "indirect_label__constant", "indirect_constant__constant", "indirect_register_plus_label__constant",
+        "indirect_register_plus_constant__constant", "indirect_label_plus_register__constant", "indirect_constant_plus_register__constant",
+        "register__indirect_register", "register__indirect_label", "register__indirect_constant", "register__indirect_register_plus_constant",
+        "register__indirect_register_plus_label", "register__indirect_constant_plus_register", "register__indirect_label_plus_register",
+        "constant__label", "constant__constant", "label__constant", "label__label"};
+    static_assert(sizeof(names) / sizeof(names[0]) == AsmStats::OPERAND_TYPE_COUNT && OT_LABEL__LABEL + 1 == AsmStats::OPERAND_TYPE_COUNT);
+
+    return operandType >= 0 && operandType < AsmStats::OPERAND_TYPE_COUNT ? names[operandType] : "";
+}
+
+bool AsmA65k::IsSymbolOnly() const
+{
+    return statements.empty() && segments.empty() && hasLabels == false && usesAddress == false && macros.empty() && sourceFiles.size() == 1 && errors.empty();
+}
+
+bool AsmA65k::WriteSymbolFile(const char *filename, std::string_view source) const
+{
+    return SymbolFile::Write(filename, SymbolFile::HashSource(source), labels);
+}
+
+double *AsmA65k::GetSizingTimer(double &seconds)
+{
+    return collectStats && isSizingPass ? &seconds : nullptr;
+}
+
+// the errors are reported in the lines of the files they are in, see LocateError()
+std::vector<Segment> *AsmA65k::Assemble(std::string_view source, std::string_view fileName)
+{
+    Reset();
+    sourceFiles.push_back(SourceFile{string(fileName)});
+
+    try
+    {
+        AssembleSource(source);
+    }
+    catch (AsmError &error)
     {
-        // convert line to lowercase
-        std::transform(actLine.begin(), actLine.end(), actLine.begin(), ::tolower);
+        LocateError(error);
+        throw;
+    }
+
+    for (AsmError &error : errors)
+        LocateError(error);
+
+    return &segments;
+}
 
-        if (IsCommentLine(actLine))
+// the source is assembled in two passes. the sizing pass defines the symbols and assigns an address
+// to every line that emits bytes, without encoding anything. then the segments are allocated in their
+// final size, and the encoding pass fills in the statements, split between several threads for big sources
+void AsmA65k::AssembleSource(std::string_view source)
+{
+    // relaxing a jump moves the code after it, so the sizing pass is repeated until no more jumps can be changed
+    std::optional<AsmError> sizingError;
+    bool isRelaxed;
+    do
+    {
+        actLineNumber = 1;
+        PC = 0;
         {
-            actLineNumber++;
-            continue;
+            PhaseTimer timer(collectStats ? &stats.sizingSeconds : nullptr);
+            sizingError = SizeSource(source);
         }
 
-        ProcessLabelDefinition(actLine);
-        if (!ProcessDirectives(actLine))
-            ProcessAsmLine(actLine);
-        actLineNumber++;
+        PhaseTimer timer(collectStats ? &stats.optimizerSeconds : nullptr);
+        isRelaxed = relaxJumps && sizingError.has_value() == false && RelaxJumps();
+    } while (isRelaxed);
+
+    stats.symbols = labels.GetSize();
+
+    // retargeting a jump doesn't change its size, so the jump chains are resolved on the final layout
+    if (optimize && sizingError.has_value() == false)
+    {
+        PhaseTimer timer(collectStats ? &stats.optimizerSeconds : nullptr);
+        ResolveJumpChains();
     }
 
-    // iterate through all unresolved labels map
-    for (auto unresolvedLabel : unresolvedLabels)
+    // allocate the segments in their final size
+    std::vector<uint32_t> segmentSizes(segments.size(), 0);
+    for (const Statement &statement : statements)
+        segmentSizes[statement.segmentIndex] = statement.address - segments[statement.segmentIndex].address + statement.length;
+    for (size_t i = 0; i < segments.size(); i++)
+        segments[i].data.resize(segmentSizes[i]);
+
+    if (IsLineCacheUsed())
+        statementKeys.assign(statements.size(), 0);
+
+    try
     {
-        // extract vector of LabelLocations from map (as a reference)
-        vector<LabelLocation> &locations = unresolvedLabel.second;
-        string label = unresolvedLabel.first;
+        PhaseTimer timer(collectStats ? &stats.encodingSeconds : nullptr);
+        EncodeAllStatements();
+    }
+    catch (AsmError &error)
+    {
+        // report the error of the first line, whichever pass found it
+        if (sizingError.has_value() == false || error.lineNumber < sizingError->lineNumber)
+            throw;
+    }
+
+    if (sizingError.has_value())
+        throw *sizingError;
 
-        // iterate through LabelLocations in vector
-        for (auto &actLocation : locations)
+    CheckExportedSymbols();
+
+    // patch the fields of all symbols that were not defined by the end of the sizing pass. an object keeps them for the linker
+    if (relocatable == false)
+    {
+        PhaseTimer timer(collectStats ? &stats.fixupSeconds : nullptr);
+        for (const Fixup &fixup : fixups)
         {
-            // check if label had been resolved later in assembly file
-            if (labels.find(label) == labels.end())
+            try
             {
-                AsmError error(actLocation.lineNumber, actLocation.lineContent, "Undefined label: " + label);
-                throw error;
+                PatchFixup(fixup);
             }
+            catch (AsmError &error)
+            {
+                RecordError(error);
+            }
+        }
+    }
+
+    stats.fixups = fixups.size();
+    for (const Segment &segment : segments)
+        stats.outputBytes += segment.data.size();
+
+    if (collectErrors && errors.empty() == false)
+    {
+        std::stable_sort(errors.begin(), errors.end(), [](const AsmError &a, const AsmError &b)
+                         { return a.lineNumber < b.lineNumber; });
+        return;
+    }
+
+    // the next assembly can reuse the bytes of this one
+    if (IsLineCacheUsed())
+    {
+        size_t dataSize = source.size();
+        for (const Segment &segment : segments)
+            dataSize += segment.data.size();
+
+        lineCache.Begin(statements.size(), dataSize);
+        for (size_t i = 0; i < statements.size(); i++)
+        {
+            const Statement &statement = statements[i];
+            const Segment &segment = segments[statement.segmentIndex];
+            lineCache.Add(statementKeys[i], statement.line, segment.data.data() + (statement.address - segment.address), statement.length);
+        }
+        lineCache.Commit();
+    }
+}
+
+void AsmA65k::PatchFixup(const Fixup &fixup)
+{
+    actLineNumber = fixup.lineNumber;
+    actLine = fixup.lineContent;
+    actToken = std::string_view();
+
+    // the symbols the expression uses had to be defined later in the assembly file
+    actStatementIndex = fixup.statementIndex;
+    uint32_t value = 0;
+    uint32_t undefinedSymbol = SymbolTable::INVALID_ID;
+    if (EvaluateExpression(fixupTokens.data() + fixup.firstToken, fixup.tokenCount, value, undefinedSymbol) == false)
+    {
+        AsmError error(fixup.lineNumber, fixup.lineContent, "Undefined label: " + string(labels.GetName(undefinedSymbol)));
+        throw error;
+    }
+
+    Segment &segment = segments[fixup.segmentIndex];
+    const uint32_t address = segment.address + fixup.offset;
+    OpcodeSize opcodeSize = fixup.opcodeSize;
+
+    if (fixup.isRelative)
+    {
+        value -= address;
+        value -= 2;
+        opcodeSize = OS_16BIT;
+        if (GetOpcodeSizeFromSignedInteger(value) < OS_16BIT)
+        {
+            ThrowException_SymbolOutOfRange();
+        }
+    }
+    else if (GetOpcodeSizeFromUnsigedInteger(value) < opcodeSize)
+    {
+        ThrowException_SymbolOutOfRange();
+    }
+
+    switch (opcodeSize)
+    {
+    case OS_8BIT:
+        segment.WriteByte(address, (uint8_t)value);
+        break;
+    case OS_16BIT:
+        segment.WriteWord(address, (uint16_t)value);
+        break;
+    case OS_32BIT:
+        segment.WriteDword(address, (uint32_t)value);
+        break;
+    default:
+        ThrowException_InternalError();
+    }
+}
+
+void AsmA65k::RecordError(AsmError &error)
+{
+    const uintptr_t lineStart = (uintptr_t)actLine.data();
+    const uintptr_t tokenStart = (uintptr_t)actToken.data();
+    if (error.column == 0 && actToken.data() != nullptr && tokenStart >= lineStart && tokenStart <= lineStart + actLine.size())
+        error.column = (unsigned int)(tokenStart - lineStart) + 1;
+
+    if (collectErrors == false)
+        throw error;
+
+    errors.push_back(error);
+}
+
+void AsmA65k::ProcessLabelDefinition(std::string_view labelName)
+{
+    const std::string_view label = lineArena.ToLower(labelName);
+    const uint32_t symbolId = labels.Intern(label);
+
+    if (labels.IsDefined(symbolId)) // check if already contains
+    {
+        AsmError error(actLineNumber, actLine);
+        error.errorMessage = "Label '";
+        error.errorMessage += label;
+        error.errorMessage += "' already defined";
+
+        throw error;
+    }
+    DefineSymbol(symbolId, PC);
+    symbolDefinitions[symbolId].isRelocatable = IsRelocatableSegment((uint32_t)segments.size() - 1);
+    hasLabels = true;
+}
 
-            // now we must find which segment this value must be written, so we iterate thorugh each segments
-            for (auto &actSegment : segments)
+void AsmA65k::CheckExportedSymbols()
+{
+    for (const ExportedSymbol &symbol : exportedSymbols)
+    {
+        if (labels.IsDefined(symbol.symbolId) == false)
+        {
+            actLine = symbol.line;
+            actToken = std::string_view();
+            AsmError error(symbol.lineNumber, symbol.line, "Exported symbol not defined: " + string(labels.GetName(symbol.symbolId)));
+            RecordError(error);
+        }
+    }
+}
+
+// the options, the line cache and the encoder contexts are kept as well
+void AsmA65k::Reset()
+{
+    RecycleSegments();
+    statements.clear();
+    redefinitions.clear();
+    symbolDefinitions.clear();
+    labels.Clear();
+    fixups.clear();
+    fixupTokens.clear();
+    jumpStates.clear();
+    referencedSymbols.clear();
+    statementKeys.clear();
+    errors.clear();
+    sourceFiles.clear();
+    sourceRanges.clear();
+    sourceStack.clear();
+    includedFiles.clear();
+    exportedSymbols.clear();
+    stats = AsmStats();
+    lineArena.Reset();
+    PC = 0;
+    actLineNumber = 1;
+    actLine = std::string_view();
+    isStatementBoundary = false;
+}
+
+void AsmA65k::RecycleSegments()
+{
+    for (Segment &segment : segments)
+    {
+        segment.data.clear();
+        spareSegments.push_back(std::move(segment));
+    }
+    segments.clear();
+}
+
+void AsmA65k::AddSegment(const uint32_t address)
+{
+    if (spareSegments.empty())
+        segments.push_back(Segment());
+    else
+    {
+        segments.push_back(std::move(spareSegments.back()));
+        spareSegments.pop_back();
+    }
+    segments.back().address = address;
+}
+
+std::optional<AsmError> AsmA65k::SizeSource(std::string_view source)
+{
+    RecycleSegments();
+    statements.clear();
+    redefinitions.clear();
+    symbolDefinitions.clear();
+    labels.Clear();
+    referencedSymbols.clear();
+    errors.clear();
+    exportedSymbols.clear();
+    isStatementBoundary = false;
+    hasLabels = false;
+    usesAddress = false;
+    stats.sizingPasses++;
+    stats.instructions = 0;
+    stats.directives = 0;
+    std::fill(std::begin(stats.operandTypes), std::end(stats.operandTypes), 0);
+
+    macroNames.Clear();
+    macros.clear();
+    macroLines.clear();
+    macroPieces.clear();
+    macroText.clear();
+    macroParameters.clear();
+    macroArguments.clear();
+    definedMacro = NO_MACRO;
+    expansionCount = 0;
+    expansionArena.Reset();
+
+    // .include and the macros push their lines to the source stack, they are processed before the rest of the including file
+    sourceFiles.resize(1);
+    includedFiles.clear();
+    sourceRanges.assign(1, SourceRange{1, 0, 1});
+    sourceStack.assign(1, SourceCursor{source});
+
+    // the lines before the first .pc are the relocatable section of an object
+    if (relocatable)
+        AddSegment(0);
+
+    // the lines are processed in place, without copying them out of the source buffer
+    std::optional<AsmError> sizingError;
+    SourceLine macroTokens;
+    isSizingPass = true;
+    try
+    {
+        while (sourceStack.empty() == false)
+        {
+            SourceCursor &cursor = sourceStack.back();
+            const SourceLine *tokens = nullptr;
+            bool isAtEnd = false;
+            if (cursor.macroIndex != NO_MACRO) // the lines of a macro expansion are built from the pieces of its body
+            {
+                const Macro &macro = macros[cursor.macroIndex];
+                const uint32_t lineIndex = cursor.lineNumber - macro.lineNumber - 1;
+                isAtEnd = lineIndex >= macro.lineCount;
+                bool isTokenized = false;
+                if (isAtEnd == false)
+                    actLine = ExpandMacroLine(cursor, lineIndex, macroTokens, isTokenized);
+                if (isTokenized)
+                    tokens = &macroTokens;
+            }
+            else if (cursor.file != nullptr) // the lines of an included file are split and tokenized already
             {
-                // make boundary check for given segment
-                if ((actSegment.address <= actLocation.address) && ((actSegment.data.size() + actSegment.address) > actLocation.address))
+                isAtEnd = cursor.lineNumber > cursor.file->lines.size();
+                if (isAtEnd == false)
                 {
-                    // suitable segment found, write value to stored address in that segment in the right size
-                    uint32_t value = labels[label];
-
-                    if (actLocation.isRelative)
-                    {
-                        value -= actLocation.address;
-                        value -= 2;
-                        actLocation.opcodeSize = OS_16BIT;
-                        if (GetOpcodeSizeFromSignedInteger(value) < OS_16BIT)
-                        {
-                            ThrowException_SymbolOutOfRange();
-                        }
-                    }
-                    else if (GetOpcodeSizeFromUnsigedInteger(value) < actLocation.opcodeSize)
-                    {
-                        ThrowException_SymbolOutOfRange();
-                    }
-
-                    switch (actLocation.opcodeSize)
-                    {
-                    case OS_8BIT:
-                        actSegment.WriteByte(actLocation.address, (uint8_t)value);
-                        break;
-                    case OS_16BIT:
-                        actSegment.WriteWord(actLocation.address, (uint16_t)value);
-                        break;
-                    case OS_32BIT:
-                        actSegment.WriteDword(actLocation.address, (uint32_t)value);
-                        break;
-                    default:
-                        ThrowException_InternalError();
-                    }
-                    break;
+                    const IncludedLine &line = cursor.file->lines[cursor.lineNumber - 1];
+                    actLine = line.text;
+                    if (line.isTokenized)
+                        tokens = &line.tokens;
                 }
             }
+            else if (cursor.position >= cursor.text.size())
+                isAtEnd = true;
+            else
+            {
+                size_t lineEnd = cursor.text.find('\n', cursor.position);
+                if (lineEnd == std::string_view::npos)
+                    lineEnd = cursor.text.size();
+
+                actLine = cursor.text.substr(cursor.position, lineEnd - cursor.position);
+                if (actLine.empty() == false && actLine.back() == '\r')
+                    actLine.remove_suffix(1);
+                cursor.position = lineEnd + 1;
+            }
+
+            if (isAtEnd)
+            {
+                // a macro definition can't go on after the end of its file
+                if (definedMacro != NO_MACRO && macros[definedMacro].fileIndex == cursor.fileIndex)
+                    EndMacroDefinition(false);
+
+                if (cursor.macroIndex != NO_MACRO)
+                    macroArguments.resize(cursor.firstArgument);
+                sourceStack.pop_back();
+                if (sourceStack.empty() == false)
+                    sourceRanges.push_back(SourceRange{actLineNumber, sourceStack.back().fileIndex, sourceStack.back().lineNumber});
+                continue;
+            }
+            cursor.lineNumber++; // the cursor is not valid after the line, .include might push another one
+
+            lineFirstSymbol = (uint32_t)referencedSymbols.size();
+            lineAddress = PC;
+            lineUsesAddress = false;
+            const uint32_t lineStartPC = PC;
+            try
+            {
+                ProcessAsmLine(actLine, tokens);
+            }
+            catch (AsmError &error)
+            {
+                RecordError(error);
+
+                // the line is skipped, as if it was empty. the label it defines is kept
+                PC = lineStartPC;
+                if (statements.empty() == false && statements.back().lineNumber == actLineNumber)
+                    statements.pop_back();
+            }
+            if (statements.empty() || statements.back().lineNumber != actLineNumber) // the line didn't emit anything
+                referencedSymbols.resize(lineFirstSymbol);
+
+            lineArena.Reset();
+            actLineNumber++;
         }
     }
+    catch (AsmError &error)
+    {
+        // the lines before the error are still encoded, they might hold an error reported by the encoding pass only
+        sizingError = error;
+        lineArena.Reset();
+    }
+    isSizingPass = false;
+    stats.lines = actLineNumber - 1;
 
-    return &segments;
+    std::stable_sort(redefinitions.begin(), redefinitions.end(), [](const SymbolRedefinition &a, const SymbolRedefinition &b)
+                     { return a.symbolId < b.symbolId; });
+
+    return sizingError;
 }
 
-void AsmA65k::ProcessLabelDefinition(const string& line)
+// relaxation only ever shortens jumps, so it reaches a fixed point. a relaxed jump that gets out of reach
+// as other segments' code moves is turned back into a jmp for good, which stops it from oscillating
+bool AsmA65k::RelaxJumps()
 {
-    const static regex rx_detectLabel(R"(\s*([a-z][a-z_0-9]*):.*)", regex_constants::icase);
-    smatch labelMatch;
-    if (regex_match(line, labelMatch, rx_detectLabel))
+    bool isChanged = false;
+    jumpStates.resize(statements.size(), JS_LONG);
+
+    for (size_t i = 0; i < statements.size(); i++)
     {
-        string label = labelMatch[1].str();
-        std::transform(label.begin(), label.end(), label.begin(), ::tolower);
+        const Statement &statement = statements[i];
+        if (statement.isRelaxable == false || jumpStates[i] == JS_KEEP_LONG)
+            continue;
 
-        if (labels.find(label) != labels.end()) // check if already contains
+        bool isInRange = false;
+        if (labels.IsDefined(statement.jumpTarget) && IsInSameSection(statement.segmentIndex, statement.jumpTarget))
         {
-            AsmError error(actLineNumber, line);
-            error.errorMessage = "Label '";
-            error.errorMessage += label;
-            error.errorMessage += "' already defined";
+            actStatementIndex = (uint32_t)i;
+            const int32_t diff = GetSymbolValue(statement.jumpTarget) - statement.address - 4; // same as in HandleOperand_Constant()
+            isInRange = diff >= -32768 && diff <= 32767;
+        }
 
-            throw error;
+        if (jumpStates[i] == JS_LONG && isInRange)
+        {
+            jumpStates[i] = JS_RELAXED;
+            isChanged = true;
+        }
+        else if (jumpStates[i] == JS_RELAXED && isInRange == false)
+        {
+            jumpStates[i] = JS_KEEP_LONG;
+            isChanged = true;
         }
-        labels[label] = PC;
     }
+
+    return isChanged;
+}
+
+void AsmA65k::DefineSymbol(const uint32_t symbolId, const uint32_t value)
+{
+    if (symbolDefinitions.size() < labels.GetSize())
+        symbolDefinitions.resize(labels.GetSize());
+
+    SymbolDefinition &definition = symbolDefinitions[symbolId];
+    const uint32_t statementIndex = (uint32_t)statements.size();
+
+    // the encoding pass sees the final values only, so the history of the symbols defined more than once is kept
+    if (labels.IsDefined(symbolId))
+    {
+        if (definition.isRedefined == false)
+            redefinitions.push_back(SymbolRedefinition{symbolId, definition.statementIndex, labels.GetValue(symbolId)});
+        redefinitions.push_back(SymbolRedefinition{symbolId, statementIndex, value});
+        definition.isRedefined = true;
+    }
+
+    definition.statementIndex = statementIndex;
+    labels.Define(symbolId, value);
+    isStatementBoundary = true;
 }
 
-void AsmA65k::InitializeOpcodetable()
-{
-    OpcodeAttribute oa;
-    oa.isSizeSpecifierAllowed = true;
-    oa.isPostfixEnabled = true;
-
-    oa.addressingModesAllowed = {AM_DIRECT, AM_REGISTER1, AM_ABSOLUTE1, AM_REGISTER_INDIRECT1, AM_INDEXED1};
-    oa.instructionCode = I_JMP;
-    opcodes["jmp"] = oa;
-    oa.instructionCode = I_JSR;
-    opcodes["jsr"] = oa;
-
-    oa.addressingModesAllowed = {AM_REGISTER1, AM_REGISTER_INDIRECT1, AM_ABSOLUTE1, AM_INDEXED1};
-    oa.instructionCode = I_CLR;
-    opcodes["clr"] = oa;
-    oa.instructionCode = I_POP;
-    opcodes["pop"] = oa;
-    oa.instructionCode = I_INC;
-    opcodes["inc"] = oa;
-    oa.instructionCode = I_DEC;
-    opcodes["dec"] = oa;
-
-    oa.addressingModesAllowed = {AM_CONST_IMMEDIATE, AM_REGISTER1, AM_REGISTER_INDIRECT1, AM_ABSOLUTE1, AM_INDEXED1};
-    oa.instructionCode = I_PUSH;
-    opcodes["push"] = oa;
-
-    oa.addressingModesAllowed = {AM_REG_IMMEDIATE,            // Rx, const
-                                 AM_REGISTER2,                // Rx, Ry
-                                 AM_ABSOLUTE_SRC,             // Rx, [$1234]
-                                 AM_ABSOLUTE_DEST,            // [$1234], Rx
-                                 AM_REGISTER_INDIRECT_SRC,    // Rx, [Ry]
-                                 AM_REGISTER_INDIRECT_DEST,   // [Rx], Ry
-                                 AM_INDEXED_SRC,              // Rx, [Ry + 123]
-                                 AM_INDEXED_DEST,             // [Rx + 123], Ry
-                                 AM_ABSOLUTE_CONST,           // [$1234], const
-                                 AM_INDEXED_CONST,            // [Rx + 123], const
-                                 AM_REGISTER_INDIRECT_CONST}; // [Rx], const
-
-    oa.instructionCode = I_MOV;
-    opcodes["mov"] = oa;
-    oa.instructionCode = I_ADD;
-    opcodes["add"] = oa;
-    oa.instructionCode = I_SUB;
-    opcodes["sub"] = oa;
-    oa.instructionCode = I_AND;
-    opcodes["and"] = oa;
-    oa.instructionCode = I_OR;
-    opcodes["or"] = oa;
-    oa.instructionCode = I_XOR;
-    opcodes["xor"] = oa;
-    oa.instructionCode = I_SHL;
-    opcodes["shl"] = oa;
-    oa.instructionCode = I_SHR;
-    opcodes["shr"] = oa;
-    oa.instructionCode = I_ROL;
-    opcodes["rol"] = oa;
-    oa.instructionCode = I_ROR;
-    opcodes["ror"] = oa;
-    oa.instructionCode = I_CMP;
-    opcodes["cmp"] = oa;
-    oa.isSizeSpecifierAllowed = false;
-    oa.instructionCode = I_MUL;
-    opcodes["mul"] = oa;
-    oa.instructionCode = I_DIV;
-    opcodes["div"] = oa;
-    oa.instructionCode = I_SXB;
-    opcodes["sxb"] = oa;
-    oa.instructionCode = I_SXW;
-    opcodes["sxw"] = oa;
-
-    oa.isPostfixEnabled = false;
-    oa.addressingModesAllowed = {AM_IMPLIED};
-    oa.instructionCode = I_SEC;
-    opcodes["sec"] = oa;
-    oa.instructionCode = I_CLC;
-    opcodes["clc"] = oa;
-    oa.instructionCode = I_SEV;
-    opcodes["sev"] = oa;
-    oa.instructionCode = I_CLV;
-    opcodes["clv"] = oa;
-    oa.instructionCode = I_SEI;
-    opcodes["sei"] = oa;
-    oa.instructionCode = I_CLI;
-    opcodes["cli"] = oa;
-    oa.instructionCode = I_PUSHA;
-    opcodes["pusha"] = oa;
-    oa.instructionCode = I_POPA;
-    opcodes["popa"] = oa;
-    oa.instructionCode = I_NOP;
-    opcodes["nop"] = oa;
-    oa.instructionCode = I_BRK;
-    opcodes["brk"] = oa;
-    oa.instructionCode = I_RTS;
-    opcodes["rts"] = oa;
-    oa.instructionCode = I_RTI;
-    opcodes["rti"] = oa;
-    oa.instructionCode = I_SLP;
-    opcodes["slp"] = oa;
-
-    oa.addressingModesAllowed = {AM_RELATIVE};
-    oa.instructionCode = I_BRA;
-    opcodes["bra"] = oa;
-    oa.instructionCode = I_BEQ;
-    opcodes["beq"] = oa;
-    oa.instructionCode = I_BNE;
-    opcodes["bne"] = oa;
-    oa.instructionCode = I_BCC;
-    opcodes["bcc"] = oa;
-    oa.instructionCode = I_BCS;
-    opcodes["bcs"] = oa;
-    oa.instructionCode = I_BPL;
-    opcodes["bpl"] = oa;
-    oa.instructionCode = I_BMI;
-    opcodes["bmi"] = oa;
-    oa.instructionCode = I_BVC;
-    opcodes["bvc"] = oa;
-    oa.instructionCode = I_BVS;
-    opcodes["bvs"] = oa;
-    oa.instructionCode = I_BLT;
-    opcodes["blt"] = oa;
-    oa.instructionCode = I_BGT;
-    opcodes["bgt"] = oa;
-    oa.instructionCode = I_BLE;
-    opcodes["ble"] = oa;
-    oa.instructionCode = I_BGE;
-    opcodes["bge"] = oa;
-
-    oa.addressingModesAllowed = {AM_SYSCALL};
-    oa.instructionCode = I_SYS;
-    opcodes["sys"] = oa;
+uint32_t AsmA65k::GetSymbolValue(const uint32_t symbolId) const
+{
+    const AsmA65k &owner = GetMaster();
+
+    if (symbolId < owner.symbolDefinitions.size() && owner.symbolDefinitions[symbolId].isRedefined)
+    {
+        // a statement sees the value of the last definition preceding it. statements preceding
+        // all of the definitions were forward references in a single pass, they see the final value.
+        // the redefinitions of a symbol are in the order of their statements, see SizeSource()
+        const SymbolRedefinition key = {symbolId, actStatementIndex, 0};
+        const auto compareDefinitions = [](const SymbolRedefinition &a, const SymbolRedefinition &b)
+        { return a.symbolId < b.symbolId || (a.symbolId == b.symbolId && a.statementIndex < b.statementIndex); };
+        const auto nextDefinition = std::upper_bound(owner.redefinitions.begin(), owner.redefinitions.end(), key, compareDefinitions);
+
+        if (nextDefinition != owner.redefinitions.begin() && std::prev(nextDefinition)->symbolId == symbolId)
+            return std::prev(nextDefinition)->value;
+    }
+
+    return owner.labels.GetValue(symbolId);
+}
+
+void AsmA65k::RecordStatement(const uint32_t address)
+{
+    if (PC == address)
+        return;
+
+    statements.push_back(Statement{actLine, actLineNumber, address, (uint32_t)segments.size() - 1, PC - address,
+                                   lineFirstSymbol, (uint32_t)referencedSymbols.size() - lineFirstSymbol});
+    statements.back().usesAddress = lineUsesAddress;
+    isStatementBoundary = false;
+}
+
+uint32_t AsmA65k::InternReference(std::string_view name)
+{
+    const uint32_t symbolId = labels.Intern(name);
+    if (useLineCache)
+        referencedSymbols.push_back(symbolId);
+
+    return symbolId;
+}
+
+// FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void *data, const size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// besides the line, the bytes depend on the values of the symbols it uses, on the address for branches and '*',
+// and on the changes of the optimizer. the symbol values are the ones this statement sees
+uint64_t AsmA65k::GetStatementKey(const Statement &statement) const
+{
+    const AsmA65k &owner = GetMaster();
+    uint64_t hash = HashBytes(0xcbf29ce484222325, statement.line.data(), statement.line.size());
+
+    const uint8_t instruction = statement.instructionWord.instructionCode;
+    if ((statement.isInstruction && instruction >= I_BRA && instruction <= I_BGE) || statement.usesAddress)
+        hash = HashBytes(hash, &statement.address, sizeof(statement.address));
+
+    hash = HashBytes(hash, &statement.rewrite, sizeof(statement.rewrite));
+
+    const auto hashSymbol = [this, &owner, &hash](const uint32_t symbolId)
+    {
+        const uint32_t value = owner.labels.IsDefined(symbolId) ? GetSymbolValue(symbolId) : 0;
+        const uint8_t isDefined = owner.labels.IsDefined(symbolId);
+        hash = HashBytes(hash, &value, sizeof(value));
+        hash = HashBytes(hash, &isDefined, sizeof(isDefined));
+    };
+
+    for (uint32_t i = 0; i < statement.symbolCount; i++)
+        hashSymbol(owner.referencedSymbols[statement.firstSymbol + i]);
+    if (statement.isRetargeted)
+        hashSymbol(statement.jumpTarget);
+
+    return hash;
+}
+
+void AsmA65k::EncodeStatements(const size_t first, const size_t last)
+{
+    AsmA65k &owner = GetMaster();
+
+    for (size_t i = first; i < last; i++)
+    {
+        const Statement &statement = owner.statements[i];
+        Segment &segment = owner.segments[statement.segmentIndex];
+
+        actStatementIndex = (uint32_t)i;
+        actSegmentIndex = statement.segmentIndex;
+        actLine = statement.line;
+        actLineNumber = statement.lineNumber;
+        PC = statement.address;
+        lineAddress = statement.address;
+        output = segment.data.data() + (statement.address - segment.address);
+
+        if (owner.IsLineCacheUsed())
+        {
+            const uint64_t key = GetStatementKey(statement);
+            owner.statementKeys[i] = key;
+
+            const uint8_t *bytes = owner.lineCache.Find(key, statement.line, statement.length);
+            if (bytes != nullptr)
+            {
+                memcpy(output, bytes, statement.length);
+                stats.cachedStatements++;
+                continue;
+            }
+        }
+
+        try
+        {
+            ProcessAsmLine(statement.line);
+        }
+        catch (AsmError &error)
+        {
+            RecordError(error);
+            lineArena.Reset();
+            continue;
+        }
+        lineArena.Reset();
+
+        // the sizing pass and the handlers must agree on the length
+        if (PC != statement.address + statement.length)
+            ThrowException_InternalError();
+    }
+}
+
+void AsmA65k::EncodeAllStatements()
+{
+    const size_t statementCount = statements.size();
+    size_t threadCount = encoderThreadCount != 0 ? encoderThreadCount : std::thread::hardware_concurrency();
+    threadCount = std::max((size_t)1, std::min(threadCount, statementCount / MIN_STATEMENTS_PER_ENCODER_THREAD));
+
+    if (threadCount == 1)
+    {
+        EncodeStatements(0, statementCount);
+        return;
+    }
+
+    // each worker has its own context for the per-line state and its fixups, this context takes the first chunk
+    while (encoders.size() < threadCount - 1)
+        encoders.push_back(std::make_unique<AsmA65k>());
+    std::vector<std::optional<AsmError>> chunkErrors(threadCount);
+    std::vector<std::exception_ptr> exceptions(threadCount);
+    std::vector<std::thread> threads;
+
+    const auto encodeChunk = [this, statementCount, threadCount, &chunkErrors, &exceptions](const size_t chunk)
+    {
+        AsmA65k &context = chunk == 0 ? *this : *encoders[chunk - 1];
+        try
+        {
+            context.EncodeStatements(statementCount * chunk / threadCount, statementCount * (chunk + 1) / threadCount);
+        }
+        catch (AsmError &error)
+        {
+            chunkErrors[chunk] = error;
+        }
+        catch (...)
+        {
+            exceptions[chunk] = std::current_exception();
+        }
+    };
+
+    for (size_t chunk = 1; chunk < threadCount; chunk++)
+    {
+        encoders[chunk - 1]->master = this;
+        encoders[chunk - 1]->fixups.clear();
+        encoders[chunk - 1]->fixupTokens.clear();
+        encoders[chunk - 1]->errors.clear();
+        encoders[chunk - 1]->stats.cachedStatements = 0;
+        encoders[chunk - 1]->collectErrors = collectErrors;
+        threads.emplace_back(encodeChunk, chunk);
+    }
+    encodeChunk(0);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // the chunks are in source order, so the first error found is the one of the first line
+    for (size_t chunk = 0; chunk < threadCount; chunk++)
+    {
+        if (exceptions[chunk])
+            std::rethrow_exception(exceptions[chunk]);
+        if (chunkErrors[chunk].has_value())
+            throw *chunkErrors[chunk];
+    }
+
+    for (size_t chunk = 1; chunk < threadCount; chunk++)
+    {
+        // the expressions of the fixups are moved after the ones of the previous chunks
+        for (Fixup &fixup : encoders[chunk - 1]->fixups)
+            fixup.firstToken += (uint32_t)fixupTokens.size();
+        fixups.insert(fixups.end(), encoders[chunk - 1]->fixups.begin(), encoders[chunk - 1]->fixups.end());
+        fixupTokens.insert(fixupTokens.end(), encoders[chunk - 1]->fixupTokens.begin(), encoders[chunk - 1]->fixupTokens.end());
+        errors.insert(errors.end(), encoders[chunk - 1]->errors.begin(), encoders[chunk - 1]->errors.end());
+        stats.cachedStatements += encoders[chunk - 1]->stats.cachedStatements;
+    }
+}
+
+constexpr uint64_t AsmA65k::PackMnemonic(std::string_view mnemonic)
+{
+    if (mnemonic.empty() || mnemonic.size() > 7)
+        return 0; // no such mnemonic, never matches a table entry
+
+    uint64_t key = 0;
+    for (size_t i = 0; i < mnemonic.size(); i++)
+    {
+        const char c = mnemonic[i];
+        key |= (uint64_t)(uint8_t)((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c) << (i * 8);
+    }
+
+    return key;
+}
+
+constexpr uint32_t AsmA65k::GetOpcodeSlot(const uint64_t key, const uint64_t multiplier)
+{
+    return (uint32_t)((key * multiplier) >> (64 - OPCODE_HASH_BITS));
+}
+
+constexpr auto AsmA65k::GetOpcodeDefinitions()
+{
+    constexpr uint32_t jumpModes = (1u << AM_DIRECT) | (1u << AM_REGISTER1) | (1u << AM_ABSOLUTE1) | (1u << AM_REGISTER_INDIRECT1) | (1u << AM_INDEXED1);
+    constexpr uint32_t unaryModes = (1u << AM_REGISTER1) | (1u << AM_REGISTER_INDIRECT1) | (1u << AM_ABSOLUTE1) | (1u << AM_INDEXED1);
+    constexpr uint32_t pushModes = unaryModes | (1u << AM_CONST_IMMEDIATE);
+    constexpr uint32_t binaryModes = (1u << AM_REG_IMMEDIATE) |          // Rx, const
+                                     (1u << AM_REGISTER2) |              // Rx, Ry
+                                     (1u << AM_ABSOLUTE_SRC) |           // Rx, [$1234]
+                                     (1u << AM_ABSOLUTE_DEST) |          // [$1234], Rx
+                                     (1u << AM_REGISTER_INDIRECT_SRC) |  // Rx, [Ry]
+                                     (1u << AM_REGISTER_INDIRECT_DEST) | // [Rx], Ry
+                                     (1u << AM_INDEXED_SRC) |            // Rx, [Ry + 123]
+                                     (1u << AM_INDEXED_DEST) |           // [Rx + 123], Ry
+                                     (1u << AM_ABSOLUTE_CONST) |         // [$1234], const
+                                     (1u << AM_INDEXED_CONST) |          // [Rx + 123], const
+                                     (1u << AM_REGISTER_INDIRECT_CONST); // [Rx], const
+    constexpr uint32_t impliedModes = 1u << AM_IMPLIED;
+    constexpr uint32_t branchModes = 1u << AM_RELATIVE;
+    constexpr uint32_t syscallModes = 1u << AM_SYSCALL;
+
+    // mnemonic, instruction code, addressing modes, size specifier allowed, postfix enabled
+    return std::to_array<OpcodeDefinition>({
+        {"jmp", I_JMP, jumpModes, true, true},
+        {"jsr", I_JSR, jumpModes, true, true},
+
+        {"clr", I_CLR, unaryModes, true, true},
+        {"pop", I_POP, unaryModes, true, true},
+        {"inc", I_INC, unaryModes, true, true},
+        {"dec", I_DEC, unaryModes, true, true},
+
+        {"push", I_PUSH, pushModes, true, true},
+
+        {"mov", I_MOV, binaryModes, true, true},
+        {"add", I_ADD, binaryModes, true, true},
+        {"sub", I_SUB, binaryModes, true, true},
+        {"and", I_AND, binaryModes, true, true},
+        {"or", I_OR, binaryModes, true, true},
+        {"xor", I_XOR, binaryModes, true, true},
+        {"shl", I_SHL, binaryModes, true, true},
+        {"shr", I_SHR, binaryModes, true, true},
+        {"rol", I_ROL, binaryModes, true, true},
+        {"ror", I_ROR, binaryModes, true, true},
+        {"cmp", I_CMP, binaryModes, true, true},
+        {"mul", I_MUL, binaryModes, false, true},
+        {"div", I_DIV, binaryModes, false, true},
+        {"sxb", I_SXB, binaryModes, false, true},
+        {"sxw", I_SXW, binaryModes, false, true},
+
+        {"sec", I_SEC, impliedModes, false, false},
+        {"clc", I_CLC, impliedModes, false, false},
+        {"sev", I_SEV, impliedModes, false, false},
+        {"clv", I_CLV, impliedModes, false, false},
+        {"sei", I_SEI, impliedModes, false, false},
+        {"cli", I_CLI, impliedModes, false, false},
+        {"pusha", I_PUSHA, impliedModes, false, false},
+        {"popa", I_POPA, impliedModes, false, false},
+        {"nop", I_NOP, impliedModes, false, false},
+        {"brk", I_BRK, impliedModes, false, false},
+        {"rts", I_RTS, impliedModes, false, false},
+        {"rti", I_RTI, impliedModes, false, false},
+        {"slp", I_SLP, impliedModes, false, false},
+
+        {"bra", I_BRA, branchModes, false, false},
+        {"beq", I_BEQ, branchModes, false, false},
+        {"bne", I_BNE, branchModes, false, false},
+        {"bcc", I_BCC, branchModes, false, false},
+        {"bcs", I_BCS, branchModes, false, false},
+        {"bpl", I_BPL, branchModes, false, false},
+        {"bmi", I_BMI, branchModes, false, false},
+        {"bvc", I_BVC, branchModes, false, false},
+        {"bvs", I_BVS, branchModes, false, false},
+        {"blt", I_BLT, branchModes, false, false},
+        {"bgt", I_BGT, branchModes, false, false},
+        {"ble", I_BLE, branchModes, false, false},
+        {"bge", I_BGE, branchModes, false, false},
+
+        {"sys", I_SYS, syscallModes, false, false},
+    });
+}
+
+// searches for a hash multiplier that maps every mnemonic into its own slot (evaluated at compile time)
+constexpr uint64_t AsmA65k::FindOpcodeHashMultiplier()
+{
+    constexpr auto definitions = GetOpcodeDefinitions();
+    uint64_t state = 0x9e3779b97f4a7c15;
+
+    while (true)
+    {
+        // splitmix64 step
+        state += 0x9e3779b97f4a7c15;
+        uint64_t multiplier = state;
+        multiplier = (multiplier ^ (multiplier >> 30)) * 0xbf58476d1ce4e5b9;
+        multiplier = (multiplier ^ (multiplier >> 27)) * 0x94d049bb133111eb;
+        multiplier = (multiplier ^ (multiplier >> 31)) | 1;
+
+        bool isSlotUsed[OPCODE_TABLE_SIZE] = {};
+        bool isCollisionFree = true;
+        for (const OpcodeDefinition& definition : definitions)
+        {
+            const uint32_t slot = GetOpcodeSlot(PackMnemonic(definition.mnemonic), multiplier);
+            if (isSlotUsed[slot])
+            {
+                isCollisionFree = false;
+                break;
+            }
+            isSlotUsed[slot] = true;
+        }
+
+        if (isCollisionFree)
+            return multiplier;
+    }
+}
+
+constexpr std::array<AsmA65k::OpcodeAttribute, AsmA65k::OPCODE_TABLE_SIZE> AsmA65k::BuildOpcodeTable(const uint64_t multiplier)
+{
+    std::array<OpcodeAttribute, OPCODE_TABLE_SIZE> table = {};
+
+    for (const OpcodeDefinition& definition : GetOpcodeDefinitions())
+    {
+        const uint64_t key = PackMnemonic(definition.mnemonic);
+        OpcodeAttribute& entry = table[GetOpcodeSlot(key, multiplier)];
+        entry.mnemonicKey = key;
+        entry.instructionCode = definition.instructionCode;
+        entry.addressingModesAllowed = definition.addressingModesAllowed;
+        entry.isSizeSpecifierAllowed = definition.isSizeSpecifierAllowed;
+        entry.isPostfixEnabled = definition.isPostfixEnabled;
+    }
+
+    return table;
+}
+
+const AsmA65k::OpcodeAttribute *AsmA65k::FindOpcode(std::string_view mnemonic)
+{
+    static constexpr uint64_t multiplier = FindOpcodeHashMultiplier();
+    static constexpr std::array<OpcodeAttribute, OPCODE_TABLE_SIZE> opcodeTable = BuildOpcodeTable(multiplier);
+
+    const uint64_t key = PackMnemonic(mnemonic);
+    const OpcodeAttribute& entry = opcodeTable[GetOpcodeSlot(key, multiplier)];
+
+    if (key == 0 || entry.mnemonicKey != key)
+        return nullptr;
+
+    return &entry;
 }
@@ -11,31 +11,92 @@
 #pragma once
 
 #include <Segment.h>
+#include <LineArena.h>
+#include <SymbolTable.h>
+#include <LineCache.h>
+#include <MappedFile.h>
+#include <SymbolFile.h>
+#include <ObjectFile.h>
 #include <iostream>
 #include <cstdarg>
 #include <vector>
-#include <map>
+#include <array>
+#include <string_view>
+#include <optional>
+#include <memory>
+#include <chrono>
 
 using string = std::string;
 
+struct AsmSourceLocation // a line of a source file
+{
+    string fileName;
+    unsigned int lineNumber;
+    bool isMacro = false; // the line invoked a macro, rather than including a file
+};
+
 struct AsmError
 {
-    AsmError(unsigned int lineNumber, string lineContent) : lineNumber(lineNumber),
-                                                            lineContent(lineContent) {}
+    AsmError(unsigned int lineNumber, std::string_view lineContent) : lineNumber(lineNumber),
+                                                                      lineContent(lineContent) {}
 
-    AsmError(unsigned int lineNumber, string lineContent, string errorString) : lineNumber(lineNumber),
-                                                                                lineContent(lineContent),
-                                                                                errorMessage(errorString) {}
+    AsmError(unsigned int lineNumber, std::string_view lineContent, string errorString) : lineNumber(lineNumber),
+                                                                                          lineContent(lineContent),
+                                                                                          errorMessage(errorString) {}
 
     unsigned int lineNumber;
+    unsigned int column = 0; // 1 based, 0 if it's not known
     string lineContent;
     string errorMessage;
+    string fileName;                             // the included file holding the line, empty for the main source
+    std::vector<AsmSourceLocation> includeStack; // the .include lines and macro invocations that led to the line, the innermost first
+};
+
+// the counters and phase timers of the last Assemble() call, collected if AsmA65k::SetStatistics() enabled them.
+// the times are in seconds. the lexing, directive and operand times are the parts of the sizing passes spent there
+struct AsmStats
+{
+    static constexpr int OPERAND_TYPE_COUNT = 39; // the number of AsmA65k::OperandTypes
+
+    double sizingSeconds = 0;    // all sizing passes
+    double lexingSeconds = 0;    // splitting the lines into label, keyword and operand
+    double directiveSeconds = 0; // the directive handlers
+    double operandSeconds = 0;   // parsing the operands of the instructions
+    double optimizerSeconds = 0; // the jump relaxation and the jump chains of the optimizer
+    double encodingSeconds = 0;  // the encoding pass, on all of its threads
+    double fixupSeconds = 0;     // patching the forward references
+
+    uint32_t sizingPasses = 0;      // more than one with jump relaxation
+    uint64_t lines = 0;             // the counters of the source are the ones of the last sizing pass
+    uint64_t instructions = 0;
+    uint64_t directives = 0;
+    uint64_t symbols = 0;
+    uint64_t fixups = 0;
+    uint64_t cachedStatements = 0;  // statements whose bytes came from the line cache
+    uint64_t outputBytes = 0;
+    uint64_t operandTypes[OPERAND_TYPE_COUNT] = {}; // the instructions by operand type, see AsmA65k::GetOperandTypeName()
 };
 
 class AsmA65k
 {
 public:
+    std::vector<Segment> *Assemble(std::string_view source, std::string_view fileName = std::string_view()); // assembles the source in place, the buffer must stay valid during the call. relative .include paths start from the directory of fileName
     std::vector<Segment> *Assemble(std::stringstream &source);
+    void Reset();                                         // clears the results of the last assembly, keeping the memory of the containers
+    void SetErrorCollection(bool isEnabled);              // skips the lines with errors instead of throwing, the errors are listed by GetErrors()
+    const std::vector<AsmError> &GetErrors() const;       // the errors of the last assembly in line order, with error collection only
+    void SetEncoderThreadCount(unsigned int threadCount); // the number of threads encoding a single source, 0 means one per hardware thread
+    void SetJumpRelaxation(bool isEnabled);               // converts jmp to the shorter bra wherever the target is within its reach
+    void SetOptimization(bool isEnabled);                 // enables the peephole optimizer, see AsmA65k-Optimizer.cpp
+    void SetLineCache(bool isEnabled);                    // keeps the encoded lines for the next Assemble() call, which re-encodes the changed ones only
+    void SetStatistics(bool isEnabled);                   // times the phases of the assembly, see AsmStats
+    const AsmStats &GetStatistics() const;
+    static const char *GetOperandTypeName(int operandType); // "register__constant" for OT_REGISTER__CONSTANT
+    bool IsSymbolOnly() const;                            // the last assembly only defined symbols with .def, no '*' and no macros, so its symbols can be precompiled
+    bool WriteSymbolFile(const char *filename, std::string_view source) const; // writes the symbols of the last assembly of 'source', see SymbolFile
+    void SetRelocatable(bool isEnabled);                  // assembles the lines before the first .pc into a relocatable section and imports the undefined symbols, for WriteObjectFile()
+    bool WriteObjectFile(const char *filename) const;     // writes the last relocatable assembly as an object file, see ObjectFile
+    std::vector<Segment> *Link(const std::vector<std::string> &objectFiles, const uint32_t baseAddress); // merges object files, their relocatable sections are placed one after the other from baseAddress
 
 private:
     // constants, structs
@@ -48,7 +109,11 @@ private:
         DIRECTIVE_TEXTZ,  // .text "Hello world!\n", 0
         DIRECTIVE_BYTE,   // .byte 1, 2, 3, $4, %1100101
         DIRECTIVE_WORD,   // .word 1, 2, 3, $ffff, %1100101
-        DIRECTIVE_DWORD   // .dword 1, 2, 3, $ffffffff, %1100101
+        DIRECTIVE_DWORD,  // .dword 1, 2, 3, $ffffffff, %1100101
+        DIRECTIVE_INCLUDE, // .include "registers.s"
+        DIRECTIVE_MACRO,   // .macro name param1, param2
+        DIRECTIVE_ENDM,    // .endm
+        DIRECTIVE_EXPORT   // .export name1, name2
     };
 
     enum OperandTypes
@@ -202,12 +267,25 @@ private:
 
     struct OpcodeAttribute
     {
+        uint64_t mnemonicKey;            // the mnemonic packed by PackMnemonic(), 0 marks an empty slot
         uint8_t instructionCode;
-        std::vector<AddressingModes> addressingModesAllowed;
+        uint32_t addressingModesAllowed; // bit n is set if AddressingModes n is allowed
         bool isSizeSpecifierAllowed;
         bool isPostfixEnabled;
     };
 
+    struct OpcodeDefinition // an entry of the instruction set listing in GetOpcodeDefinitions()
+    {
+        const char *mnemonic;
+        Instructions instructionCode;
+        uint32_t addressingModesAllowed;
+        bool isSizeSpecifierAllowed;
+        bool isPostfixEnabled;
+    };
+
+    static constexpr unsigned OPCODE_HASH_BITS = 8;                       // the opcode table is indexed by the top bits of the mnemonic's hash
+    static constexpr unsigned OPCODE_TABLE_SIZE = 1u << OPCODE_HASH_BITS;
+
     struct InstructionWord
     {
         uint16_t addressingMode : 5;
@@ -216,15 +294,6 @@ private:
         uint16_t opcodeSize : 2;
     };
 
-    struct StringPair
-    {
-        StringPair(){};
-        StringPair(string left, string right) : left(left), right(right){};
-
-        string left;
-        string right;
-    };
-
     enum RegisterType
     {
         REG_R0,
@@ -245,13 +314,45 @@ private:
         REG_PC
     };
 
-    struct LabelLocation
+    enum ExpressionOperator : uint8_t // the elements of an expression in reverse polish notation, see ParseExpression()
     {
-        uint32_t address;
+        EXPR_CONSTANT,    // pushes 'value'
+        EXPR_ADDRESS,     // pushes 'value', the address of the line for '*'. it isn't folded like the constants
+        EXPR_SYMBOL,      // pushes the value of the symbol 'value'
+        EXPR_NEGATE,      // -x
+        EXPR_NOT,         // ~x
+        EXPR_LOW_BYTE,    // <x
+        EXPR_HIGH_BYTE,   // >x
+        EXPR_MULTIPLY,    // x * y
+        EXPR_DIVIDE,      // x / y
+        EXPR_ADD,         // x + y
+        EXPR_SUBTRACT,    // x - y
+        EXPR_SHIFT_LEFT,  // x << y
+        EXPR_SHIFT_RIGHT, // x >> y
+        EXPR_AND,         // x & y
+        EXPR_XOR,         // x ^ y
+        EXPR_OR           // x | y
+    };
+
+    struct ExpressionToken
+    {
+        ExpressionOperator type;
+        uint32_t value;
+    };
+
+    static constexpr uint32_t MAX_EXPRESSION_STACK = 32; // the values an expression keeps on the stack at the same time, and the depth of its parentheses
+
+    struct Fixup // a field whose expression used a symbol that wasn't defined yet. kept for the linker as a relocation in object files
+    {
+        uint32_t firstToken;   // the expression in fixupTokens
+        uint32_t tokenCount;
+        uint32_t statementIndex;
+        uint32_t segmentIndex; // the segment holding the field to be patched
+        uint32_t offset;       // the field's byte offset inside the segment
         OpcodeSize opcodeSize;
+        bool isRelative;              // branches store the distance from the field's address + 2
         uint32_t lineNumber;
-        string lineContent;
-        bool isRelative;
+        std::string_view lineContent; // points into the source buffer
     };
 
     enum PostfixType
@@ -261,105 +362,462 @@ private:
         PF_DEC
     };
 
+    enum OperandTermType
+    {
+        TERM_REGISTER, // r0
+        TERM_CONSTANT, // $1234
+        TERM_LABEL     // names
+    };
+
+    enum OperandShape // the form of one side of a comma separated operand
+    {
+        SHAPE_REGISTER,                        // r0
+        SHAPE_CONSTANT,                        // 1234
+        SHAPE_LABEL,                           // names
+        SHAPE_INDIRECT_REGISTER,               // [r0]
+        SHAPE_INDIRECT_CONSTANT,               // [1234]
+        SHAPE_INDIRECT_LABEL,                  // [names]
+        SHAPE_INDIRECT_REGISTER_PLUS_CONSTANT, // [r0 + 1234]
+        SHAPE_INDIRECT_REGISTER_PLUS_LABEL,    // [r0 + names]
+        SHAPE_INDIRECT_CONSTANT_PLUS_REGISTER, // [1234 + r0]
+        SHAPE_INDIRECT_LABEL_PLUS_REGISTER     // [names + r0]
+    };
+
+    struct OperandValue
+    {
+        bool isLabel = false;    // decides whether 'constant' or the expression is valid
+        uint32_t constant = 0;   // $1234, or an expression of constants folded into one
+        uint32_t firstToken = 0; // the expression in expressionTokens: names, "table + 4 * 2" or "*"
+        uint32_t tokenCount = 0;
+    };
+
+    struct Operand // the descriptor of an instruction's operand, built by ParseOperand()
+    {
+        OperandTypes type = OT_NONE;
+        RegisterType registers[2] = {REG_R0, REG_R0}; // registers in the order of appearance
+        OperandValue values[2];                       // constants and labels in the order of appearance
+        uint8_t registerCount = 0;
+        uint8_t valueCount = 0;
+        PostfixType postfix = PF_NONE; // [r0]+ or [r0]-
+    };
+
+    enum Rewrite : uint8_t // a change of an instruction made by the relaxation or the optimizer
+    {
+        RW_NONE,
+        RW_BRA, // jmp label -> bra label
+        RW_JMP, // jsr addr -> jmp addr, when followed by an rts
+        RW_CLR, // mov rX, 0 -> clr rX
+        RW_INC, // add rX, 1 -> inc rX
+        RW_DEC  // sub rX, 1 -> dec rX
+    };
+
+    struct Statement // a line that emits bytes. the sizing pass assigns its address, the encoding pass fills it in
+    {
+        std::string_view line;
+        uint32_t lineNumber;
+        uint32_t address;
+        uint32_t segmentIndex;
+        uint32_t length;
+        uint32_t firstSymbol = 0;                      // the symbols the line refers to in referencedSymbols, with the line cache only
+        uint32_t symbolCount = 0;
+        uint32_t jumpTarget = SymbolTable::INVALID_ID; // the label operand of a jump or branch
+        InstructionWord instructionWord = {};          // the instruction as encoded, valid if isInstruction is set
+        uint8_t operandType = OT_NONE;
+        uint8_t operandRegister = REG_R0;              // the first register of the operand
+        Rewrite rewrite = RW_NONE;                     // applied by the encoding pass, see ApplyRewrite()
+        bool isInstruction = false;
+        bool isRelaxable = false;                      // a jmp that might be encoded as bra, see RelaxJumps()
+        bool isRetargeted = false;                     // jumpTarget replaces the label of the source line, see ResolveJumpChains()
+        bool usesAddress = false;                      // an expression of the line has '*', its bytes depend on its address
+    };
+
+    enum JumpState : uint8_t // the relaxation state of a statement, see RelaxJumps()
+    {
+        JS_LONG,     // jmp, might be relaxed
+        JS_RELAXED,  // bra
+        JS_KEEP_LONG // relaxed before, but moving code took it out of reach. stays a jmp
+    };
+
+    struct SymbolDefinition
+    {
+        uint32_t statementIndex = 0; // the first statement that sees the symbol's latest value
+        bool isRedefined = false;    // .def can change the value of a symbol, see GetSymbolValue()
+        bool isRelocatable = false;  // a label of the relocatable section, its value is an offset into it
+    };
+
+    struct ExportedSymbol // a name listed by .export
+    {
+        uint32_t symbolId;
+        uint32_t lineNumber;
+        std::string_view line;
+    };
+
+    struct SymbolRedefinition // one of the values of a symbol that was defined more than once
+    {
+        uint32_t symbolId;
+        uint32_t statementIndex;
+        uint32_t value;
+    };
+
+    struct SourceLine // the pieces of a source line, produced by TokenizeLine()
+    {
+        std::string_view label;    // "loop" in "loop: mov.b r0, 1 ; comment"
+        std::string_view keyword;  // "mov", or the directive name without the '.'
+        std::string_view modifier; // "b"
+        std::string_view operand;  // "r0, 1"
+        std::string_view comment;  // "; comment"
+        bool isDirective = false;
+    };
+
+    struct IncludedLine
+    {
+        std::string_view text;
+        SourceLine tokens;        // valid if isTokenized is set
+        bool isTokenized = false; // a line with a syntax error is tokenized again by the sizing pass, which reports the error
+    };
+
+    struct IncludedFile // a file loaded by .include, split into lines and tokenized once per process. see LoadIncludedFile()
+    {
+        MappedFile file;                 // a copy of the file, the lines point into it
+        std::vector<IncludedLine> lines;
+    };
+
+    struct SourceFile // the main source, one inclusion of a file, or one expansion of a macro
+    {
+        string name;                     // empty for the macro expansions
+        uint32_t parent = 0;             // the index of the including file in sourceFiles
+        uint32_t includeLineNumber = 0;  // the line of the .include directive or the macro invocation in the parent
+        uint32_t definitionFile = 0;     // the file holding the lines: the file itself, or the one the macro was defined in
+        bool isMacro = false;
+    };
+
+    struct SourceRange // a run of lines of the same file, see LocateError()
+    {
+        uint32_t firstLine;  // in the numbering of actLineNumber, which goes on through the included files
+        uint32_t fileIndex;  // in sourceFiles
+        uint32_t lineNumber; // of the first line in its file
+    };
+
+    struct SourceCursor // where the sizing pass is in a file of the include stack
+    {
+        std::string_view text;           // the main source
+        size_t position = 0;
+        const IncludedFile *file = nullptr; // an included file
+        uint32_t fileIndex = 0;
+        uint32_t lineNumber = 1;         // of the next line
+        uint32_t macroIndex = NO_MACRO;  // a macro expansion, its lines are built by ExpandMacroLine()
+        uint32_t firstArgument = 0;      // the arguments of the expansion in macroArguments
+        uint32_t expansion = 0;          // the number of the expansion, it makes the local labels unique
+    };
+
+    static constexpr size_t MAX_INCLUDE_DEPTH = 16;
+    static constexpr size_t MAX_MACRO_DEPTH = 64;     // the depth of the source stack when a macro is invoked
+    static constexpr uint32_t NO_MACRO = 0xffffffff;
+
+    struct Macro // the body of a macro is split into pieces when it's defined, see AddMacroLine()
+    {
+        uint32_t firstLine;      // in macroLines
+        uint32_t lineCount = 0;
+        uint32_t firstParameter; // the lower case names of the parameters in macroParameters
+        uint32_t parameterCount;
+        uint32_t fileIndex;      // where it was defined, in sourceFiles
+        uint32_t lineNumber;     // of the .macro directive
+        uint32_t definitionLine; // the same in the numbering of actLineNumber
+        std::string_view line;   // the .macro directive
+    };
+
+    struct MacroSpan // a field of a macro line, as an offset into the line of the body
+    {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct MacroLine // the line is tokenized when it's defined if only its operand has parameters, see AddMacroLine()
+    {
+        uint32_t firstPiece; // in macroPieces
+        uint32_t pieceCount;
+        MacroSpan label;     // the fields of the SourceLine, valid if isTokenized is set
+        MacroSpan keyword;
+        MacroSpan modifier;
+        MacroSpan operand;
+        bool isDirective = false;
+        bool isTokenized = false;
+    };
+
+    struct MacroPiece // a run of text of a macro line, or a place to insert an argument or the suffix of a local label
+    {
+        static constexpr int32_t TEXT = -1;         // the piece is macroText[offset, offset + length)
+        static constexpr int32_t LOCAL_SUFFIX = -2; // "name@" in the body is a label local to the expansion
+
+        int32_t parameter;
+        uint32_t offset;
+        uint32_t length; // in the line of the body: the text, the name of the parameter or the '@'
+    };
+
+    class PhaseTimer // adds the time spent in its scope to a timer of AsmStats, does nothing if that's nullptr
+    {
+    public:
+        explicit PhaseTimer(double *seconds) : seconds(seconds)
+        {
+            if (seconds != nullptr)
+                start = std::chrono::steady_clock::now();
+        }
+
+        ~PhaseTimer()
+        {
+            if (seconds != nullptr)
+                *seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        double *seconds;
+        std::chrono::steady_clock::time_point start;
+    };
+
     // variables
     std::vector<Segment> segments;             // the machine code & data get compiled into this
-    std::map<string, OpcodeAttribute> opcodes; // contains info about each instruction, indexed by their names
-    std::map<string, uint32_t> labels;         // symbol table containing all labels and their addresses
-    std::map<string, std::vector<LabelLocation>> unresolvedLabels;
+    std::vector<Segment> spareSegments;        // the segments of the previous assembly, their buffers are reused by the .pc directive
+    SymbolTable labels;                                      // symbol table containing all labels and their addresses
+    std::vector<Fixup> fixups;                               // forward references, patched at the end of Assemble()
+    std::vector<ExpressionToken> fixupTokens;                // the expressions of the fixups
+    std::vector<ExpressionToken> expressionTokens;           // the expressions of the line being assembled
+    uint32_t expressionStackSize = 0;                        // the depth of the expression being parsed, see EmitExpressionToken()
+    uint32_t expressionNesting = 0;                          // the parentheses and unary operators in the expression being parsed
+    bool isExpressionEvaluated = true;                       // the constants of the expression being parsed are converted and folded
+    uint32_t lineAddress = 0;                                // the address of the line being assembled, the value of '*'
+    bool lineUsesAddress = false;                            // the line being sized has '*'
+    LineArena lineArena;                                     // scratch memory for the line being assembled, reset after each line
     uint32_t PC = 0;                // keeps track of the current compiling position
     unsigned int actLineNumber = 1; // keeps track of the current line in the source code
-    string actLine;                 // the content of the current source code line being assembled
+    std::string_view actLine;       // the content of the current source code line being assembled
+    std::string_view actToken;      // the part of actLine being processed, gives the column of an error
+    uint8_t instructionBytes[16];   // the instruction being encoded, written to the output in one piece by EmitInstruction()
+    uint8_t instructionLength = 0;
+
+    static constexpr size_t MIN_STATEMENTS_PER_ENCODER_THREAD = 4096;
+    std::vector<Statement> statements;               // the lines that emit bytes, in source order
+    std::vector<SymbolDefinition> symbolDefinitions; // indexed by symbol ID
+    std::vector<SymbolRedefinition> redefinitions;   // sorted by symbol ID (and statement index) after the sizing pass
+    bool isSizingPass = false;                       // the sizing pass lays out the statements, the encoding pass fills them in
+    bool relaxJumps = false;
+    std::vector<JumpState> jumpStates;               // indexed by statement, kept between the repeated sizing passes
+    bool optimize = false;
+    bool isStatementBoundary = false;                // a symbol was defined since the last statement, the optimizer can't merge across it
+    bool useLineCache = false;
+    bool relocatable = false;                        // the first segment is the relocatable section, see SetRelocatable()
+    std::vector<ExportedSymbol> exportedSymbols;
+    LineCache lineCache;
+    std::vector<uint32_t> referencedSymbols;         // the symbols used by the statements, see Statement::firstSymbol
+    std::vector<uint64_t> statementKeys;             // the line cache keys of the statements, filled in by the encoding pass
+    uint32_t lineFirstSymbol = 0;                    // where the symbols of the line being sized start in referencedSymbols
+    bool collectErrors = false;
+    std::vector<AsmError> errors;                    // the errors skipped over with error collection
+    std::vector<SourceFile> sourceFiles;         // the first one is the main source
+    std::vector<SourceRange> sourceRanges;       // maps actLineNumber to the files and their lines, in line order
+    std::vector<SourceCursor> sourceStack;       // the include stack of the sizing pass
+    std::vector<std::shared_ptr<const IncludedFile>> includedFiles; // the statements point into them, they are kept until the next assembly
+    bool hasLabels = false;                      // a label was defined, its value depends on where the source is
+    bool usesAddress = false;                    // a line has '*', its value depends on where the source is
+    SymbolTable macroNames;                      // the IDs index macros
+    std::vector<Macro> macros;
+    std::vector<MacroLine> macroLines;
+    std::vector<MacroPiece> macroPieces;
+    std::string macroText;                       // the text pieces of the macro bodies
+    std::vector<std::string> macroParameters;
+    std::vector<std::string_view> macroArguments; // the arguments of the expansions on the source stack
+    uint32_t definedMacro = NO_MACRO;            // the macro whose body is being recorded
+    uint32_t expansionCount = 0;
+    LineArena expansionArena;                    // the expanded lines, they are kept until the end of the assembly like the source
+    bool collectStats = false;
+    AsmStats stats;                                  // only cachedStatements is counted in the encoding workers
+    unsigned int encoderThreadCount = 0;
+    AsmA65k *master = nullptr;  // the context owning the symbols and the segments, set in the encoding workers
+    std::vector<std::unique_ptr<AsmA65k>> encoders; // the worker contexts of the encoding pass, kept for the next assembly
+    uint32_t actStatementIndex = 0;
+    uint32_t actSegmentIndex = 0;
+    uint8_t *output = nullptr;  // where the encoding pass writes the bytes of the current statement
 
     // AsmA65k.cpp
-    void ProcessLabelDefinition(const string& line); // catalogs a new label
-    void InitializeOpcodetable();                   // populate the 'opcodes' map
+    void AssembleSource(std::string_view source);                 // Assemble() without the conversion of the line numbers of the errors
+    std::optional<AsmError> SizeSource(std::string_view source); // the sizing pass, returns the error that stopped it
+    bool RelaxJumps();                                             // updates jumpStates from the last sizing pass, returns true if anything changed
+    void EncodeStatements(const size_t first, const size_t last); // the encoding pass over a range of statements
+    void EncodeAllStatements();                                   // splits the encoding pass between worker contexts
+    void RecordStatement(const uint32_t address);                 // called by the sizing pass for a line that emitted bytes
+    void RecycleSegments();                                       // moves the segments to spareSegments
+    void PatchFixup(const Fixup &fixup);                          // writes the value of a symbol that was undefined in the encoding pass
+    void RecordError(AsmError &error);                            // adds the column of the error, and throws it unless errors are collected
+    uint32_t InternReference(std::string_view name);              // interns a symbol used by the line being sized
+    uint64_t GetStatementKey(const Statement &statement) const;   // the line cache key, a hash of the line and everything its bytes depend on
+    bool IsLineCacheUsed() const { return useLineCache && relocatable == false; } // the cached lines would skip their relocations
+    double *GetSizingTimer(double &seconds);                      // the timer of a sizing pass phase for PhaseTimer, nullptr if it's not timed
+    void AddSegment(const uint32_t address);                      // starts a new segment, reusing the buffer of a spare one
+    void CheckExportedSymbols();                                  // reports the exported symbols that were never defined
+
+    // AsmA65k-Optimizer.cpp
+    Rewrite FindRewrite(const InstructionWord instructionWord, const Operand &operand) const;             // the single instruction replacement of an instruction, if any
+    static void ApplyRewrite(const Rewrite rewrite, InstructionWord &instructionWord, Operand &operand);  // changes the instruction as the rewrite describes
+    bool MergeWithPreviousStatement(const InstructionWord instructionWord, const Operand &operand);      // returns true if the instruction was folded into the statement before it
+    void ResolveJumpChains();                                                                              // points jumps to the end of the jump chains they start
+
+    void ProcessLabelDefinition(std::string_view labelName); // catalogs a new label
+    void DefineSymbol(const uint32_t symbolId, const uint32_t value);
+    uint32_t GetSymbolValue(const uint32_t symbolId) const;  // the value of a symbol as seen by the current statement
+    AsmA65k &GetMaster() { return master != nullptr ? *master : *this; }
+    const AsmA65k &GetMaster() const { return master != nullptr ? *master : *this; }
+    static constexpr uint64_t PackMnemonic(std::string_view mnemonic);                                       // packs up to 7 characters into an integer key
+    static constexpr uint32_t GetOpcodeSlot(const uint64_t key, const uint64_t multiplier);                   // hashes a packed mnemonic into an opcode table index
+    static constexpr auto GetOpcodeDefinitions();                                                             // the instruction set
+    static constexpr uint64_t FindOpcodeHashMultiplier();                                                     // finds a collision free hash for the instruction set
+    static constexpr std::array<OpcodeAttribute, OPCODE_TABLE_SIZE> BuildOpcodeTable(const uint64_t multiplier); // builds the perfect hash table at compile time
+    static const OpcodeAttribute *FindOpcode(std::string_view mnemonic);                                      // looks up an instruction, returns nullptr if it doesn't exist
 
     // AsmA65k-Assembly.cpp
-    void ProcessAsmLine(const string& line);                                                             // prepares and assembles the line. see also assembleInstruction()
-    void AssembleInstruction(const string& mnemonic, const string& modifier, const string& operand); // does the actual assembly -> machine code translation
-
-    OperandTypes DetectOperandType(const string& operandStr); // given the operand string, detects its type. see enum OperandType
+    void ProcessAsmLine(std::string_view line, const SourceLine *tokens = nullptr);                                      // prepares and assembles the line, tokenizing it unless 'tokens' has it. see also assembleInstruction()
+    void AssembleInstruction(std::string_view mnemonic, std::string_view modifier, std::string_view operandStr); // does the actual assembly -> machine code translation
+    uint32_t GetInstructionLength(const OperandTypes operandType, const InstructionWord instructionWord); // the number of bytes the handlers emit for the instruction
+
+    Operand ParseOperand(std::string_view operandStr);                                      // given the operand string, builds its descriptor in one pass. see struct Operand
+    OperandShape ParseOperandSide(std::string_view text, size_t& pos, Operand& operand);    // parses one side of a comma separated operand
+    OperandTermType ParseOperandTerm(std::string_view text, size_t& pos, Operand& operand); // parses a single register, constant or label
+    OperandTypes GetSingleOperandType(const OperandShape shape);                            // maps a monadic operand's shape to its type
+    OperandTypes GetDoubleOperandType(const OperandShape left, const OperandShape right);   // maps a diadic operand's shapes to its type
     AddressingModes GetAddressingModeFromOperand(const OperandTypes operandType);
 
-    void HandleOperand_Register(const string& operand, InstructionWord instructionWord);
+    void HandleOperand_Register(const Operand& operand, InstructionWord instructionWord);
     void HandleOperand_Constant(const uint32_t constant, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegister(const string& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegister(const Operand& operand, InstructionWord instructionWord);
     void HandleOperand_IndirectConstant(const uint32_t constant, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegisterPlusLabel(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegisterPlusConstant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectLabelPlusRegister(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectConstantPlusRegister(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_Label(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectRegister(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectConstantPlusRegister(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectLabelPlusRegister(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectRegisterPlusLabel(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectRegisterPlusConstant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegister_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegisterPlusLabel_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegisterPlusConstant_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectLabelPlusRegister_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectConstantPlusRegister_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectLabel_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectConstant_Register(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectLabel(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Register_IndirectConstant(const string& operand, InstructionWord instructionWord);
-    //    void handleDoubleRegisters(const StringPair sp, InstructionWord instructionWord, const char postfixChar);
-    void HandleDoubleRegisters(const StringPair sp, InstructionWord instructionWord, const PostfixType postFix);
-    void HandleOperand_Constant_Label(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Constant_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Label_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_Label_Label(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegister_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectLabel_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectConstant_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegisterPlusLabel_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectRegisterPlusConstant_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectLabelPlusRegister_Constant(const string& operand, InstructionWord instructionWord);
-    void HandleOperand_IndirectConstantPlusRegister_Constant(const string& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegisterPlusLabel(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegisterPlusConstant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectLabelPlusRegister(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectConstantPlusRegister(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_Label(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectRegister(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectConstantPlusRegister(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectLabelPlusRegister(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectRegisterPlusLabel(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectRegisterPlusConstant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegister_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegisterPlusLabel_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegisterPlusConstant_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectLabelPlusRegister_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectConstantPlusRegister_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectLabel_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectConstant_Register(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectLabel(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Register_IndirectConstant(const Operand& operand, InstructionWord instructionWord);
+    void HandleDoubleRegisters(const RegisterType left, const RegisterType right, InstructionWord instructionWord, const PostfixType postFix);
+    void HandleOperand_Constant_Label(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Constant_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Label_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_Label_Label(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegister_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectLabel_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectConstant_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegisterPlusLabel_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectRegisterPlusConstant_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectLabelPlusRegister_Constant(const Operand& operand, InstructionWord instructionWord);
+    void HandleOperand_IndirectConstantPlusRegister_Constant(const Operand& operand, InstructionWord instructionWord);
 
     // AsmA65k-Directives.cpp
-    bool ProcessDirectives(const string& line);                                      // the main method for processing & handling the directives
-    int DetectDirective(const string& line);                                         // detects if there's a directive on the given line
-    void HandleDirective_Text(const string& line, const int directiveType);          // handles .text "asdf" directives
-    void HandleDirective_ByteWordDword(const string& line, const int directiveType); // handles data entry directives
-    void HandleDirective_SetPC(const string& line);                                  // handles .pc = xxx directives
-    void HandleDirective_Define(const string& line);                                 // handles the .define directive
+    void ProcessDirective(const SourceLine& sourceLine);                                           // the main method for processing & handling the directives
+    std::string_view ScanValueToken(std::string_view text, size_t& pos);                          // reads a number or a label from a directive's arguments
+    void HandleDirective_Text(std::string_view arguments, const Directives directiveType);          // handles .text "asdf" directives
+    void HandleDirective_ByteWordDword(std::string_view arguments, const Directives directiveType); // handles data entry directives
+    void HandleDirective_SetPC(std::string_view arguments);                                        // handles .pc = xxx directives
+    void HandleDirective_Define(std::string_view arguments);                                       // handles the .define directive
+    void HandleDirective_Include(std::string_view arguments);                                      // handles .include "file" directives
+    void HandleDirective_Macro(std::string_view arguments);                                        // handles .macro name param1, param2 directives
+    void HandleDirective_Export(std::string_view arguments);                                       // handles .export name1, name2 directives
+
+    // AsmA65k-Macros.cpp
+    static bool IsEndMacroLine(std::string_view line);                            // the line is an .endm directive, it's checked before tokenizing
+    void AddMacroLine(std::string_view line);                                     // records a line of the body of definedMacro
+    void EndMacroDefinition(bool isComplete);                                     // ends the recording, reports the missing .endm unless isComplete
+    bool ExpandMacro(std::string_view name, std::string_view arguments);          // pushes the expansion of a macro to the source stack, returns false if there's no such macro
+    std::string_view ExpandMacroLine(const SourceCursor &cursor, uint32_t lineIndex, SourceLine &tokens, bool &isTokenized); // builds a line of an expansion with the arguments substituted, and its tokens if the line has them
+
+    // AsmA65k-Expressions.cpp
+    uint32_t ParseExpression(std::string_view text, size_t& pos, const bool isEvaluated = true); // compiles an expression into expressionTokens, returns its first token. stops before a "+ register"
+    bool IsRegisterIndex(std::string_view text, size_t pos);                       // the '+' at 'pos' is followed by a register
+    void ParseBinaryExpression(std::string_view text, size_t& pos, const int minPrecedence); // the operators binding at least as tight as minPrecedence
+    void ParseUnaryExpression(std::string_view text, size_t& pos);                 // a value, a parenthesized expression or a unary operator applied to one
+    static int GetPrecedence(const ExpressionOperator type);                      // of a binary operator, the tighter it binds the higher
+    static size_t ScanBinaryOperator(std::string_view text, const size_t pos, ExpressionOperator& type); // returns the length of the operator at 'pos', 0 if there's none
+    uint32_t GetSymbolId(std::string_view name);                                   // the ID of a name used by the line being assembled
+    void EmitExpressionToken(const ExpressionOperator type, const uint32_t value = 0); // appends a token, folding the operators of constants
+    uint32_t ApplyExpressionOperator(const ExpressionOperator type, const uint32_t left, const uint32_t right) const;
+    bool EvaluateExpression(const ExpressionToken *tokens, const uint32_t tokenCount, uint32_t& value, uint32_t& undefinedSymbol) const; // returns false if a symbol is not defined
+    uint32_t EvaluateDefinedExpression(const uint32_t firstToken);                 // for the directives of the sizing pass, the symbols must be defined already
+    uint32_t ResolveExpression(const ExpressionToken *tokens, const uint32_t tokenCount, const uint32_t address, const OpcodeSize size = OS_32BIT, bool isRelative = false); // evaluates the expression, or adds a fixup if it has an undefined symbol
+    uint32_t ResolveValue(const OperandValue& value, const uint32_t address, const OpcodeSize size = OS_32BIT, bool isRelative = false);       // ResolveExpression() for an operand
+    uint32_t GetLabelId(const OperandValue& value) const;                          // the symbol if the value is a single label, SymbolTable::INVALID_ID otherwise
+    bool NeedsRelocation(const ExpressionToken *tokens, const uint32_t tokenCount, const uint32_t segmentIndex, bool isRelative) const; // the value depends on where the linker puts the relocatable section, or on an import
+
+    // AsmA65k-Link.cpp
+    bool IsRelocatableSegment(const uint32_t segmentIndex) const;                  // the segment is the relocatable section of an object
+    bool IsInSameSection(const uint32_t segmentIndex, const uint32_t symbolId) const; // the distance of the symbol from the segment is known before linking
+    uint32_t GetSectionAddress(const uint32_t section, const std::vector<uint32_t> &sectionSegments, const std::vector<uint32_t> &sectionOffsets) const; // where the linker put a section of an object
+    void LinkObject(const ObjectFile &object, const std::string &fileName, const std::vector<uint32_t> &sectionSegments, const std::vector<uint32_t> &sectionOffsets); // patches the relocations of an object
+
+    // AsmA65k-Include.cpp
+    std::shared_ptr<const IncludedFile> LoadIncludedFile(const std::string &path); // returns the parsed file from the process wide cache, loading it if needed
+    static std::shared_ptr<const SymbolFile> LoadSymbolFile(const std::string &path); // returns the precompiled symbols of a source file if they are up to date
+    void LocateError(AsmError &error) const;                                        // converts the line number of an error into the line of its file
+
+    // AsmA65k-Lexer.cpp
+    void TokenizeLine(std::string_view line, SourceLine& sourceLine); // splits a line into label, keyword, modifier, operand and comment
+    Directives FindDirective(std::string_view name);                  // converts a directive's name into its Directives value
 
     // AsmA65k-Misc.cpp
-    bool IsCommentLine(const string& line);              // check if a line is made of entirely out of a comment
-    int ConvertStringToInteger(const string& valueStr);  // as the name implies, converts a std::string into an int
-    int FindChar(const string& text, char c);            // searches for the given character and returns its index or -1
+    uint32_t ConvertStringToInteger(std::string_view valueStr); // converts a $hex, %binary or (signed) decimal literal, range checked to 32 bits
+    static bool ConvertHex8(const char *digits, uint32_t& result); // converts exactly 8 hex digits at once, returns false on a non-hex digit
     void ThrowException_ValueOutOfRange();              // throws an exception
     void ThrowException_InvalidNumberFormat();          // throws an exception
-    void CheckIntegerRange(const int64_t result);       // checks if the 64 bit value can be fit into 32 bits (that's the max. allowed)
-    void ThrowException_SyntaxError(const string& line); // throws an exception
+    void ThrowException_SyntaxError(std::string_view line); // throws an exception
     void ThrowException_InvalidRegister();              // throws an exception
     void ThrowException_InvalidOperands();              // throws an exception
     void ThrowException_InvalidMnemonic();
     void ThrowException_InternalError(); // throws an exception
     void ThrowException_SymbolOutOfRange();
-    uint32_t ResolveLabel(const string& label, const uint32_t address, const OpcodeSize size = OS_32BIT, bool isRelative = false); // returns the address associated with a label
-    string RemoveSquaredBrackets(const string& operand);                                                  // removes the enclosing squared bracked from a string
-    StringPair SplitStringByPlusSign(const string& operand);                                              // splits a string into a StringPair separated by a '+' character
-    StringPair SplitStringByComma(const string& operand);                                                 // splits a string into a StringPair separated by a ',' character
-    RegisterType DetectRegisterType(const string& registerStr);                                           // converts the string into a RegisterType
-    bool FindAddressingMode(const string& mnemonic, const AddressingModes am);
-    void CheckIfAddressingModeIsLegalForThisInstruction(const string& mnemonic, const OperandTypes operandType);
-    void CheckIfSizeSpecifierIsAllowed(const string& mnemonic, const OpcodeSize opcodeSize);
+    bool DetectRegisterType(std::string_view registerStr, RegisterType& registerType);                    // converts the string into a RegisterType, returns false if it's not a register name
+    void CheckIfAddressingModeIsLegalForThisInstruction(const OpcodeAttribute& opcode, const Operand& operand);
+    void CheckIfSizeSpecifierIsAllowed(const OpcodeAttribute& opcode, const OpcodeSize opcodeSize);
     OpcodeSize GetOpcodeSizeFromSignedInteger(const int32_t value);
     OpcodeSize GetOpcodeSizeFromUnsigedInteger(const uint64_t value);
-    void VerifyRangeForConstant(const string& constant, const OpcodeSize opcodeSize);
     void VerifyRangeForConstant(const uint32_t constant, OpcodeSize opcodeSize);
     void AddData(const OpcodeSize size, const uint32_t data);
-    void AddData(const string& sizeSpecifier, const uint32_t data);
-    uint8_t GetOpcodeSize(const string& modifierCharacter); // takes the modifier character (eg.: mov.b -> 'b') and returns its numerical value
+    uint8_t GetOpcodeSize(std::string_view modifierCharacter, const OpcodeAttribute& opcode); // takes the modifier character (eg.: mov.b -> 'b') and returns its numerical value
+    static OpcodeSize GetDataSize(const InstructionWord instructionWord);                       // the size of the constants of the instruction
     void AddInstructionWord(const InstructionWord instructionWord);
-    void AddRegisterConfigurationByte(const string& registerString, InstructionWord instructionWord, const PostfixType postfixType);
-    string DetectAndRemoveLabelDefinition(string line);
-    PostfixType GetPostFixType(const string& operand);
+    void EmitInstruction(); // moves the encoded instruction to the output
+    void AddRegisterConfigurationByte(const RegisterType registerIndex, InstructionWord instructionWord, const PostfixType postfixType);
+
+    // character classes, shared by the lexer and the parsers
+    static bool IsWhiteSpace(const char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+    static bool IsIdentifierStart(const char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static bool IsIdentifierChar(const char c) { return IsIdentifierStart(c) || (c >= '0' && c <= '9') || c == '_'; }
+    static bool IsExpressionStart(const char c) { return IsIdentifierChar(c) || std::string_view("$%-(~<>*").find(c) != std::string_view::npos; }
+    static void SkipWhiteSpace(std::string_view text, size_t& pos)
+    {
+        while (pos < text.size() && IsWhiteSpace(text[pos]))
+            pos++;
+    }
+
+    // the source is matched case insensitively, symbols are stored in lower case
+    static char ToLower(const char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+    static bool EqualsIgnoreCase(std::string_view text, std::string_view lowerCaseText)
+    {
+        if (text.size() != lowerCaseText.size())
+            return false;
+        for (size_t i = 0; i < text.size(); i++)
+            if (ToLower(text[i]) != lowerCaseText[i])
+                return false;
+        return true;
+    }
 
 public:
     void AsmLog(const char *fmt, ...)
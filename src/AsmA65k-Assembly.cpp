@@ -10,64 +10,138 @@
 
 #include <Asm65k.h>
 #include <sstream>
-#include <regex>
 #include <iostream>
 
 using namespace std;
 
-void AsmA65k::ProcessAsmLine(const string& line)
+void AsmA65k::ProcessAsmLine(std::string_view line, const SourceLine *tokens)
 {
-    const string processedLine = DetectAndRemoveLabelDefinition(line);
-    if (processedLine.size() == 0)
+    // the lines of a macro's body are only assembled when it's expanded
+    if (definedMacro != NO_MACRO)
+    {
+        if (IsEndMacroLine(line))
+            EndMacroDefinition(true);
+        else
+            AddMacroLine(line);
         return;
+    }
 
-    // ==== extract mnemonic and operands ====
-    // $1 = instruction, $2 = .b/w, $3 = operands
-    const static regex rx_matchInstructionAndOperands(R"(\s*([a-z]{2,5})\.?([bw]?)\s*(.*))", regex_constants::icase);
-    smatch asmMatches;
-    if (regex_match(processedLine, asmMatches, rx_matchInstructionAndOperands) == false)
-        ThrowException_SyntaxError(processedLine);
+    SourceLine sourceLine;
+    actToken = line;
+    expressionTokens.clear();
+    if (tokens != nullptr)
+        sourceLine = *tokens;
+    else
+    {
+        PhaseTimer timer(GetSizingTimer(stats.lexingSeconds));
+        TokenizeLine(line, sourceLine);
+    }
 
-    // assign matches to individual variables
-    string mnemonic = asmMatches[1].str();
-    string modifier = asmMatches[2].str();
-    string operand = asmMatches[3].str();
+    // the symbols are defined by the sizing pass, the encoding pass only fills in the bytes
+    if (sourceLine.label.empty() == false && isSizingPass)
+    {
+        actToken = sourceLine.label;
+        ProcessLabelDefinition(sourceLine.label);
+    }
 
-    // remove comment from operand
-    const static regex rx_detectComment(R"((.*\S)\s*;.*)", regex_constants::icase);
-    smatch cleanOperand;
-    if (regex_match(operand, cleanOperand, rx_detectComment))
-        operand = cleanOperand[1].str();
+    actToken = sourceLine.keyword;
 
-    // convert strings to lower case
-    std::transform(mnemonic.begin(), mnemonic.end(), mnemonic.begin(), ::tolower);
-    std::transform(modifier.begin(), modifier.end(), modifier.begin(), ::tolower);
-    std::transform(operand.begin(), operand.end(), operand.begin(), ::tolower);
+    if (sourceLine.isDirective == false && sourceLine.modifier.empty() && isSizingPass && macros.empty() == false &&
+        ExpandMacro(sourceLine.keyword, sourceLine.operand))
+        return;
 
-    AssembleInstruction(mnemonic, modifier, operand);
+    if (sourceLine.isDirective)
+    {
+        PhaseTimer timer(GetSizingTimer(stats.directiveSeconds));
+        stats.directives += isSizingPass;
+        ProcessDirective(sourceLine);
+    }
+    else if (sourceLine.keyword.empty() == false)
+        AssembleInstruction(sourceLine.keyword, sourceLine.modifier, sourceLine.operand);
 }
 
-void AsmA65k::AssembleInstruction(const string& mnemonic, const string& modifier, const string& operand)
+void AsmA65k::AssembleInstruction(std::string_view mnemonic, std::string_view modifier, std::string_view operandStr)
 {
     InstructionWord instructionWord;
 
-    instructionWord.opcodeSize = GetOpcodeSize(modifier);
-
-    if (opcodes.find(mnemonic) == opcodes.end())
+    if (isSizingPass && segments.empty()) // the encoding pass only sees lines that passed this check
     {
+        AsmError error(actLineNumber, actLine, "A .pc directive must precede the first instruction");
+        throw error;
+    }
+
+    instructionLength = 0;
+    actToken = mnemonic;
+    const OpcodeAttribute *opcode = FindOpcode(mnemonic);
+    if (opcode == nullptr)
         ThrowException_InvalidMnemonic();
+
+    instructionWord.instructionCode = opcode->instructionCode;
+
+    actToken = modifier;
+    instructionWord.opcodeSize = GetOpcodeSize(modifier, *opcode);
+    CheckIfSizeSpecifierIsAllowed(*opcode, (OpcodeSize)instructionWord.opcodeSize);
+
+    actToken = operandStr;
+    Operand operand;
+    {
+        PhaseTimer timer(GetSizingTimer(stats.operandSeconds));
+        operand = ParseOperand(operandStr);
     }
+    CheckIfAddressingModeIsLegalForThisInstruction(*opcode, operand);
 
-    instructionWord.instructionCode = opcodes[mnemonic].instructionCode;
+    if (isSizingPass)
+    {
+        stats.instructions++;
+        stats.operandTypes[operand.type]++;
+
+        Rewrite rewrite = RW_NONE;
+        if (optimize)
+        {
+            if (MergeWithPreviousStatement(instructionWord, operand))
+                return;
 
-    CheckIfSizeSpecifierIsAllowed(mnemonic, (OpcodeSize)instructionWord.opcodeSize);
+            rewrite = FindRewrite(instructionWord, operand);
+            ApplyRewrite(rewrite, instructionWord, operand);
+        }
+
+        // a jmp to a label without a size specifier is a candidate for relaxation, see RelaxJumps()
+        const uint32_t address = PC;
+        const size_t statementIndex = statements.size();
+        const bool isRelaxable = relaxJumps && instructionWord.instructionCode == I_JMP && operand.type == OT_LABEL && instructionWord.opcodeSize == OS_NONE &&
+                                 GetLabelId(operand.values[0]) != SymbolTable::INVALID_ID;
+        if (isRelaxable && statementIndex < jumpStates.size() && jumpStates[statementIndex] == JS_RELAXED)
+        {
+            rewrite = RW_BRA;
+            ApplyRewrite(rewrite, instructionWord, operand);
+        }
+
+        PC += GetInstructionLength(operand.type, instructionWord);
+        RecordStatement(address);
+        if (PC == address)
+            return;
+
+        Statement &statement = statements.back();
+        statement.instructionWord = instructionWord;
+        statement.operandType = operand.type;
+        statement.operandRegister = operand.registers[0];
+        statement.rewrite = rewrite;
+        statement.isInstruction = true;
+        statement.isRelaxable = isRelaxable;
+        if (operand.type == OT_LABEL)
+            statement.jumpTarget = GetLabelId(operand.values[0]);
+        return;
+    }
 
-    OperandTypes operandType = DetectOperandType(operand);
-    CheckIfAddressingModeIsLegalForThisInstruction(mnemonic, operandType);
+    // the encoding pass repeats the changes the sizing pass has made
+    const Statement &statement = GetMaster().statements[actStatementIndex];
+    ApplyRewrite(statement.rewrite, instructionWord, operand);
+    if (statement.isRetargeted)
+        expressionTokens[operand.values[0].firstToken].value = statement.jumpTarget;
 
     uint32_t effectiveAddress = 0;
 
-    switch (operandType)
+    switch (operand.type)
     {
     case OT_NONE: // SEI
         instructionWord.addressingMode = AM_IMPLIED;
@@ -80,38 +154,45 @@ void AsmA65k::AssembleInstruction(const string& mnemonic, const string& modifier
     case OT_LABEL: // BEQ label
     {
         const uint8_t instruction = instructionWord.instructionCode;
-        effectiveAddress = ResolveLabel(operand, PC + 2, (OpcodeSize)instructionWord.opcodeSize, instruction >= I_BRA && instruction <= I_BGE);
+        effectiveAddress = ResolveValue(operand.values[0], PC + 2, GetDataSize(instructionWord), instruction >= I_BRA && instruction <= I_BGE);
         if (instruction >= I_BRA && instruction <= I_BGE)
             instructionWord.opcodeSize = OS_16BIT;
     }
         HandleOperand_Constant(effectiveAddress, instructionWord);
         break;
-    case OT_CONSTANT:
-        effectiveAddress = ConvertStringToInteger(operand); // BNE $4000 or PSH $f000
+    case OT_CONSTANT: // BNE $4000 or PSH $f000
+    {
+        const uint8_t instruction = instructionWord.instructionCode;
+        effectiveAddress = operand.values[0].constant;
+        if (instruction >= I_BRA && instruction <= I_BGE && IsRelocatableSegment(actSegmentIndex)) // the distance depends on where the section goes
+        {
+            const ExpressionToken target = {EXPR_CONSTANT, effectiveAddress};
+            effectiveAddress = ResolveExpression(&target, 1, PC + 2, OS_16BIT, true);
+        }
+    }
         HandleOperand_Constant(effectiveAddress, instructionWord);
         break;
     case OT_INDIRECT_REGISTER: // INC [r0]
         HandleOperand_IndirectRegister(operand, instructionWord);
         break;
     case OT_INDIRECT_LABEL: // INC [label]
-        effectiveAddress = ResolveLabel(RemoveSquaredBrackets(operand), PC + 2);
+        effectiveAddress = ResolveValue(operand.values[0], PC + 2);
         HandleOperand_IndirectConstant(effectiveAddress, instructionWord);
         break;
     case OT_INDIRECT_CONSTANT: // INC.w [$ffff]
-        effectiveAddress = ConvertStringToInteger(RemoveSquaredBrackets(operand));
-        HandleOperand_IndirectConstant(effectiveAddress, instructionWord);
+        HandleOperand_IndirectConstant(operand.values[0].constant, instructionWord);
         break;
     case OT_INDIRECT_REGISTER_PLUS_LABEL: // INC.b [r0 + label]
-        HandleOperand_IndirectRegisterPlusLabel(RemoveSquaredBrackets(operand), instructionWord);
+        HandleOperand_IndirectRegisterPlusLabel(operand, instructionWord);
         break;
     case OT_INDIRECT_REGISTER_PLUS_CONSTANT: // INC [r0 + 10]
-        HandleOperand_IndirectRegisterPlusConstant(RemoveSquaredBrackets(operand), instructionWord);
+        HandleOperand_IndirectRegisterPlusConstant(operand, instructionWord);
         break;
     case OT_INDIRECT_LABEL_PLUS_REGISTER: // INC [label + r0]
-        HandleOperand_IndirectLabelPlusRegister(RemoveSquaredBrackets(operand), instructionWord);
+        HandleOperand_IndirectLabelPlusRegister(operand, instructionWord);
         break;
     case OT_INDIRECT_CONSTANT_PLUS_REGISTER: // INC [$1000 + r0]
-        HandleOperand_IndirectConstantPlusRegister(RemoveSquaredBrackets(operand), instructionWord);
+        HandleOperand_IndirectConstantPlusRegister(operand, instructionWord);
         break;
     case OT_REGISTER__LABEL: // MOV r0, label
         HandleOperand_Register_Label(operand, instructionWord);
@@ -198,6 +279,88 @@ void AsmA65k::AssembleInstruction(const string& mnemonic, const string& modifier
         HandleOperand_IndirectConstantPlusRegister_Constant(operand, instructionWord);
         break;
     }
+
+    EmitInstruction();
+}
+
+// must match the bytes emitted by the HandleOperand_* methods
+uint32_t AsmA65k::GetInstructionLength(const OperandTypes operandType, const InstructionWord instructionWord)
+{
+    static constexpr uint32_t dataSizes[] = {4, 2, 1}; // indexed by OpcodeSize, OS_NONE means 32 bits
+    const uint32_t dataSize = dataSizes[GetDataSize(instructionWord)];
+    const uint8_t instruction = instructionWord.instructionCode;
+
+    switch (operandType)
+    {
+    case OT_NONE: // SEI
+        return 2;
+
+    case OT_LABEL:    // BEQ label
+    case OT_CONSTANT: // BNE $4000 or PSH $f000
+        if (instruction >= I_BRA && instruction <= I_BGE)
+            return 2 + 2;
+        if (instruction == I_PUSH)
+            return 2 + dataSize;
+        if (instruction == I_JMP || instruction == I_JSR)
+            return 2 + 4;
+        return 0;
+
+    case OT_REGISTER:                     // INC r0
+    case OT_INDIRECT_REGISTER:            // INC [r0]
+    case OT_REGISTER__REGISTER:           // MOV r0, r1
+    case OT_REGISTER__INDIRECT_REGISTER:  // MOV r0, [r1]
+    case OT_INDIRECT_REGISTER__REGISTER:  // MOV [r0], r1
+        return 2 + 1;
+
+    case OT_INDIRECT_LABEL:    // INC [label]
+    case OT_INDIRECT_CONSTANT: // INC.w [$ffff]
+        return 2 + 4;
+
+    case OT_INDIRECT_REGISTER_PLUS_LABEL:                  // INC.b [r0 + label]
+    case OT_INDIRECT_REGISTER_PLUS_CONSTANT:               // INC [r0 + 10]
+    case OT_INDIRECT_LABEL_PLUS_REGISTER:                  // INC [label + r0]
+    case OT_INDIRECT_CONSTANT_PLUS_REGISTER:               // INC [$1000 + r0]
+    case OT_REGISTER__INDIRECT_CONSTANT_PLUS_REGISTER:     // MOV r0, [$f000 + r1]
+    case OT_REGISTER__INDIRECT_LABEL_PLUS_REGISTER:        // MOV r0, [label + r1]
+    case OT_REGISTER__INDIRECT_REGISTER_PLUS_LABEL:        // MOV r0, [r1 + label]
+    case OT_REGISTER__INDIRECT_REGISTER_PLUS_CONSTANT:     // MOV r0, [r1 + 10]
+    case OT_INDIRECT_REGISTER_PLUS_LABEL__REGISTER:        // MOV [r0 + label], r1
+    case OT_INDIRECT_REGISTER_PLUS_CONSTANT__REGISTER:     // MOV [r0 + 10], r1
+    case OT_INDIRECT_LABEL_PLUS_REGISTER__REGISTER:        // MOV [label + r0], r1
+    case OT_INDIRECT_CONSTANT_PLUS_REGISTER__REGISTER:     // MOV [1234 + r0], r1
+    case OT_INDIRECT_LABEL__REGISTER:                      // MOV [kacsa], r0
+    case OT_INDIRECT_CONSTANT__REGISTER:                   // MOV [$6660], r0
+    case OT_REGISTER__INDIRECT_LABEL:                      // MOV r0, [kacsa]
+    case OT_REGISTER__INDIRECT_CONSTANT:                   // MOV r0, [$4434]
+        return 2 + 1 + 4;
+
+    case OT_REGISTER__LABEL:           // MOV r0, label
+    case OT_REGISTER__CONSTANT:        // MOV r0, 1234
+    case OT_INDIRECT_REGISTER__CONSTANT: // [r0], 64
+        return 2 + 1 + dataSize;
+
+    case OT_CONSTANT__LABEL:    // SYS $1234, label
+    case OT_CONSTANT__CONSTANT: // SYS $1234, $5678
+    case OT_LABEL__LABEL:       // SYS label, label
+        return 2 + 2 + 4;
+
+    case OT_LABEL__CONSTANT: // SYS label, $1234
+        return 2 + 2 + dataSize;
+
+    case OT_INDIRECT_LABEL__CONSTANT:    // [names], 64
+    case OT_INDIRECT_CONSTANT__CONSTANT: // [$1234], 64
+        return 2 + 4 + dataSize;
+
+    case OT_INDIRECT_REGISTER_PLUS_LABEL__CONSTANT:    // [r0 + names], 64
+    case OT_INDIRECT_REGISTER_PLUS_CONSTANT__CONSTANT: // [r0 + 1234], 64
+    case OT_INDIRECT_LABEL_PLUS_REGISTER__CONSTANT:    // [names + r0], 64
+    case OT_INDIRECT_CONSTANT_PLUS_REGISTER__CONSTANT: // [2344 + r0], 64
+        return 2 + 1 + 4 + dataSize;
+    }
+
+    ThrowException_InternalError();
+
+    return 0; // will never get here
 }
 
 AsmA65k::AddressingModes AsmA65k::GetAddressingModeFromOperand(const OperandTypes operandType)
@@ -215,11 +378,11 @@ AsmA65k::AddressingModes AsmA65k::GetAddressingModeFromOperand(const OperandType
         return AM_AMBIGOUS; // AM_RELATIVE or AM_DIRECT or AM_CONST_IMMEDIATE
 
     case OT_INDIRECT_REGISTER: // INC [r0]
-        return AM_REGISTER1;
+        return AM_REGISTER_INDIRECT1;
 
     case OT_INDIRECT_LABEL:    // INC [label]
     case OT_INDIRECT_CONSTANT: // INC.w [$ffff]
-        return AM_REGISTER_INDIRECT1;
+        return AM_ABSOLUTE1;
 
     case OT_INDIRECT_REGISTER_PLUS_LABEL:    // INC.b [r0 + label]
     case OT_INDIRECT_REGISTER_PLUS_CONSTANT: // INC [r0 + 10]
@@ -288,229 +451,154 @@ AsmA65k::AddressingModes AsmA65k::GetAddressingModeFromOperand(const OperandType
     return AM_IMPLIED; // will never get here
 }
 
-void AsmA65k::HandleOperand_Register_IndirectConstant(const string& operand, InstructionWord instructionWord) // MOV r0, [$4434]
+void AsmA65k::HandleOperand_Register_IndirectConstant(const Operand& operand, InstructionWord instructionWord) // MOV r0, [$4434]
 {
-    StringPair sp = SplitStringByComma(operand);
-    sp.right = RemoveSquaredBrackets(sp.right);
-
     instructionWord.addressingMode = AM_ABSOLUTE_SRC;
-    AddRegisterConfigurationByte(sp.left, instructionWord, PF_NONE);
-    AddData(OS_32BIT, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, PF_NONE);
+    AddData(OS_32BIT, operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_Register_IndirectLabel(const string& operand, InstructionWord instructionWord) // MOV r0, [kacsa]
+void AsmA65k::HandleOperand_Register_IndirectLabel(const Operand& operand, InstructionWord instructionWord) // MOV r0, [kacsa]
 {
-    StringPair sp = SplitStringByComma(operand);
-    sp.right = RemoveSquaredBrackets(sp.right);
-
     instructionWord.addressingMode = AM_ABSOLUTE_SRC;
-    AddRegisterConfigurationByte(sp.left, instructionWord, PF_NONE);
-    AddData(OS_32BIT, ResolveLabel(sp.right, PC));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, PF_NONE);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
 }
 
-void AsmA65k::HandleOperand_IndirectConstant_Register(const string& operand, InstructionWord instructionWord) // MOV [$6660], r0
+void AsmA65k::HandleOperand_IndirectConstant_Register(const Operand& operand, InstructionWord instructionWord) // MOV [$6660], r0
 {
-    StringPair sp = SplitStringByComma(operand);
-    sp.left = RemoveSquaredBrackets(sp.left);
-
     instructionWord.addressingMode = AM_ABSOLUTE_DEST;
-    AddRegisterConfigurationByte(sp.right, instructionWord, PF_NONE);
-    AddData(OS_32BIT, ConvertStringToInteger(sp.left));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, PF_NONE);
+    AddData(OS_32BIT, operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectLabel_Register(const string& operand, InstructionWord instructionWord) // MOV [kacsa], r0
+void AsmA65k::HandleOperand_IndirectLabel_Register(const Operand& operand, InstructionWord instructionWord) // MOV [kacsa], r0
 {
-    StringPair sp = SplitStringByComma(operand);
-    sp.left = RemoveSquaredBrackets(sp.left);
-
     instructionWord.addressingMode = AM_ABSOLUTE_DEST;
-    AddRegisterConfigurationByte(sp.right, instructionWord, PF_NONE);
-    AddData(OS_32BIT, ResolveLabel(sp.left, PC));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, PF_NONE);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
 }
 
-void AsmA65k::HandleOperand_IndirectConstantPlusRegister_Register(const string& operand, InstructionWord instructionWord) // MOV [1234 + r0]+, r1
+void AsmA65k::HandleOperand_IndirectConstantPlusRegister_Register(const Operand& operand, InstructionWord instructionWord) // MOV [1234 + r0]+, r1
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    sp.left = RemoveSquaredBrackets(sp.left);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.left);
-
     instructionWord.addressingMode = AM_INDEXED_DEST; // this must precede the HandleDoubleRegisters() method!
-    HandleDoubleRegisters(StringPair(indexedOperandPair.right, sp.right), instructionWord, postFix);
-    AddData(OS_32BIT, ConvertStringToInteger(indexedOperandPair.left));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
+    AddData(OS_32BIT, operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectLabelPlusRegister_Register(const string& operand, InstructionWord instructionWord) // MOV [label + r0], r1
+void AsmA65k::HandleOperand_IndirectLabelPlusRegister_Register(const Operand& operand, InstructionWord instructionWord) // MOV [label + r0], r1
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    sp.left = RemoveSquaredBrackets(sp.left);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.left);
-
     instructionWord.addressingMode = AM_INDEXED_DEST;
-    HandleDoubleRegisters(StringPair(indexedOperandPair.right, sp.right), instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(indexedOperandPair.left, PC));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
 }
 
-void AsmA65k::HandleOperand_IndirectRegisterPlusConstant_Register(const string& operand, InstructionWord instructionWord) // MOV [r0 + 10], r1
+void AsmA65k::HandleOperand_IndirectRegisterPlusConstant_Register(const Operand& operand, InstructionWord instructionWord) // MOV [r0 + 10], r1
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    sp.left = RemoveSquaredBrackets(sp.left);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.left);
-
     instructionWord.addressingMode = AM_INDEXED_DEST;
-    HandleDoubleRegisters(StringPair(indexedOperandPair.left, sp.right), instructionWord, postFix);
-    AddData(OS_32BIT, ConvertStringToInteger(indexedOperandPair.right));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
+    AddData(OS_32BIT, operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectRegisterPlusLabel_Register(const string& operand, InstructionWord instructionWord) // MOV [r0 + label], r1
+void AsmA65k::HandleOperand_IndirectRegisterPlusLabel_Register(const Operand& operand, InstructionWord instructionWord) // MOV [r0 + label], r1
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    sp.left = RemoveSquaredBrackets(sp.left);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.left);
-
     instructionWord.addressingMode = AM_INDEXED_DEST;
-    HandleDoubleRegisters(StringPair(indexedOperandPair.left, sp.right), instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(indexedOperandPair.right, PC));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
 }
 
-void AsmA65k::HandleOperand_IndirectRegister_Register(const string& operand, InstructionWord instructionWord) // MOV [r0], r1
+void AsmA65k::HandleOperand_IndirectRegister_Register(const Operand& operand, InstructionWord instructionWord) // MOV [r0], r1
 {
-    StringPair sp = SplitStringByComma(operand);
     instructionWord.addressingMode = AM_REGISTER_INDIRECT_DEST;
-    HandleDoubleRegisters(StringPair(RemoveSquaredBrackets(sp.left), sp.right), instructionWord, GetPostFixType(sp.left));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
 }
 
-void AsmA65k::HandleOperand_Register_IndirectRegisterPlusConstant(const string& operand, InstructionWord instructionWord) // MOV r0, [r1 + 10]
+void AsmA65k::HandleOperand_Register_IndirectRegisterPlusConstant(const Operand& operand, InstructionWord instructionWord) // MOV r0, [r1 + 10]
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.right);
-    sp.right = RemoveSquaredBrackets(sp.right);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.right);
-
     instructionWord.addressingMode = AM_INDEXED_SRC;
-    HandleDoubleRegisters(StringPair(sp.left, indexedOperandPair.left), instructionWord, postFix); // T1, T2, T3
-    AddData(OS_32BIT, ConvertStringToInteger(indexedOperandPair.right));                           // T4
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix); // T1, T2, T3
+    AddData(OS_32BIT, operand.values[0].constant);                                                      // T4
 }
 
-void AsmA65k::HandleOperand_Register_IndirectConstantPlusRegister(const string& operand, InstructionWord instructionWord) // MOV r0, [$f000 + r1]
+void AsmA65k::HandleOperand_Register_IndirectConstantPlusRegister(const Operand& operand, InstructionWord instructionWord) // MOV r0, [$f000 + r1]
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.right);
-    sp.right = RemoveSquaredBrackets(sp.right);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.right);
-
     instructionWord.addressingMode = AM_INDEXED_SRC;
-    HandleDoubleRegisters(StringPair(sp.left, indexedOperandPair.right), instructionWord, postFix); // T1, T2, T3
-    AddData(OS_32BIT, ConvertStringToInteger(indexedOperandPair.left));                             // T4
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix); // T1, T2, T3
+    AddData(OS_32BIT, operand.values[0].constant);                                                      // T4
 }
 
-void AsmA65k::HandleOperand_Register_IndirectRegisterPlusLabel(const string& operand, InstructionWord instructionWord) // MOV r0, [r1 + label]
+void AsmA65k::HandleOperand_Register_IndirectRegisterPlusLabel(const Operand& operand, InstructionWord instructionWord) // MOV r0, [r1 + label]
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.right);
-    sp.right = RemoveSquaredBrackets(sp.right);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.right);
-
     instructionWord.addressingMode = AM_INDEXED_SRC;
-    HandleDoubleRegisters(StringPair(sp.left, indexedOperandPair.left), instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(indexedOperandPair.right, PC));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
 }
 
-void AsmA65k::HandleOperand_Register_IndirectLabelPlusRegister(const string& operand, InstructionWord instructionWord) // MOV r0, [csoki + r1]
+void AsmA65k::HandleOperand_Register_IndirectLabelPlusRegister(const Operand& operand, InstructionWord instructionWord) // MOV r0, [csoki + r1]
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.right);
-    sp.right = RemoveSquaredBrackets(sp.right);
-    StringPair indexedOperandPair = SplitStringByPlusSign(sp.right);
-
     instructionWord.addressingMode = AM_INDEXED_SRC;
-    HandleDoubleRegisters(StringPair(sp.left, indexedOperandPair.right), instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(indexedOperandPair.left, PC));
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
 }
 
-void AsmA65k::HandleOperand_Register_IndirectRegister(const string& operand, InstructionWord instructionWord) // mov r0, [r1]
+void AsmA65k::HandleOperand_Register_IndirectRegister(const Operand& operand, InstructionWord instructionWord) // mov r0, [r1]
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.right);
-    sp.right = RemoveSquaredBrackets(sp.right);
-
     instructionWord.addressingMode = AM_REGISTER_INDIRECT_SRC;
-    HandleDoubleRegisters(sp, instructionWord, postFix);
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, operand.postfix);
 }
 
-void AsmA65k::HandleOperand_Register_Register(const string& operand, InstructionWord instructionWord) // MOV.b r0, r1
+void AsmA65k::HandleOperand_Register_Register(const Operand& operand, InstructionWord instructionWord) // MOV.b r0, r1
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_REGISTER2;
-    HandleDoubleRegisters(sp, instructionWord, PF_NONE);
+    HandleDoubleRegisters(operand.registers[0], operand.registers[1], instructionWord, PF_NONE);
 }
 
-void AsmA65k::HandleOperand_Register_Constant(const string& operand, InstructionWord instructionWord) // MOV.b r0, 1234
+void AsmA65k::HandleOperand_Register_Constant(const Operand& operand, InstructionWord instructionWord) // MOV.b r0, 1234
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_REG_IMMEDIATE;
-    AddRegisterConfigurationByte(sp.left, instructionWord, PF_NONE);
-    VerifyRangeForConstant(sp.right, (OpcodeSize)instructionWord.opcodeSize);
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, PF_NONE);
+    VerifyRangeForConstant(operand.values[0].constant, GetDataSize(instructionWord));
+    AddData(GetDataSize(instructionWord), operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_Register_Label(const string& operand, InstructionWord instructionWord) // MOV.b r0, label
+void AsmA65k::HandleOperand_Register_Label(const Operand& operand, InstructionWord instructionWord) // MOV.b r0, label
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_REG_IMMEDIATE;
-    AddRegisterConfigurationByte(sp.left, instructionWord, PF_NONE);
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, PF_NONE);
 
-    uint32_t address = ResolveLabel(sp.right, PC, (OpcodeSize)instructionWord.opcodeSize);
-    VerifyRangeForConstant(std::to_string(address), (OpcodeSize)instructionWord.opcodeSize);
-    AddData((OpcodeSize)instructionWord.opcodeSize, address);
+    uint32_t address = ResolveValue(operand.values[0], PC, GetDataSize(instructionWord));
+    VerifyRangeForConstant(address, GetDataSize(instructionWord));
+    AddData(GetDataSize(instructionWord), address);
 }
 
-void AsmA65k::HandleOperand_IndirectConstantPlusRegister(const string& operand, InstructionWord instructionWord) // INC.b [1233 + r0]+
+void AsmA65k::HandleOperand_IndirectConstantPlusRegister(const Operand& operand, InstructionWord instructionWord) // INC.b [1233 + r0]+
 {
-    PostfixType postFix = GetPostFixType(operand);
-    StringPair sp = SplitStringByPlusSign(RemoveSquaredBrackets(operand));
-
     // fill in rest of the instruction word
     instructionWord.addressingMode = AM_INDEXED1;
-    AddRegisterConfigurationByte(sp.right, instructionWord, postFix);
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
     // add constant after i.w.
-    AddData(OS_32BIT, ConvertStringToInteger(sp.left));
+    AddData(OS_32BIT, operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectLabelPlusRegister(const string& operand, InstructionWord instructionWord) // INC.b [label + r0]
+void AsmA65k::HandleOperand_IndirectLabelPlusRegister(const Operand& operand, InstructionWord instructionWord) // INC.b [label + r0]
 {
-    PostfixType postFix = GetPostFixType(operand);
-    StringPair sp = SplitStringByPlusSign(RemoveSquaredBrackets(operand));
-
     instructionWord.addressingMode = AM_INDEXED1;
-    AddRegisterConfigurationByte(sp.right, instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(sp.left, PC)); // 4 bytes
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC)); // 4 bytes
 }
 
-void AsmA65k::HandleOperand_IndirectRegisterPlusConstant(const string& operand, InstructionWord instructionWord) // INC.w [r0 + 1234]
+void AsmA65k::HandleOperand_IndirectRegisterPlusConstant(const Operand& operand, InstructionWord instructionWord) // INC.w [r0 + 1234]
 {
-    PostfixType postFix = GetPostFixType(operand);
-    StringPair sp = SplitStringByPlusSign(RemoveSquaredBrackets(operand));
-
     instructionWord.addressingMode = AM_INDEXED1;
-    AddRegisterConfigurationByte(sp.left, instructionWord, postFix);
-    AddData(OS_32BIT, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectRegisterPlusLabel(const string& operand, InstructionWord instructionWord) // INC.w [r0 + label]
+void AsmA65k::HandleOperand_IndirectRegisterPlusLabel(const Operand& operand, InstructionWord instructionWord) // INC.w [r0 + label]
 {
-    PostfixType postFix = GetPostFixType(operand);
-    StringPair sp = SplitStringByPlusSign(RemoveSquaredBrackets(operand));
-
     instructionWord.addressingMode = AM_INDEXED1;
-    AddRegisterConfigurationByte(sp.left, instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(sp.right, PC)); // 4 bytes
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC)); // 4 bytes
 }
 
 void AsmA65k::HandleOperand_IndirectConstant(const uint32_t constant, InstructionWord instructionWord) // INC.w [$ffff]
@@ -521,14 +609,13 @@ void AsmA65k::HandleOperand_IndirectConstant(const uint32_t constant, Instructio
     AddData(OS_32BIT, constant);
 }
 
-void AsmA65k::HandleOperand_Register(const string& operand, InstructionWord instructionWord) // inc r0
+void AsmA65k::HandleOperand_Register(const Operand& operand, InstructionWord instructionWord) // inc r0
 {
     instructionWord.addressingMode = AM_REGISTER1;
     instructionWord.registerConfiguration = RC_REGISTER;
-    RegisterType registerIndex = DetectRegisterType(operand);
 
     AddInstructionWord(instructionWord);
-    AddData(OS_8BIT, registerIndex);
+    AddData(OS_8BIT, operand.registers[0]);
 }
 
 void AsmA65k::HandleOperand_Constant(const uint32_t effectiveAddress, InstructionWord instructionWord) // bne $4000 or psh $f000
@@ -552,11 +639,11 @@ void AsmA65k::HandleOperand_Constant(const uint32_t effectiveAddress, Instructio
         switch (instruction)
         {
         case I_PUSH: // push $ff
-            VerifyRangeForConstant(effectiveAddress, (OpcodeSize)instructionWord.opcodeSize);
+            VerifyRangeForConstant(effectiveAddress, GetDataSize(instructionWord));
             instructionWord.addressingMode = AM_CONST_IMMEDIATE;
             instructionWord.registerConfiguration = RC_NOREGISTER;
             AddInstructionWord(instructionWord);
-            AddData((OpcodeSize)instructionWord.opcodeSize, effectiveAddress);
+            AddData(GetDataSize(instructionWord), effectiveAddress);
             break;
         case I_JMP: // jmp $43434
         case I_JSR: // jsr $3434
@@ -569,253 +656,380 @@ void AsmA65k::HandleOperand_Constant(const uint32_t effectiveAddress, Instructio
         }
 }
 
-void AsmA65k::HandleOperand_IndirectRegister(const string& operand, InstructionWord instructionWord) // inc [r0]
+void AsmA65k::HandleOperand_IndirectRegister(const Operand& operand, InstructionWord instructionWord) // inc [r0]
 {
-    PostfixType postFix = GetPostFixType(operand);
-    string registerString = RemoveSquaredBrackets(operand);
-
     instructionWord.addressingMode = AM_REGISTER_INDIRECT1;
-    AddRegisterConfigurationByte(registerString, instructionWord, postFix);
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
 }
 
-void AsmA65k::HandleOperand_IndirectRegister_Constant(const string& operand, InstructionWord instructionWord) // [r0], 64
+void AsmA65k::HandleOperand_IndirectRegister_Constant(const Operand& operand, InstructionWord instructionWord) // [r0], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-
     instructionWord.addressingMode = AM_REGISTER_INDIRECT_CONST;
-    AddRegisterConfigurationByte(RemoveSquaredBrackets(sp.left), instructionWord, postFix);
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(GetDataSize(instructionWord), operand.values[0].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectLabel_Constant(const string& operand, InstructionWord instructionWord) // [names], 64
+void AsmA65k::HandleOperand_IndirectLabel_Constant(const Operand& operand, InstructionWord instructionWord) // [names], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_ABSOLUTE_CONST;
     instructionWord.registerConfiguration = RC_NOREGISTER;
     AddInstructionWord(instructionWord);
-    AddData(OS_32BIT, ResolveLabel(RemoveSquaredBrackets(sp.left), PC));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectConstant_Constant(const string& operand, InstructionWord instructionWord) // [$1234], 64
+void AsmA65k::HandleOperand_IndirectConstant_Constant(const Operand& operand, InstructionWord instructionWord) // [$1234], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_ABSOLUTE_CONST;
     instructionWord.registerConfiguration = RC_REGISTER;
     AddInstructionWord(instructionWord);
-    AddData(OS_32BIT, ConvertStringToInteger(RemoveSquaredBrackets(sp.left)));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddData(OS_32BIT, operand.values[0].constant);
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectRegisterPlusLabel_Constant(const string& operand, InstructionWord instructionWord) // [r0 + names], 64
+void AsmA65k::HandleOperand_IndirectRegisterPlusLabel_Constant(const Operand& operand, InstructionWord instructionWord) // [r0 + names], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    StringPair indirectSp = SplitStringByPlusSign(RemoveSquaredBrackets(sp.left));
-
     instructionWord.addressingMode = AM_INDEXED_CONST;
-    AddRegisterConfigurationByte(indirectSp.left, instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(indirectSp.right, PC));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectRegisterPlusConstant_Constant(const string& operand, InstructionWord instructionWord) // [r0 + 1234], 64
+void AsmA65k::HandleOperand_IndirectRegisterPlusConstant_Constant(const Operand& operand, InstructionWord instructionWord) // [r0 + 1234], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    StringPair indirectSp = SplitStringByPlusSign(RemoveSquaredBrackets(sp.left));
-
     instructionWord.addressingMode = AM_INDEXED_CONST;
-    AddRegisterConfigurationByte(indirectSp.left, instructionWord, postFix);
-    AddData(OS_32BIT, ConvertStringToInteger(indirectSp.right));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, operand.values[0].constant);
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectConstantPlusRegister_Constant(const string& operand, InstructionWord instructionWord) // [1234 + r0], 64
+void AsmA65k::HandleOperand_IndirectConstantPlusRegister_Constant(const Operand& operand, InstructionWord instructionWord) // [1234 + r0], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    StringPair indirectSp = SplitStringByPlusSign(RemoveSquaredBrackets(sp.left));
-
     instructionWord.addressingMode = AM_INDEXED_CONST;
-    AddRegisterConfigurationByte(indirectSp.left, instructionWord, postFix);
-    AddData(OS_32BIT, ConvertStringToInteger(indirectSp.right));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, operand.values[0].constant);
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
 }
 
-void AsmA65k::HandleOperand_IndirectLabelPlusRegister_Constant(const string& operand, InstructionWord instructionWord) // [names + r0], 64
+void AsmA65k::HandleOperand_IndirectLabelPlusRegister_Constant(const Operand& operand, InstructionWord instructionWord) // [names + r0], 64
 {
-    StringPair sp = SplitStringByComma(operand);
-    PostfixType postFix = GetPostFixType(sp.left);
-    StringPair indirectSp = SplitStringByPlusSign(RemoveSquaredBrackets(sp.left));
-
     instructionWord.addressingMode = AM_INDEXED_DEST;
-    AddRegisterConfigurationByte(indirectSp.right, instructionWord, postFix);
-    AddData(OS_32BIT, ResolveLabel(indirectSp.left, PC));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
+    AddRegisterConfigurationByte(operand.registers[0], instructionWord, operand.postfix);
+    AddData(OS_32BIT, ResolveValue(operand.values[0], PC));
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
 }
 
 // used only for the syscall instruction
-void AsmA65k::HandleOperand_Constant_Label(const string& operand, InstructionWord instructionWord) // sys $1234, label
+void AsmA65k::HandleOperand_Constant_Label(const Operand& operand, InstructionWord instructionWord) // sys $1234, label
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_IMPLIED;
     instructionWord.registerConfiguration = RC_NOREGISTER;
     AddInstructionWord(instructionWord);
-    AddData(OS_16BIT, ConvertStringToInteger(sp.left));
-    AddData(OS_32BIT, ResolveLabel(sp.right, PC));
+    AddData(OS_16BIT, operand.values[0].constant);
+    AddData(OS_32BIT, ResolveValue(operand.values[1], PC));
 }
 
 // used only for the syscall instruction
-void AsmA65k::HandleOperand_Constant_Constant(const string& operand, InstructionWord instructionWord) // sys $1234, $5678
+void AsmA65k::HandleOperand_Constant_Constant(const Operand& operand, InstructionWord instructionWord) // sys $1234, $5678
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_IMPLIED;
     instructionWord.registerConfiguration = RC_NOREGISTER;
     AddInstructionWord(instructionWord);
-    AddData(OS_16BIT, ConvertStringToInteger(sp.left));
-    AddData(OS_32BIT, ConvertStringToInteger(sp.right));
+    AddData(OS_16BIT, operand.values[0].constant);
+    AddData(OS_32BIT, operand.values[1].constant);
 }
 
 // used only for the syscall instruction
-void AsmA65k::HandleOperand_Label_Label(const string& operand, InstructionWord instructionWord) // sys label, label
+void AsmA65k::HandleOperand_Label_Label(const Operand& operand, InstructionWord instructionWord) // sys label, label
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_IMPLIED;
     instructionWord.registerConfiguration = RC_NOREGISTER;
     AddInstructionWord(instructionWord);
-    AddData(OS_16BIT, ResolveLabel(sp.left, PC, OS_16BIT));
-    AddData(OS_32BIT, ResolveLabel(sp.right, PC));
+    AddData(OS_16BIT, ResolveValue(operand.values[0], PC, OS_16BIT));
+    AddData(OS_32BIT, ResolveValue(operand.values[1], PC));
 }
 
 // used only for the syscall instruction
-void AsmA65k::HandleOperand_Label_Constant(const string& operand, InstructionWord instructionWord) // sys label, $1234
+void AsmA65k::HandleOperand_Label_Constant(const Operand& operand, InstructionWord instructionWord) // sys label, $1234
 {
-    StringPair sp = SplitStringByComma(operand);
-
     instructionWord.addressingMode = AM_SYSCALL;
     instructionWord.registerConfiguration = RC_NOREGISTER;
     AddInstructionWord(instructionWord);
-    AddData(OS_16BIT, ResolveLabel(sp.left, PC, OS_16BIT));
-    AddData((OpcodeSize)instructionWord.opcodeSize, ConvertStringToInteger(sp.right));
-}
-
-AsmA65k::OperandTypes AsmA65k::DetectOperandType(const string& operandStr)
-{
-    const static regex_constants::syntax_option_type icase = regex_constants::icase;
-    const static regex rx_matchDoubleOperands(R"((.*)\s*,\s*(.*))", icase);
-    const static regex rx_constant(R"((^-?\d+$)|(^\$[0-9a-f]+)$|(^%[01]+$))", icase);                                             // 64
-    const static regex rx_label(R"([a-z][a-z_0-9]*)", icase);                                                                     // names
-    const static regex rx_register(R"((r[0-9]{1,2})|(PC|SP))", icase);                                                            // r0
-    const static regex rx_indirectConstant(R"(\[\s*[$%]?[0-9a-f]+\s*\])", icase);                                                 // [$5000]
-    const static regex rx_indirectLabel(R"(\[[a-z][a-z_0-9]*\])", icase);                                                         // [names]
-    const static regex rx_indirectRegister(R"(\[\s*((r[0-9]{1,2})|(PC|SP))\s*\][\+\-]?)", icase);                                 // [r0]
-    const static regex rx_indirectRegisterPlusConst(R"(\[\s*((r[0-9]{1,2})|(PC|SP))\s*\+\s*[$%]?[0-9]+\s*\][\+\-]?)", icase);     // [r0 + $1000]
-    const static regex rx_indirectConstPlusRegister(R"(\[\s*[$%]?[0-9a-f]+\s*\+\s*((r[0-9]{1,2})|(pc))\s*\][\+\-]?)", icase);     // [$1000 + r0]
-    const static regex rx_indirectRegisterPlusLabel(R"(\[\s*((r[0-9]{1,2})|(PC|SP))\s*\+\s*[a-z][a-z_0-9]*\s*\][\+\-]?)", icase); // [r0 + names]
-    const static regex rx_indirectLabelPlusRegister(R"(\[\s*[a-z][a-z_0-9]*\s*\+\s*((r[0-9]{1,2})|(PC|SP))\s*\][\+\-]?)", icase); // [names + r0]
-
-    if (operandStr == "")
-        return OT_NONE;
-
-    smatch match;
-    if (regex_match(operandStr, match, rx_matchDoubleOperands)) // double operands
+    AddData(OS_16BIT, ResolveValue(operand.values[0], PC, OS_16BIT));
+    AddData(GetDataSize(instructionWord), operand.values[1].constant);
+}
+
+// reads a single register or expression starting at 'pos' and stores it in the descriptor. an expression of
+// constants is folded into a constant, anything else with a name or '*' is a label
+AsmA65k::OperandTermType AsmA65k::ParseOperandTerm(std::string_view text, size_t& pos, Operand& operand)
+{
+    SkipWhiteSpace(text, pos);
+    const size_t start = pos;
+
+    if (pos < text.size() && IsIdentifierStart(text[pos])) // register or label
     {
-        string left = match[1];
-        string right = match[2];
+        while (pos < text.size() && IsIdentifierChar(text[pos]))
+            pos++;
 
-        // log("double operands detected. left = '%s', right = '%s'\n", left.c_str(), right.c_str());
+        RegisterType registerType;
+        if (DetectRegisterType(text.substr(start, pos - start), registerType))
+        {
+            if (operand.registerCount == 2)
+                ThrowException_InvalidOperands();
 
-        if (regex_match(left, rx_register) && regex_match(right, rx_register))
+            operand.registers[operand.registerCount++] = registerType;
+            return TERM_REGISTER;
+        }
+        pos = start;
+    }
+    else if (pos == text.size() || IsExpressionStart(text[pos]) == false)
+        ThrowException_InvalidOperands();
+
+    if (operand.valueCount == 2)
+        ThrowException_InvalidOperands();
+
+    OperandValue& value = operand.values[operand.valueCount++];
+    const uint32_t firstToken = ParseExpression(text, pos, isSizingPass == false || optimize); // the sizing pass needs the values for the optimizer only
+    if (expressionTokens.size() - firstToken == 1 && expressionTokens[firstToken].type == EXPR_CONSTANT)
+    {
+        value.isLabel = false;
+        value.constant = expressionTokens[firstToken].value;
+        expressionTokens.pop_back();
+        return TERM_CONSTANT;
+    }
+
+    value.isLabel = true;
+    value.firstToken = firstToken;
+    value.tokenCount = (uint32_t)expressionTokens.size() - firstToken;
+    return TERM_LABEL;
+}
+
+// reads one side of a (possibly comma separated) operand: a term, or a bracketed term with an optional '+ term' and postfix
+AsmA65k::OperandShape AsmA65k::ParseOperandSide(std::string_view text, size_t& pos, Operand& operand)
+{
+    SkipWhiteSpace(text, pos);
+
+    if (pos == text.size())
+        ThrowException_InvalidOperands();
+
+    if (text[pos] != '[')
+    {
+        switch (ParseOperandTerm(text, pos, operand))
+        {
+        case TERM_REGISTER:
+            return SHAPE_REGISTER;
+        case TERM_CONSTANT:
+            return SHAPE_CONSTANT;
+        case TERM_LABEL:
+            return SHAPE_LABEL;
+        }
+    }
+
+    pos++; // skip '['
+    const OperandTermType base = ParseOperandTerm(text, pos, operand);
+    OperandShape shape = SHAPE_INDIRECT_REGISTER;
+
+    SkipWhiteSpace(text, pos);
+    if (pos < text.size() && text[pos] == '+') // [base + index]
+    {
+        pos++;
+        const OperandTermType index = ParseOperandTerm(text, pos, operand);
+
+        if (base == TERM_REGISTER && index == TERM_CONSTANT)
+            shape = SHAPE_INDIRECT_REGISTER_PLUS_CONSTANT;
+        else if (base == TERM_REGISTER && index == TERM_LABEL)
+            shape = SHAPE_INDIRECT_REGISTER_PLUS_LABEL;
+        else if (base == TERM_CONSTANT && index == TERM_REGISTER)
+            shape = SHAPE_INDIRECT_CONSTANT_PLUS_REGISTER;
+        else if (base == TERM_LABEL && index == TERM_REGISTER)
+            shape = SHAPE_INDIRECT_LABEL_PLUS_REGISTER;
+        else
+            ThrowException_InvalidOperands();
+
+        SkipWhiteSpace(text, pos);
+    }
+    else if (base == TERM_REGISTER)
+        shape = SHAPE_INDIRECT_REGISTER;
+    else if (base == TERM_CONSTANT)
+        shape = SHAPE_INDIRECT_CONSTANT;
+    else
+        shape = SHAPE_INDIRECT_LABEL;
+
+    if (pos == text.size() || text[pos] != ']')
+        ThrowException_InvalidOperands();
+    pos++;
+
+    // detect postfix sign: [r0]+ or [r0]-
+    if (pos < text.size() && (text[pos] == '+' || text[pos] == '-'))
+    {
+        if (shape == SHAPE_INDIRECT_CONSTANT || shape == SHAPE_INDIRECT_LABEL)
+            ThrowException_InvalidOperands();
+
+        operand.postfix = text[pos] == '+' ? PF_INC : PF_DEC;
+        pos++;
+    }
+
+    return shape;
+}
+
+AsmA65k::OperandTypes AsmA65k::GetSingleOperandType(const OperandShape shape)
+{
+    switch (shape)
+    {
+    case SHAPE_REGISTER:
+        return OT_REGISTER;
+    case SHAPE_CONSTANT:
+        return OT_CONSTANT;
+    case SHAPE_LABEL:
+        return OT_LABEL;
+    case SHAPE_INDIRECT_REGISTER:
+        return OT_INDIRECT_REGISTER;
+    case SHAPE_INDIRECT_CONSTANT:
+        return OT_INDIRECT_CONSTANT;
+    case SHAPE_INDIRECT_LABEL:
+        return OT_INDIRECT_LABEL;
+    case SHAPE_INDIRECT_REGISTER_PLUS_CONSTANT:
+        return OT_INDIRECT_REGISTER_PLUS_CONSTANT;
+    case SHAPE_INDIRECT_REGISTER_PLUS_LABEL:
+        return OT_INDIRECT_REGISTER_PLUS_LABEL;
+    case SHAPE_INDIRECT_CONSTANT_PLUS_REGISTER:
+        return OT_INDIRECT_CONSTANT_PLUS_REGISTER;
+    case SHAPE_INDIRECT_LABEL_PLUS_REGISTER:
+        return OT_INDIRECT_LABEL_PLUS_REGISTER;
+    }
+
+    return OT_NONE;
+}
+
+// returns OT_NONE if the combination is not a valid diadic operand
+AsmA65k::OperandTypes AsmA65k::GetDoubleOperandType(const OperandShape left, const OperandShape right)
+{
+    switch (left)
+    {
+    case SHAPE_REGISTER:
+        switch (right)
+        {
+        case SHAPE_REGISTER:
             return OT_REGISTER__REGISTER;
-        if (regex_match(left, rx_register) && regex_match(right, rx_constant))
+        case SHAPE_CONSTANT:
             return OT_REGISTER__CONSTANT;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectConstant))
-            return OT_REGISTER__INDIRECT_CONSTANT;
-        if (regex_match(left, rx_indirectRegister) && regex_match(right, rx_register))
-            return OT_INDIRECT_REGISTER__REGISTER;
-        if (regex_match(left, rx_indirectLabel) && regex_match(right, rx_register))
-            return OT_INDIRECT_LABEL__REGISTER;
-        if (regex_match(left, rx_indirectConstant) && regex_match(right, rx_register))
-            return OT_INDIRECT_CONSTANT__REGISTER;
-        if (regex_match(left, rx_indirectRegisterPlusConst) && regex_match(right, rx_register))
-            return OT_INDIRECT_REGISTER_PLUS_CONSTANT__REGISTER;
-        if (regex_match(left, rx_indirectRegisterPlusLabel) && regex_match(right, rx_register))
-            return OT_INDIRECT_REGISTER_PLUS_LABEL__REGISTER;
-        if (regex_match(left, rx_indirectLabelPlusRegister) && regex_match(right, rx_register))
-            return OT_INDIRECT_LABEL_PLUS_REGISTER__REGISTER;
-        if (regex_match(left, rx_indirectConstPlusRegister) && regex_match(right, rx_register))
-            return OT_INDIRECT_CONSTANT_PLUS_REGISTER__REGISTER;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectRegister))
+        case SHAPE_LABEL:
+            return OT_REGISTER__LABEL;
+        case SHAPE_INDIRECT_REGISTER:
             return OT_REGISTER__INDIRECT_REGISTER;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectRegisterPlusConst))
+        case SHAPE_INDIRECT_CONSTANT:
+            return OT_REGISTER__INDIRECT_CONSTANT;
+        case SHAPE_INDIRECT_LABEL:
+            return OT_REGISTER__INDIRECT_LABEL;
+        case SHAPE_INDIRECT_REGISTER_PLUS_CONSTANT:
             return OT_REGISTER__INDIRECT_REGISTER_PLUS_CONSTANT;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectRegisterPlusLabel))
+        case SHAPE_INDIRECT_REGISTER_PLUS_LABEL:
             return OT_REGISTER__INDIRECT_REGISTER_PLUS_LABEL;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectConstPlusRegister))
+        case SHAPE_INDIRECT_CONSTANT_PLUS_REGISTER:
             return OT_REGISTER__INDIRECT_CONSTANT_PLUS_REGISTER;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectLabelPlusRegister))
+        case SHAPE_INDIRECT_LABEL_PLUS_REGISTER:
             return OT_REGISTER__INDIRECT_LABEL_PLUS_REGISTER;
-        if (regex_match(left, rx_register) && regex_match(right, rx_label))
-            return OT_REGISTER__LABEL;
-        if (regex_match(left, rx_register) && regex_match(right, rx_indirectLabel))
-            return OT_REGISTER__INDIRECT_LABEL;
-        if (regex_match(left, rx_constant) && regex_match(right, rx_label))
-            return OT_CONSTANT__LABEL;
-        if (regex_match(left, rx_constant) && regex_match(right, rx_constant))
+        }
+        break;
+
+    case SHAPE_CONSTANT:
+        if (right == SHAPE_CONSTANT)
             return OT_CONSTANT__CONSTANT;
-        if (regex_match(left, rx_label) && regex_match(right, rx_constant))
+        if (right == SHAPE_LABEL)
+            return OT_CONSTANT__LABEL;
+        break;
+
+    case SHAPE_LABEL:
+        if (right == SHAPE_CONSTANT)
             return OT_LABEL__CONSTANT;
-        if (regex_match(left, rx_label) && regex_match(right, rx_label))
+        if (right == SHAPE_LABEL)
             return OT_LABEL__LABEL;
-        if (regex_match(left, rx_indirectRegister) && regex_match(right, rx_constant))
+        break;
+
+    case SHAPE_INDIRECT_REGISTER:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_REGISTER__REGISTER;
+        if (right == SHAPE_CONSTANT)
             return OT_INDIRECT_REGISTER__CONSTANT;
-        if (regex_match(left, rx_indirectLabel) && regex_match(right, rx_constant))
-            return OT_INDIRECT_LABEL__CONSTANT;
-        if (regex_match(left, rx_indirectConstant) && regex_match(right, rx_constant))
+        break;
+
+    case SHAPE_INDIRECT_CONSTANT:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_CONSTANT__REGISTER;
+        if (right == SHAPE_CONSTANT)
             return OT_INDIRECT_CONSTANT__CONSTANT;
-        if (regex_match(left, rx_indirectRegisterPlusLabel) && regex_match(right, rx_constant))
-            return OT_INDIRECT_REGISTER_PLUS_LABEL__CONSTANT;
-        if (regex_match(left, rx_indirectRegisterPlusConst) && regex_match(right, rx_constant))
+        break;
+
+    case SHAPE_INDIRECT_LABEL:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_LABEL__REGISTER;
+        if (right == SHAPE_CONSTANT)
+            return OT_INDIRECT_LABEL__CONSTANT;
+        break;
+
+    case SHAPE_INDIRECT_REGISTER_PLUS_CONSTANT:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_REGISTER_PLUS_CONSTANT__REGISTER;
+        if (right == SHAPE_CONSTANT)
             return OT_INDIRECT_REGISTER_PLUS_CONSTANT__CONSTANT;
-        if (regex_match(left, rx_indirectLabelPlusRegister) && regex_match(right, rx_constant))
-            return OT_INDIRECT_LABEL_PLUS_REGISTER__CONSTANT;
-        if (regex_match(left, rx_indirectConstPlusRegister) && regex_match(right, rx_constant))
+        break;
+
+    case SHAPE_INDIRECT_REGISTER_PLUS_LABEL:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_REGISTER_PLUS_LABEL__REGISTER;
+        if (right == SHAPE_CONSTANT)
+            return OT_INDIRECT_REGISTER_PLUS_LABEL__CONSTANT;
+        break;
+
+    case SHAPE_INDIRECT_CONSTANT_PLUS_REGISTER:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_CONSTANT_PLUS_REGISTER__REGISTER;
+        if (right == SHAPE_CONSTANT)
             return OT_INDIRECT_CONSTANT_PLUS_REGISTER__CONSTANT;
+        break;
+
+    case SHAPE_INDIRECT_LABEL_PLUS_REGISTER:
+        if (right == SHAPE_REGISTER)
+            return OT_INDIRECT_LABEL_PLUS_REGISTER__REGISTER;
+        if (right == SHAPE_CONSTANT)
+            return OT_INDIRECT_LABEL_PLUS_REGISTER__CONSTANT;
+        break;
     }
-    else // single operand
+
+    return OT_NONE;
+}
+
+AsmA65k::Operand AsmA65k::ParseOperand(std::string_view operandStr)
+{
+    Operand operand;
+    size_t pos = 0;
+
+    SkipWhiteSpace(operandStr, pos);
+    if (pos == operandStr.size())
+        return operand; // OT_NONE
+
+    const OperandShape left = ParseOperandSide(operandStr, pos, operand);
+    SkipWhiteSpace(operandStr, pos);
+
+    if (pos == operandStr.size()) // single operand
     {
-        // printf("DetectOperandType(): single operand detected. operand = '%s'\n", operandStr.c_str());
-
-        if (regex_match(operandStr, rx_register))
-            return OT_REGISTER;
-        if (regex_match(operandStr, rx_constant))
-            return OT_CONSTANT;
-        if (regex_match(operandStr, rx_indirectConstant))
-            return OT_INDIRECT_CONSTANT;
-        if (regex_match(operandStr, rx_indirectRegister))
-            return OT_INDIRECT_REGISTER;
-        if (regex_match(operandStr, rx_indirectRegisterPlusConst))
-            return OT_INDIRECT_REGISTER_PLUS_CONSTANT;
-        if (regex_match(operandStr, rx_indirectConstPlusRegister))
-            return OT_INDIRECT_CONSTANT_PLUS_REGISTER;
-        if (regex_match(operandStr, rx_indirectRegisterPlusLabel))
-            return OT_INDIRECT_REGISTER_PLUS_LABEL;
-        if (regex_match(operandStr, rx_indirectLabelPlusRegister))
-            return OT_INDIRECT_LABEL_PLUS_REGISTER;
-        if (regex_match(operandStr, rx_label))
-            return OT_LABEL;
-        if (regex_match(operandStr, rx_indirectLabel))
-            return OT_INDIRECT_LABEL;
+        operand.type = GetSingleOperandType(left);
+        return operand;
     }
 
-    ThrowException_InvalidOperands();
+    if (operandStr[pos] != ',')
+        ThrowException_InvalidOperands();
+    pos++;
+
+    const OperandShape right = ParseOperandSide(operandStr, pos, operand); // double operands
+    SkipWhiteSpace(operandStr, pos);
+
+    if (pos != operandStr.size())
+        ThrowException_InvalidOperands();
+
+    operand.type = GetDoubleOperandType(left, right);
+    if (operand.type == OT_NONE)
+        ThrowException_InvalidOperands();
 
-    return OT_NONE; // fake line to silence warning
+    return operand;
 }
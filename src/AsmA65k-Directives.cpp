@@ -10,262 +10,372 @@
 
 #include <Asm65k.h>
 #include <sstream>
-#include <regex>
 #include <iostream>
+#include <cstring>
+#include <filesystem>
 
 using namespace std;
 
-bool AsmA65k::ProcessDirectives(const string& line)
+void AsmA65k::ProcessDirective(const SourceLine& sourceLine)
 {
-    const int directiveType = DetectDirective(line); // explicit declaration is intentional
+    const Directives directiveType = FindDirective(sourceLine.keyword); // explicit declaration is intentional
+    if (directiveType != DIRECTIVE_NONE)
+        actToken = sourceLine.operand;
+
     switch (directiveType)
     {
-    case DIRECTIVE_NONE:
-        return false;
-
     case DIRECTIVE_SETPC:
-        HandleDirective_SetPC(line);
+        HandleDirective_SetPC(sourceLine.operand);
         break;
 
     case DIRECTIVE_TEXT:
     case DIRECTIVE_TEXTZ:
-        HandleDirective_Text(line, directiveType);
+        HandleDirective_Text(sourceLine.operand, directiveType);
         break;
 
     case DIRECTIVE_BYTE:
     case DIRECTIVE_WORD:
     case DIRECTIVE_DWORD:
-        HandleDirective_ByteWordDword(line, directiveType);
+        HandleDirective_ByteWordDword(sourceLine.operand, directiveType);
         break;
 
     case DIRECTIVE_DEFINE:
-        HandleDirective_Define(line);
+        HandleDirective_Define(sourceLine.operand);
+        break;
+
+    case DIRECTIVE_INCLUDE:
+        HandleDirective_Include(sourceLine.operand);
+        break;
+
+    case DIRECTIVE_MACRO:
+        HandleDirective_Macro(sourceLine.operand);
         break;
 
-    default:
+    case DIRECTIVE_EXPORT:
+        HandleDirective_Export(sourceLine.operand);
+        break;
+
+    case DIRECTIVE_ENDM:
     {
-        AsmError error(actLineNumber, line, "Internal error: directive handler not implemented");
+        AsmError error(actLineNumber, actLine, ".endm without .macro");
         throw error;
     }
-    }
 
-    return true;
+    case DIRECTIVE_NONE:
+    {
+        AsmError error(actLineNumber, actLine, "Unrecognized directive");
+        throw error;
+    }
+    }
 }
 
-int AsmA65k::DetectDirective(const string& line)
+// returns the number or label starting at 'pos', stepping over it. the result is empty if there's none
+std::string_view AsmA65k::ScanValueToken(std::string_view text, size_t& pos)
 {
-    const static regex rx_detectDirective(R"(^(\s*|.*:\s*)\.([a-z]+).*)", regex_constants::icase);
-    smatch directiveCandidate;
-
-    if (regex_search(line, directiveCandidate, rx_detectDirective) == 0)
-        return DIRECTIVE_NONE;
-
-    if (directiveCandidate[2].str() == "pc")
-        return DIRECTIVE_SETPC;
-
-    if (directiveCandidate[2].str() == "text")
-        return DIRECTIVE_TEXT;
-
-    if (directiveCandidate[2].str() == "textz")
-        return DIRECTIVE_TEXTZ;
+    SkipWhiteSpace(text, pos);
+    const size_t start = pos;
 
-    if (directiveCandidate[2].str() == "def")
-        return DIRECTIVE_DEFINE;
+    if (pos < text.size() && (text[pos] == '$' || text[pos] == '%' || text[pos] == '-'))
+        pos++;
 
-    if (directiveCandidate[2].str() == "byte")
-        return DIRECTIVE_BYTE;
+    while (pos < text.size() && IsIdentifierChar(text[pos]))
+        pos++;
 
-    if (directiveCandidate[2].str() == "word")
-        return DIRECTIVE_WORD;
-
-    if (directiveCandidate[2].str() == "dword")
-        return DIRECTIVE_DWORD;
-
-    AsmError error(actLineNumber, line, "Unrecognized directive");
-    throw error;
+    return text.substr(start, pos - start);
 }
 
-void AsmA65k::HandleDirective_SetPC(const string& line)
+void AsmA65k::HandleDirective_SetPC(std::string_view arguments) // .pc = $1000 or .pc = base + $400
 {
-    static const regex rx_matchNumberInSetPCDirectiveLine(R"(\s*.pc\s*=\s*(([$%]?[0-9a-f]+$)|(([$%]?[0-9a-f]+)[\s|;])).*)", regex_constants::icase);
-    smatch value;
+    size_t pos = 0;
+    bool isValid = false;
+    uint32_t firstToken = 0;
+
+    SkipWhiteSpace(arguments, pos);
+    if (pos < arguments.size() && arguments[pos] == '=')
+    {
+        pos++;
+        SkipWhiteSpace(arguments, pos);
+        if (pos < arguments.size() && IsExpressionStart(arguments[pos]))
+        {
+            firstToken = ParseExpression(arguments, pos);
+            SkipWhiteSpace(arguments, pos);
+            isValid = pos == arguments.size();
+        }
+    }
 
-    if (regex_search(line, value, rx_matchNumberInSetPCDirectiveLine) == false || regex_match(line, rx_matchNumberInSetPCDirectiveLine) == false)
+    if (isValid == false)
     {
-        AsmError error(actLineNumber, line, "No valid value found for .pc directive");
+        AsmError error(actLineNumber, actLine, "No valid value found for .pc directive");
         throw error;
     }
 
-    PC = ConvertStringToInteger(value[1].str());
+    PC = EvaluateDefinedExpression(firstToken);
 
-    // create a new segment, store it in 'segments' vector
-    segments.push_back(Segment());
-    segments.back().address = PC;
+    AddSegment(PC);
 }
 
-void AsmA65k::HandleDirective_Text(const string& line, const int directiveType)
+void AsmA65k::HandleDirective_Text(std::string_view arguments, const Directives directiveType) // .text "Hello world!"
 {
-    static const regex rx_matchTextInTextDirective(R"(.*\.text\s*\"(.*)\".*)", regex_constants::icase);
-    smatch textMatch;
-
-    if (regex_search(line, textMatch, rx_matchTextInTextDirective) == false)
+    // the text lasts from the first to the last quotation mark
+    const size_t textEnd = arguments.rfind('"');
+    if (arguments.empty() || arguments[0] != '"' || textEnd == 0 || textEnd == std::string_view::npos)
     {
-        AsmError error(actLineNumber, line, "No valid data found after .text directive");
+        AsmError error(actLineNumber, actLine, "No valid data found after .text directive");
         throw error;
     }
 
-    if (segments.empty())
+    if (isSizingPass && segments.empty())
     {
-        AsmError error(actLineNumber, line, "A .pc directive must precede a .text directive");
+        AsmError error(actLineNumber, actLine, "A .pc directive must precede a .text directive");
         throw error;
     }
 
-    unsigned i = 0;
-    const size_t textLength = textMatch[1].str().length();
+    const std::string_view text = arguments.substr(1, textEnd - 1);
+    const uint32_t address = PC;
+    PC += text.size();
+    if (directiveType == DIRECTIVE_TEXTZ) // add terminating zero for textz directive
+        PC++;
 
-    do
+    if (isSizingPass)
     {
-        segments.back().data.push_back(textMatch[1].str()[i]); // store text into current segment
-    } while (++i < textLength);
+        RecordStatement(address);
+        return;
+    }
 
-    if (directiveType == DIRECTIVE_TEXTZ) // add additional '0' for textz directive
-        segments.back().data.push_back('0');
+    memcpy(output, text.data(), text.size()); // store text into current segment
+    output += text.size();
 
-    PC += textLength;
+    if (directiveType == DIRECTIVE_TEXTZ)
+        *output++ = 0;
 }
 
-void AsmA65k::HandleDirective_ByteWordDword(const string& line, const int directiveType)
-{ // trim line back to the raw data after the directive
-    static const regex rx_matchDataInByteDirective(R"(.*\.(byte|word|dword)\s+(.+)\s*.*)", regex_constants::icase);
-    smatch dataMatch;
-
-    // check if line is valid
-    if (regex_search(line, dataMatch, rx_matchDataInByteDirective) == false)
-    {
-        AsmError error(actLineNumber, line);
-        error.errorMessage = "Invalid data found after .";
-        error.errorMessage += dataMatch[1];
-        error.errorMessage += " directive";
-
-        throw error;
-    }
+void AsmA65k::HandleDirective_ByteWordDword(std::string_view arguments, const Directives directiveType) // .byte 1, $2, %11, label, <(table + 4)
+{
+    const char *directiveName = directiveType == DIRECTIVE_BYTE ? "byte" : (directiveType == DIRECTIVE_WORD ? "word" : "dword");
 
     // check if there's an existing segment already
-    if (segments.empty())
+    if (isSizingPass && segments.empty())
     {
-        AsmError error(actLineNumber, line);
+        AsmError error(actLineNumber, actLine);
         error.errorMessage = "A .pc directive must precede a .";
-        error.errorMessage += dataMatch[1];
+        error.errorMessage += directiveName;
         error.errorMessage += " directive";
 
         throw error;
     }
 
-    // match the individual numbers
-    static const regex rx_matchNumber(R"(([%$]?([0-9a-f]+|\s*[a-z][a-z_0-9]*))\s*,?\s*)");
-    const string matchStr = dataMatch[2].str(); // dataMatch[1] = (byte|word|dword); dataMatch[2] = "%1, $2, 3, 4", etc
-    sregex_token_iterator iter(matchStr.begin(), matchStr.end(), rx_matchNumber, 1);
-    const sregex_token_iterator end;
-    while (iter != end) // iterate through sub-matches, that is, each data element after the directive, skipping ',' and white space
+    const uint32_t address = PC;
+    size_t pos = 0;
+    do // iterate through each data element after the directive, skipping ',' and white space
     {
-        uint32_t value;
-        const string token = iter->str();
-        // check if the string is a label
-        if (token[0] >= 'a' && token[0] <= 'z')
-            value = ResolveLabel(token, PC, OS_32BIT);
-        else
-            value = ConvertStringToInteger(token);
+        SkipWhiteSpace(arguments, pos);
+        const bool isValue = pos < arguments.size() && IsExpressionStart(arguments[pos]);
+        const uint32_t firstToken = isValue ? ParseExpression(arguments, pos, isSizingPass == false) : 0;
+        SkipWhiteSpace(arguments, pos);
+
+        // check if line is valid
+        if (isValue == false || (pos < arguments.size() && arguments[pos] != ','))
+        {
+            AsmError error(actLineNumber, actLine);
+            error.errorMessage = "Invalid data found after .";
+            error.errorMessage += directiveName;
+            error.errorMessage += " directive";
+
+            throw error;
+        }
+
+        // the sizing pass only counts the elements, parsing them interned the names for the encoding pass
+        if (isSizingPass)
+        {
+            PC += directiveType == DIRECTIVE_BYTE ? 1 : (directiveType == DIRECTIVE_WORD ? 2 : 4);
+            continue;
+        }
+
+        const uint32_t value = ResolveExpression(expressionTokens.data() + firstToken, (uint32_t)expressionTokens.size() - firstToken, PC,
+                                                 directiveType == DIRECTIVE_BYTE ? OS_8BIT : directiveType == DIRECTIVE_WORD ? OS_16BIT : OS_32BIT);
 
         // handle data size
         switch (directiveType)
         {
         case DIRECTIVE_BYTE:
-            if (value < 0 || value > 255)
+            if (value > 255)
                 ThrowException_ValueOutOfRange();
 
-            segments.back().AddByte(value); // store data as byte
+            *output++ = (uint8_t)value; // store data as byte
             PC++;
             break;
 
         case DIRECTIVE_WORD:
-            if (value < 0 || value > 65535)
+            if (value > 65535)
                 ThrowException_ValueOutOfRange();
 
-            segments.back().AddWord(value); // store data as word
+            Segment::StoreWord(output, (uint16_t)value); // store data as word
+            output += 2;
             PC += 2;
             break;
 
         case DIRECTIVE_DWORD:
-            if (value < 0)
-                ThrowException_ValueOutOfRange();
-
-            segments.back().AddDword(value); // store data as dword
+            Segment::StoreDword(output, value); // store data as dword
+            output += 4;
             PC += 4;
             break;
 
         default: // can never ever get here
             break;
         } // switch
+    } while (pos++ < arguments.size()); // step over the ','
 
-        ++iter; // step the iterator
-    }           // while
+    if (isSizingPass)
+        RecordStatement(address);
 }
 
-void AsmA65k::HandleDirective_Define(const string& line)
+void AsmA65k::HandleDirective_Define(std::string_view arguments) // .def NAME = CONST or .def NAME = (LABEL + CONST) * 2
 {
-    const static regex rx_matchDefintionLine(R"(\s*\.def\s+([a-z][a-z_0-9]*)\s*=\s*([^;]+)\s*;?.*)", regex_constants::icase);
-    smatch matches;
+    size_t pos = 0;
+    SkipWhiteSpace(arguments, pos);
+
+    const size_t labelStart = pos;
+    while (pos < arguments.size() && IsIdentifierChar(arguments[pos]))
+        pos++;
+    const std::string_view label = lineArena.ToLower(arguments.substr(labelStart, pos - labelStart));
 
-    if (regex_match(line, matches, rx_matchDefintionLine) == false)
+    SkipWhiteSpace(arguments, pos);
+    if (label.empty() || IsIdentifierStart(label[0]) == false || pos == arguments.size() || arguments[pos] != '=')
     {
-        AsmError error(actLineNumber, line, "Invalid definition");
+        AsmError error(actLineNumber, actLine, "Invalid definition");
         throw error;
     }
+    pos++;
 
-    // store label in its own variable and convert it into lower case
-    string label = matches[1].str();
-    std::transform(label.begin(), label.end(), label.begin(), ::tolower);
+    SkipWhiteSpace(arguments, pos);
+    if (pos == arguments.size() || IsExpressionStart(arguments[pos]) == false)
+    {
+        AsmError error(actLineNumber, actLine, "Invalid defintion expression");
+        throw error;
+    }
 
-    // check if rvalue is a single constant
-    const static regex rx_matchConstant(R"(([%$]?[0-9a-f]+)\s*)", regex_constants::icase);
-    smatch valueMatch;
-    string match2 = matches[2].str();
-    if (regex_match(match2, valueMatch, rx_matchConstant))
-    { // if yes, convert it into decimal and add it into the symbol table
-        labels[label] = ConvertStringToInteger(valueMatch[1].str());
+    const uint32_t firstToken = ParseExpression(arguments, pos);
+    SkipWhiteSpace(arguments, pos);
+    if (pos != arguments.size())
+    {
+        AsmError error(actLineNumber, actLine, "Invalid defintion expression");
+        throw error;
+    }
 
-        return;
+    DefineSymbol(labels.Intern(label), EvaluateDefinedExpression(firstToken));
+}
+
+void AsmA65k::HandleDirective_Include(std::string_view arguments) // .include "registers.s"
+{
+    if (arguments.size() < 3 || arguments.front() != '"' || arguments.back() != '"')
+    {
+        AsmError error(actLineNumber, actLine, "No valid file name found after .include directive");
+        throw error;
     }
 
-    // check if rvalue is an expression (only the simple 'label + const' format is allowed)
-    const static regex rx_matchExpression(R"(([a-z][a-z_0-9]*)\s*\+\s*([%$]?[0-9a-f]+).*)", regex_constants::icase);
-    smatch expressionOperands;
-    match2 = matches[2].str();
-    if (regex_match(match2, expressionOperands, rx_matchExpression))
+    if (isSizingPass == false) // the lines of the file are statements of their own
+        return;
+
+    if (sourceStack.size() > MAX_INCLUDE_DEPTH)
     {
-        // read lvalue and convert it into lower case
-        string lvalue = expressionOperands[1].str();
-        std::transform(lvalue.begin(), lvalue.end(), lvalue.begin(), ::tolower);
+        AsmError error(actLineNumber, actLine, "Include files are nested too deeply");
+        throw error;
+    }
+
+    // a relative path starts from the directory of the including file
+    const uint32_t parent = sourceStack.back().fileIndex;
+    std::filesystem::path path(arguments.substr(1, arguments.size() - 2));
+    if (path.is_relative())
+        path = std::filesystem::path(sourceFiles[sourceFiles[parent].definitionFile].name).parent_path() / path;
+    const std::string fileName = path.lexically_normal().string();
 
-        // check if lvalue symbol exists
-        if (labels.find(lvalue) == labels.end())
+    // a header with precompiled symbols only defines them
+    if (const std::shared_ptr<const SymbolFile> symbolFile = LoadSymbolFile(fileName))
+    {
+        for (uint32_t i = 0; i < symbolFile->GetCount(); i++)
         {
-            AsmError error(actLineNumber, line);
-            error.errorMessage = "Symbol not defined: ";
-            error.errorMessage += expressionOperands[1].str();
+            const SymbolFile::Entry &entry = symbolFile->GetEntry(i);
+            DefineSymbol(labels.Intern(symbolFile->GetName(entry), entry.hash), entry.value);
+        }
+        return;
+    }
+
+    std::shared_ptr<const IncludedFile> file = LoadIncludedFile(fileName);
+    if (file == nullptr)
+    {
+        AsmError error(actLineNumber, actLine, "Could not open include file '" + fileName + "'");
+        throw error;
+    }
 
+    // the sizing pass continues with the first line of the file
+    const uint32_t fileIndex = (uint32_t)sourceFiles.size();
+    sourceFiles.push_back(SourceFile{fileName, parent, sourceStack.back().lineNumber - 1, fileIndex});
+    sourceStack.push_back(SourceCursor{std::string_view(), 0, file.get(), fileIndex});
+    sourceRanges.push_back(SourceRange{actLineNumber + 1, fileIndex, 1});
+    includedFiles.push_back(std::move(file));
+}
+
+void AsmA65k::HandleDirective_Macro(std::string_view arguments) // .macro name param1, param2
+{
+    size_t pos = 0;
+    const std::string_view name = ScanValueToken(arguments, pos);
+    if (name.empty() || IsIdentifierStart(name[0]) == false)
+    {
+        AsmError error(actLineNumber, actLine, "Invalid macro definition");
+        throw error;
+    }
+
+    const std::string_view lowerCaseName = lineArena.ToLower(name);
+    if (FindOpcode(lowerCaseName) != nullptr || macroNames.Find(lowerCaseName) != SymbolTable::INVALID_ID)
+    {
+        AsmError error(actLineNumber, actLine, "Macro name already in use: " + string(lowerCaseName));
+        throw error;
+    }
+
+    // the parameters are a comma separated list of names
+    const size_t firstParameter = macroParameters.size();
+    SkipWhiteSpace(arguments, pos);
+    while (pos < arguments.size())
+    {
+        const std::string_view parameter = ScanValueToken(arguments, pos);
+        SkipWhiteSpace(arguments, pos);
+        if (parameter.empty() || IsIdentifierStart(parameter[0]) == false || (pos < arguments.size() && arguments[pos] != ','))
+        {
+            macroParameters.resize(firstParameter);
+            AsmError error(actLineNumber, actLine, "Invalid macro parameter list");
             throw error;
         }
 
-        // read rvalue string
-        string rvalue = expressionOperands[2].str();
+        macroParameters.push_back(string(lineArena.ToLower(parameter)));
+        if (pos < arguments.size())
+        {
+            pos++;
+            SkipWhiteSpace(arguments, pos);
+        }
+    }
 
-        // look up symbol (lvalue) and add the decimal value of the rvalue to it, then add the result as a new symbol
-        labels[label] = (uint32_t)labels[lvalue] + (uint32_t)ConvertStringToInteger(rvalue);
+    // the lines up to .endm are the body, see AddMacroLine()
+    definedMacro = macroNames.Intern(lowerCaseName);
+    macros.push_back(Macro{(uint32_t)macroLines.size(), 0, (uint32_t)firstParameter, (uint32_t)(macroParameters.size() - firstParameter),
+                           sourceStack.back().fileIndex, sourceStack.back().lineNumber - 1, actLineNumber, actLine});
+}
 
-        return;
-    }
+// the symbols are visible to the other objects of a link. without SetRelocatable() the list is only checked
+void AsmA65k::HandleDirective_Export(std::string_view arguments) // .export name1, name2
+{
+    size_t pos = 0;
+    do
+    {
+        const std::string_view name = ScanValueToken(arguments, pos);
+        SkipWhiteSpace(arguments, pos);
+        if (name.empty() || IsIdentifierStart(name[0]) == false || (pos < arguments.size() && arguments[pos] != ','))
+        {
+            AsmError error(actLineNumber, actLine, "Invalid export list");
+            throw error;
+        }
 
-    AsmError error(actLineNumber, line, "Invalid defintion expression");
-    throw error;
+        exportedSymbols.push_back(ExportedSymbol{labels.Intern(lineArena.ToLower(name)), actLineNumber, actLine});
+        if (pos < arguments.size())
+            pos++;
+    } while (pos < arguments.size());
 }
@@ -0,0 +1,463 @@
+//
+//  AsmA65k-Expressions.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+
+using namespace std;
+
+// the binary operators from the loosest to the tightest binding, as in C
+int AsmA65k::GetPrecedence(const ExpressionOperator type)
+{
+    switch (type)
+    {
+    case EXPR_OR:
+        return 1;
+    case EXPR_XOR:
+        return 2;
+    case EXPR_AND:
+        return 3;
+    case EXPR_SHIFT_LEFT:
+    case EXPR_SHIFT_RIGHT:
+        return 4;
+    case EXPR_ADD:
+    case EXPR_SUBTRACT:
+        return 5;
+    case EXPR_MULTIPLY:
+    case EXPR_DIVIDE:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+// returns the length of the binary operator at 'pos', 0 if there's none
+size_t AsmA65k::ScanBinaryOperator(std::string_view text, const size_t pos, ExpressionOperator& type)
+{
+    if (pos >= text.size())
+        return 0;
+
+    const char next = pos + 1 < text.size() ? text[pos + 1] : '\0';
+    switch (text[pos])
+    {
+    case '*':
+        type = EXPR_MULTIPLY;
+        return 1;
+    case '/':
+        type = EXPR_DIVIDE;
+        return 1;
+    case '+':
+        type = EXPR_ADD;
+        return 1;
+    case '-':
+        type = EXPR_SUBTRACT;
+        return 1;
+    case '&':
+        type = EXPR_AND;
+        return 1;
+    case '^':
+        type = EXPR_XOR;
+        return 1;
+    case '|':
+        type = EXPR_OR;
+        return 1;
+    case '<':
+        type = EXPR_SHIFT_LEFT;
+        return next == '<' ? 2 : 0;
+    case '>':
+        type = EXPR_SHIFT_RIGHT;
+        return next == '>' ? 2 : 0;
+    default:
+        return 0;
+    }
+}
+
+// the expression is compiled once per pass into reverse polish notation. the operators of constants are folded
+// while it's compiled, so "4 * 2" is a single constant and "table + 4 * 2" is [table, 8, +]. the sizing pass
+// interns the names, the encoding pass finds them in the symbol table of the master context. the sizing pass
+// only needs the shape of most expressions, their numbers are converted if isEvaluated is set
+uint32_t AsmA65k::ParseExpression(std::string_view text, size_t& pos, const bool isEvaluated)
+{
+    const uint32_t firstToken = (uint32_t)expressionTokens.size();
+
+    // a single name or number, most of the operands and data, doesn't need the parser
+    SkipWhiteSpace(text, pos);
+    const size_t start = pos;
+    const char c = pos < text.size() ? text[pos] : '\0';
+    const bool isName = IsIdentifierStart(c);
+    if (isName || c == '$' || c == '%' || (c >= '0' && c <= '9') || (c == '-' && pos + 1 < text.size() && text[pos + 1] >= '0' && text[pos + 1] <= '9'))
+    {
+        size_t end = start + 1;
+        while (end < text.size() && IsIdentifierChar(text[end]))
+            end++;
+        size_t next = end;
+        SkipWhiteSpace(text, next);
+
+        const std::string_view term = text.substr(start, end - start);
+        RegisterType registerType;
+        const bool isEnd = next == text.size() || text[next] == ',' || text[next] == ']' || (text[next] == '+' && IsRegisterIndex(text, next));
+        if (isEnd && (isName == false || DetectRegisterType(term, registerType) == false))
+        {
+            if (isName)
+                expressionTokens.push_back(ExpressionToken{EXPR_SYMBOL, GetSymbolId(term)});
+            else
+                expressionTokens.push_back(ExpressionToken{EXPR_CONSTANT, isEvaluated ? ConvertStringToInteger(term) : 0});
+            pos = end;
+            return firstToken;
+        }
+    }
+
+    const std::string_view savedToken = actToken; // the errors point to the part of the expression they are found in
+    isExpressionEvaluated = isEvaluated;
+    expressionStackSize = 0;
+    expressionNesting = 0;
+    ParseBinaryExpression(text, pos, 1);
+    actToken = savedToken;
+    return firstToken;
+}
+
+// "[label + r0]": the register is the index of the operand, not a part of the expression
+bool AsmA65k::IsRegisterIndex(std::string_view text, size_t pos)
+{
+    pos++; // skip '+'
+    SkipWhiteSpace(text, pos);
+    const size_t start = pos;
+    while (pos < text.size() && IsIdentifierChar(text[pos]))
+        pos++;
+
+    RegisterType registerType;
+    return pos > start && IsIdentifierStart(text[start]) && DetectRegisterType(text.substr(start, pos - start), registerType);
+}
+
+void AsmA65k::ParseBinaryExpression(std::string_view text, size_t& pos, const int minPrecedence)
+{
+    ParseUnaryExpression(text, pos);
+
+    while (true)
+    {
+        SkipWhiteSpace(text, pos);
+        ExpressionOperator type = EXPR_CONSTANT;
+        const size_t length = ScanBinaryOperator(text, pos, type);
+        if (length == 0 || GetPrecedence(type) < minPrecedence)
+            return;
+
+        if (type == EXPR_ADD && IsRegisterIndex(text, pos))
+            return;
+
+        pos += length;
+        ParseBinaryExpression(text, pos, GetPrecedence(type) + 1); // left associative
+        EmitExpressionToken(type);
+    }
+}
+
+void AsmA65k::ParseUnaryExpression(std::string_view text, size_t& pos)
+{
+    SkipWhiteSpace(text, pos);
+    const size_t start = pos;
+    actToken = text.substr(start);
+
+    if (pos == text.size())
+    {
+        AsmError error(actLineNumber, actLine, "Invalid expression");
+        throw error;
+    }
+
+    const char c = text[pos];
+    if ((c == '(' || c == '-' || c == '~' || c == '<' || c == '>') && ++expressionNesting > MAX_EXPRESSION_STACK)
+    {
+        AsmError error(actLineNumber, actLine, "Expression too complex");
+        throw error;
+    }
+
+    const bool isNegativeNumber = c == '-' && pos + 1 < text.size() && text[pos + 1] >= '0' && text[pos + 1] <= '9';
+    if (c == '$' || c == '%' || (c >= '0' && c <= '9') || isNegativeNumber) // "-5" is a literal, "-$5" and "-label" are negated
+    {
+        pos++;
+        while (pos < text.size() && IsIdentifierChar(text[pos]))
+            pos++;
+
+        EmitExpressionToken(EXPR_CONSTANT, isExpressionEvaluated ? ConvertStringToInteger(text.substr(start, pos - start)) : 0);
+    }
+    else if (IsIdentifierStart(c))
+    {
+        while (pos < text.size() && IsIdentifierChar(text[pos]))
+            pos++;
+
+        const std::string_view name = text.substr(start, pos - start);
+        RegisterType registerType;
+        if (DetectRegisterType(name, registerType))
+        {
+            AsmError error(actLineNumber, actLine, "Invalid expression");
+            throw error;
+        }
+
+        EmitExpressionToken(EXPR_SYMBOL, GetSymbolId(name));
+    }
+    else if (c == '*')
+    {
+        pos++;
+        lineUsesAddress = true;
+        usesAddress = true;
+        EmitExpressionToken(EXPR_ADDRESS, lineAddress);
+    }
+    else if (c == '(')
+    {
+        pos++;
+        ParseBinaryExpression(text, pos, 1);
+        SkipWhiteSpace(text, pos);
+        if (pos == text.size() || text[pos] != ')')
+        {
+            actToken = text.substr(pos);
+            AsmError error(actLineNumber, actLine, "Missing ')' in expression");
+            throw error;
+        }
+        pos++;
+    }
+    else if (c == '-' || c == '~' || c == '<' || c == '>')
+    {
+        pos++;
+        ParseUnaryExpression(text, pos);
+        EmitExpressionToken(c == '-' ? EXPR_NEGATE : c == '~' ? EXPR_NOT : c == '<' ? EXPR_LOW_BYTE : EXPR_HIGH_BYTE);
+    }
+    else
+    {
+        AsmError error(actLineNumber, actLine, "Invalid expression");
+        throw error;
+    }
+}
+
+// every referenced name gets its ID in the sizing pass, the encoding pass only reads the symbol table
+uint32_t AsmA65k::GetSymbolId(std::string_view name)
+{
+    const std::string_view label = lineArena.ToLower(name);
+    const uint32_t symbolId = isSizingPass ? InternReference(label) : GetMaster().labels.Find(label);
+    if (symbolId == SymbolTable::INVALID_ID)
+        ThrowException_InternalError();
+
+    return symbolId;
+}
+
+void AsmA65k::EmitExpressionToken(const ExpressionOperator type, const uint32_t value)
+{
+    if (type <= EXPR_SYMBOL)
+    {
+        if (++expressionStackSize > MAX_EXPRESSION_STACK)
+        {
+            AsmError error(actLineNumber, actLine, "Expression too complex");
+            throw error;
+        }
+        expressionTokens.push_back(ExpressionToken{type, value});
+        return;
+    }
+
+    const size_t size = expressionTokens.size();
+    if (type <= EXPR_HIGH_BYTE)
+    {
+        if (expressionTokens[size - 1].type == EXPR_CONSTANT)
+            expressionTokens[size - 1].value = isExpressionEvaluated ? ApplyExpressionOperator(type, expressionTokens[size - 1].value, 0) : 0;
+        else
+            expressionTokens.push_back(ExpressionToken{type, 0});
+        return;
+    }
+
+    expressionStackSize--;
+    if (expressionTokens[size - 2].type == EXPR_CONSTANT && expressionTokens[size - 1].type == EXPR_CONSTANT)
+    {
+        if (isExpressionEvaluated)
+            expressionTokens[size - 2].value = ApplyExpressionOperator(type, expressionTokens[size - 2].value, expressionTokens[size - 1].value);
+        expressionTokens.pop_back();
+    }
+    else
+        expressionTokens.push_back(ExpressionToken{type, 0});
+}
+
+// the unary operators only use 'left'. the arithmetic wraps around at 32 bits
+uint32_t AsmA65k::ApplyExpressionOperator(const ExpressionOperator type, const uint32_t left, const uint32_t right) const
+{
+    switch (type)
+    {
+    case EXPR_NEGATE:
+        return 0 - left;
+    case EXPR_NOT:
+        return ~left;
+    case EXPR_LOW_BYTE:
+        return left & 0xff;
+    case EXPR_HIGH_BYTE:
+        return (left >> 8) & 0xff;
+    case EXPR_MULTIPLY:
+        return left * right;
+    case EXPR_DIVIDE:
+        if (right == 0)
+        {
+            AsmError error(actLineNumber, actLine, "Division by zero");
+            throw error;
+        }
+        return left / right;
+    case EXPR_ADD:
+        return left + right;
+    case EXPR_SUBTRACT:
+        return left - right;
+    case EXPR_SHIFT_LEFT:
+        return right < 32 ? left << right : 0;
+    case EXPR_SHIFT_RIGHT:
+        return right < 32 ? left >> right : 0;
+    case EXPR_AND:
+        return left & right;
+    case EXPR_XOR:
+        return left ^ right;
+    case EXPR_OR:
+        return left | right;
+    default:
+        return left;
+    }
+}
+
+// the sizing pass sees the current values of the symbols, the encoding pass the ones of the statement being encoded
+bool AsmA65k::EvaluateExpression(const ExpressionToken *tokens, const uint32_t tokenCount, uint32_t& value, uint32_t& undefinedSymbol) const
+{
+    const AsmA65k &owner = GetMaster();
+    uint32_t stack[MAX_EXPRESSION_STACK];
+    uint32_t stackSize = 0;
+
+    for (uint32_t i = 0; i < tokenCount; i++)
+    {
+        const ExpressionToken &token = tokens[i];
+        switch (token.type)
+        {
+        case EXPR_CONSTANT:
+        case EXPR_ADDRESS:
+            stack[stackSize++] = token.value;
+            break;
+        case EXPR_SYMBOL:
+            if (owner.labels.IsDefined(token.value) == false)
+            {
+                undefinedSymbol = token.value;
+                return false;
+            }
+            stack[stackSize++] = isSizingPass ? owner.labels.GetValue(token.value) : GetSymbolValue(token.value);
+            break;
+        case EXPR_NEGATE:
+        case EXPR_NOT:
+        case EXPR_LOW_BYTE:
+        case EXPR_HIGH_BYTE:
+            stack[stackSize - 1] = ApplyExpressionOperator(token.type, stack[stackSize - 1], 0);
+            break;
+        default:
+            stackSize--;
+            stack[stackSize - 1] = ApplyExpressionOperator(token.type, stack[stackSize - 1], stack[stackSize]);
+            break;
+        }
+    }
+
+    value = stack[0];
+    return true;
+}
+
+// .def and .pc are evaluated by the sizing pass, so they can't refer to the symbols defined after them
+uint32_t AsmA65k::EvaluateDefinedExpression(const uint32_t firstToken)
+{
+    uint32_t value = 0;
+    uint32_t undefinedSymbol = SymbolTable::INVALID_ID;
+    if (EvaluateExpression(expressionTokens.data() + firstToken, (uint32_t)expressionTokens.size() - firstToken, value, undefinedSymbol) == false)
+    {
+        AsmError error(actLineNumber, actLine);
+        error.errorMessage = "Symbol not defined: ";
+        error.errorMessage += labels.GetName(undefinedSymbol);
+
+        throw error;
+    }
+
+    // the linker can't change a value the sizing pass has used already
+    if (relocatable && NeedsRelocation(expressionTokens.data() + firstToken, (uint32_t)expressionTokens.size() - firstToken, (uint32_t)segments.size() - 1, false))
+    {
+        AsmError error(actLineNumber, actLine, "Relocatable symbols can't be used in .def and .pc");
+        throw error;
+    }
+
+    return value;
+}
+
+// called by the encoding pass only. the sizing pass has interned every name and defined all the symbols it could,
+// the expressions using the rest are copied to the fixups and evaluated at the end of the assembly. an object keeps the
+// fixups for the linker, with the ones whose value depends on where the relocatable section goes, see NeedsRelocation()
+uint32_t AsmA65k::ResolveExpression(const ExpressionToken *tokens, const uint32_t tokenCount, const uint32_t address, const OpcodeSize size, bool isRelative)
+{
+    const AsmA65k &owner = GetMaster();
+    const bool isRelocated = owner.relocatable && NeedsRelocation(tokens, tokenCount, actSegmentIndex, isRelative);
+    if (isRelocated == false)
+    {
+        if (tokenCount == 1 && tokens[0].type == EXPR_CONSTANT) // most data and operands are a single number or label
+            return tokens[0].value;
+        if (tokenCount == 1 && tokens[0].type == EXPR_SYMBOL && owner.labels.IsDefined(tokens[0].value))
+            return GetSymbolValue(tokens[0].value);
+
+        uint32_t value = 0;
+        uint32_t undefinedSymbol = SymbolTable::INVALID_ID;
+        if (EvaluateExpression(tokens, tokenCount, value, undefinedSymbol))
+            return value;
+    }
+
+    Fixup fixup;
+    fixup.firstToken = (uint32_t)fixupTokens.size();
+    fixup.tokenCount = tokenCount;
+    fixup.statementIndex = actStatementIndex;
+    fixup.segmentIndex = actSegmentIndex;
+    fixup.offset = address - owner.segments[actSegmentIndex].address;
+    fixup.opcodeSize = size;
+    fixup.isRelative = isRelative;
+    fixup.lineNumber = actLineNumber;
+    fixup.lineContent = actLine;
+    fixups.push_back(fixup);
+
+    // the values known already are the ones this statement sees, only the relocatable symbols and the imports are left for later
+    for (uint32_t i = 0; i < tokenCount; i++)
+    {
+        ExpressionToken token = tokens[i];
+        if (token.type == EXPR_SYMBOL && owner.labels.IsDefined(token.value) && owner.symbolDefinitions[token.value].isRelocatable == false)
+            token = ExpressionToken{EXPR_CONSTANT, GetSymbolValue(token.value)};
+        else if (token.type == EXPR_ADDRESS && IsRelocatableSegment(actSegmentIndex) == false)
+            token.type = EXPR_CONSTANT;
+        fixupTokens.push_back(token);
+    }
+
+    // the placeholder of a branch points right after the instruction, so its zero distance passes the range check
+    return isRelative ? address + 2 : 0;
+}
+
+uint32_t AsmA65k::ResolveValue(const OperandValue& value, const uint32_t address, const OpcodeSize size, bool isRelative)
+{
+    return ResolveExpression(expressionTokens.data() + value.firstToken, value.tokenCount, address, size, isRelative);
+}
+
+// the distance of a branch only changes if it's in a different section than its target
+bool AsmA65k::NeedsRelocation(const ExpressionToken *tokens, const uint32_t tokenCount, const uint32_t segmentIndex, bool isRelative) const
+{
+    const AsmA65k &owner = GetMaster();
+    bool isRelocatable = false;
+    for (uint32_t i = 0; i < tokenCount; i++)
+    {
+        if (tokens[i].type == EXPR_SYMBOL)
+        {
+            if (owner.labels.IsDefined(tokens[i].value) == false)
+                return true;
+            isRelocatable |= owner.symbolDefinitions[tokens[i].value].isRelocatable;
+        }
+        else if (tokens[i].type == EXPR_ADDRESS)
+            isRelocatable |= IsRelocatableSegment(segmentIndex);
+    }
+
+    return isRelative ? isRelocatable != IsRelocatableSegment(segmentIndex) : isRelocatable;
+}
+
+uint32_t AsmA65k::GetLabelId(const OperandValue& value) const
+{
+    if (value.isLabel == false || value.tokenCount != 1 || expressionTokens[value.firstToken].type != EXPR_SYMBOL)
+        return SymbolTable::INVALID_ID;
+
+    return expressionTokens[value.firstToken].value;
+}
@@ -0,0 +1,171 @@
+//
+//  AsmA65k-Include.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+// the files are cached by their canonical path for the lifetime of the process, so a header included by every
+// module of a batch is read and tokenized once. an entry is replaced when the file's modification time or size
+// changes, the assemblies still using the previous version keep it alive through their shared_ptr. the cached
+// text is a copy, not a mapping, so it stays the version that was tokenized whatever happens to the file
+std::shared_ptr<const AsmA65k::IncludedFile> AsmA65k::LoadIncludedFile(const std::string &path)
+{
+    struct CacheEntry
+    {
+        std::filesystem::file_time_type modificationTime;
+        uintmax_t size;
+        std::shared_ptr<const IncludedFile> file;
+    };
+
+    static std::mutex cacheMutex;
+    static std::unordered_map<std::string, CacheEntry> cache;
+
+    std::error_code errorCode;
+    const std::filesystem::path canonicalPath = std::filesystem::canonical(path, errorCode);
+    if (errorCode)
+        return nullptr;
+    const std::filesystem::file_time_type modificationTime = std::filesystem::last_write_time(canonicalPath, errorCode);
+    const uintmax_t size = std::filesystem::file_size(canonicalPath, errorCode);
+    if (errorCode)
+        return nullptr;
+
+    const std::string key = canonicalPath.string();
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        const auto entry = cache.find(key);
+        if (entry != cache.end() && entry->second.modificationTime == modificationTime && entry->second.size == size)
+            return entry->second.file;
+    }
+
+    // the file is parsed without holding the lock. if two threads load it at the same time, both versions are valid
+    std::shared_ptr<IncludedFile> file = std::make_shared<IncludedFile>();
+    if (file->file.Read(key.c_str()) == false)
+        return nullptr;
+
+    const std::string_view text = file->file.GetText();
+    const std::string_view savedLine = actLine;
+    size_t lineStart = 0;
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string_view::npos)
+            lineEnd = text.size();
+
+        IncludedLine &line = file->lines.emplace_back();
+        line.text = text.substr(lineStart, lineEnd - lineStart);
+        if (line.text.empty() == false && line.text.back() == '\r')
+            line.text.remove_suffix(1);
+
+        actLine = line.text;
+        try
+        {
+            TokenizeLine(line.text, line.tokens);
+            line.isTokenized = true;
+        }
+        catch (AsmError &)
+        {
+        }
+
+        lineStart = lineEnd + 1;
+    }
+    actLine = savedLine;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache[key] = CacheEntry{modificationTime, size, file};
+    return file;
+}
+
+// a symbol file is used if it was written from the current content of the source, "regs.sym" for "regs.s". the
+// valid ones are cached like the included files, by the path of the source, and kept while neither file changes
+std::shared_ptr<const SymbolFile> AsmA65k::LoadSymbolFile(const std::string &path)
+{
+    struct FileState
+    {
+        std::filesystem::file_time_type modificationTime;
+        uintmax_t size;
+
+        bool operator==(const FileState &) const = default;
+    };
+
+    struct CacheEntry
+    {
+        FileState source;
+        FileState symbols;
+        std::shared_ptr<const SymbolFile> file;
+    };
+
+    static std::mutex cacheMutex;
+    static std::unordered_map<std::string, CacheEntry> cache;
+
+    const auto getState = [](const std::filesystem::path &filePath, FileState &state)
+    {
+        std::error_code errorCode;
+        state.modificationTime = std::filesystem::last_write_time(filePath, errorCode);
+        state.size = std::filesystem::file_size(filePath, errorCode);
+        return !errorCode;
+    };
+
+    const std::filesystem::path symbolPath = std::filesystem::path(path).replace_extension(".sym");
+    FileState sourceState, symbolState;
+    if (getState(symbolPath, symbolState) == false || getState(path, sourceState) == false)
+        return nullptr;
+
+    std::error_code errorCode;
+    const std::string key = std::filesystem::canonical(path, errorCode).string();
+    if (errorCode)
+        return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        const auto entry = cache.find(key);
+        if (entry != cache.end() && entry->second.source == sourceState && entry->second.symbols == symbolState)
+            return entry->second.file;
+    }
+
+    std::shared_ptr<SymbolFile> file = std::make_shared<SymbolFile>();
+    MappedFile source;
+    if (file->Open(symbolPath.string().c_str()) == false || source.Open(path.c_str()) == false ||
+        SymbolFile::HashSource(source.GetText()) != file->GetSourceHash())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache[key] = CacheEntry{sourceState, symbolState, file};
+    return file;
+}
+
+// actLineNumber counts the lines through all included files. the ranges give the file of every line,
+// and the include stack is rebuilt from the parents of the file
+void AsmA65k::LocateError(AsmError &error) const
+{
+    const auto range = std::upper_bound(sourceRanges.begin(), sourceRanges.end(), error.lineNumber, [](const uint32_t lineNumber, const SourceRange &range)
+                                        { return lineNumber < range.firstLine; });
+    if (range == sourceRanges.begin())
+        return;
+
+    const SourceRange &sourceRange = *(range - 1);
+    error.lineNumber = sourceRange.lineNumber + (error.lineNumber - sourceRange.firstLine);
+    if (sourceRange.fileIndex == 0)
+        return;
+
+    // the lines of a macro expansion are in the file the macro was defined in
+    const uint32_t definitionFile = sourceFiles[sourceRange.fileIndex].definitionFile;
+    if (definitionFile != 0)
+        error.fileName = sourceFiles[definitionFile].name;
+    for (uint32_t fileIndex = sourceRange.fileIndex; fileIndex != 0; fileIndex = sourceFiles[fileIndex].parent)
+    {
+        const SourceFile &file = sourceFiles[fileIndex];
+        const SourceFile &parent = sourceFiles[file.parent];
+        error.includeStack.push_back(AsmSourceLocation{sourceFiles[parent.definitionFile].name, file.includeLineNumber, file.isMacro});
+    }
+}
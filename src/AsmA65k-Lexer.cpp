@@ -0,0 +1,135 @@
+//
+//  AsmA65k-Lexer.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+
+using namespace std;
+
+// splits a source line into its label, keyword, size modifier, operand and comment in a single pass
+void AsmA65k::TokenizeLine(std::string_view line, SourceLine& sourceLine)
+{
+    const size_t length = line.size();
+    size_t pos = 0;
+
+    sourceLine = SourceLine();
+    SkipWhiteSpace(line, pos);
+
+    // label definition, eg.: "loop:"
+    if (pos < length && IsIdentifierStart(line[pos]))
+    {
+        size_t end = pos;
+        while (end < length && IsIdentifierChar(line[end]))
+            end++;
+
+        if (end < length && line[end] == ':')
+        {
+            sourceLine.label = line.substr(pos, end - pos);
+            pos = end + 1;
+            SkipWhiteSpace(line, pos);
+        }
+    }
+
+    // directive or mnemonic
+    if (pos < length && line[pos] != ';')
+    {
+        if (line[pos] == '.')
+        {
+            sourceLine.isDirective = true;
+            pos++;
+        }
+
+        const size_t keywordStart = pos;
+        while (pos < length && IsIdentifierChar(line[pos]))
+            pos++;
+
+        if (pos == keywordStart || IsIdentifierStart(line[keywordStart]) == false)
+            ThrowException_SyntaxError(actLine);
+
+        sourceLine.keyword = line.substr(keywordStart, pos - keywordStart);
+
+        // size modifier, eg.: "mov.b"
+        if (sourceLine.isDirective == false && pos < length && line[pos] == '.')
+        {
+            const size_t modifierStart = ++pos;
+            while (pos < length && IsIdentifierChar(line[pos]))
+                pos++;
+
+            sourceLine.modifier = line.substr(modifierStart, pos - modifierStart);
+        }
+
+        SkipWhiteSpace(line, pos);
+
+        // the operand lasts until the first ';' that is not inside a string literal
+        const size_t operandStart = pos;
+        bool isInString = false;
+        while (pos < length && (isInString || line[pos] != ';'))
+        {
+            if (line[pos] == '"')
+                isInString = !isInString;
+            pos++;
+        }
+
+        size_t operandEnd = pos;
+        while (operandEnd > operandStart && IsWhiteSpace(line[operandEnd - 1]))
+            operandEnd--;
+
+        sourceLine.operand = line.substr(operandStart, operandEnd - operandStart);
+    }
+
+    if (pos < length)
+        sourceLine.comment = line.substr(pos);
+}
+
+AsmA65k::Directives AsmA65k::FindDirective(std::string_view name)
+{
+    switch (name.size())
+    {
+    case 2:
+        if (EqualsIgnoreCase(name, "pc"))
+            return DIRECTIVE_SETPC;
+        break;
+
+    case 3:
+        if (EqualsIgnoreCase(name, "def"))
+            return DIRECTIVE_DEFINE;
+        break;
+
+    case 4:
+        if (EqualsIgnoreCase(name, "endm"))
+            return DIRECTIVE_ENDM;
+        if (EqualsIgnoreCase(name, "text"))
+            return DIRECTIVE_TEXT;
+        if (EqualsIgnoreCase(name, "byte"))
+            return DIRECTIVE_BYTE;
+        if (EqualsIgnoreCase(name, "word"))
+            return DIRECTIVE_WORD;
+        break;
+
+    case 5:
+        if (EqualsIgnoreCase(name, "textz"))
+            return DIRECTIVE_TEXTZ;
+        if (EqualsIgnoreCase(name, "dword"))
+            return DIRECTIVE_DWORD;
+        if (EqualsIgnoreCase(name, "macro"))
+            return DIRECTIVE_MACRO;
+        break;
+
+    case 6:
+        if (EqualsIgnoreCase(name, "export"))
+            return DIRECTIVE_EXPORT;
+        break;
+
+    case 7:
+        if (EqualsIgnoreCase(name, "include"))
+            return DIRECTIVE_INCLUDE;
+        break;
+    }
+
+    return DIRECTIVE_NONE;
+}
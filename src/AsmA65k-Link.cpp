@@ -0,0 +1,258 @@
+//
+//  AsmA65k-Link.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+
+using namespace std;
+
+// an object has a single relocatable section, the segment of the lines before the first .pc
+bool AsmA65k::IsRelocatableSegment(const uint32_t segmentIndex) const
+{
+    return GetMaster().relocatable && segmentIndex == 0;
+}
+
+// without SetRelocatable() every address is final. an import is in no section of the object
+bool AsmA65k::IsInSameSection(const uint32_t segmentIndex, const uint32_t symbolId) const
+{
+    const AsmA65k &owner = GetMaster();
+    if (owner.relocatable == false)
+        return true;
+    if (owner.labels.IsDefined(symbolId) == false)
+        return false;
+
+    return owner.symbolDefinitions[symbolId].isRelocatable == IsRelocatableSegment(segmentIndex);
+}
+
+// the symbols keep their IDs, so the expressions of the fixups are written as they are. the fixups have the
+// values of the other symbols substituted already, see ResolveExpression()
+bool AsmA65k::WriteObjectFile(const char *filename) const
+{
+    if (relocatable == false)
+        return false;
+
+    ObjectFile::Contents contents;
+    contents.sourceName = sourceFiles.empty() ? std::string_view() : std::string_view(sourceFiles[0].name);
+
+    for (uint32_t i = 0; i < segments.size(); i++)
+    {
+        const Segment &segment = segments[i];
+        contents.sections.push_back(ObjectFile::Section{segment.address, (uint32_t)contents.data.size(), (uint32_t)segment.data.size(), IsRelocatableSegment(i)});
+        contents.data.append((const char *)segment.data.data(), segment.data.size());
+    }
+
+    std::vector<bool> isExported(labels.GetSize(), false);
+    for (const ExportedSymbol &symbol : exportedSymbols)
+        isExported[symbol.symbolId] = true;
+
+    for (uint32_t id = 0; id < labels.GetSize(); id++)
+    {
+        const std::string_view name = labels.GetName(id);
+        uint32_t section = ObjectFile::UNDEFINED;
+        if (labels.IsDefined(id))
+            section = symbolDefinitions[id].isRelocatable ? 0 : ObjectFile::ABSOLUTE;
+
+        contents.symbols.push_back(ObjectFile::Symbol{SymbolTable::Hash(name), (uint32_t)contents.names.size(), (uint32_t)name.size(),
+                                                      labels.GetValue(id), section, isExported[id]});
+        contents.names.append(name);
+    }
+
+    // the line of a fixup is stored once for all the fixups of a statement
+    std::string_view previousLine;
+    std::string previousFile;
+    uint32_t lineOffset = 0;
+    uint32_t fileOffset = 0;
+    for (const Fixup &fixup : fixups)
+    {
+        AsmError location(fixup.lineNumber, fixup.lineContent);
+        LocateError(location);
+
+        if (fixup.lineContent.data() != previousLine.data() || fixup.lineContent.size() != previousLine.size())
+        {
+            lineOffset = (uint32_t)contents.names.size();
+            contents.names.append(fixup.lineContent);
+            previousLine = fixup.lineContent;
+        }
+        if (location.fileName != previousFile)
+        {
+            fileOffset = (uint32_t)contents.names.size();
+            contents.names.append(location.fileName);
+            previousFile = location.fileName;
+        }
+
+        contents.relocations.push_back(ObjectFile::Relocation{fixup.segmentIndex, fixup.offset, (uint32_t)contents.tokens.size(), fixup.tokenCount,
+                                                              (uint32_t)fixup.opcodeSize, fixup.isRelative, location.lineNumber, lineOffset,
+                                                              (uint32_t)fixup.lineContent.size(), fileOffset, (uint32_t)previousFile.size()});
+        for (uint32_t i = 0; i < fixup.tokenCount; i++)
+        {
+            const ExpressionToken &token = fixupTokens[fixup.firstToken + i];
+            contents.tokens.push_back(ObjectFile::Token{token.type, token.value});
+        }
+    }
+
+    return ObjectFile::Write(filename, contents);
+}
+
+// the relocatable sections of the objects are placed one after the other from baseAddress in the first segment, the
+// others keep their addresses. the exported symbols of all objects are interned into 'labels' first, then the
+// relocations of each object become fixups whose symbols are the imports, written by PatchFixup() as in an assembly
+std::vector<Segment> *AsmA65k::Link(const std::vector<std::string> &objectFiles, const uint32_t baseAddress)
+{
+    Reset();
+
+    std::vector<std::unique_ptr<ObjectFile>> objects;
+    for (const std::string &fileName : objectFiles)
+    {
+        objects.push_back(std::make_unique<ObjectFile>());
+        if (objects.back()->Open(fileName.c_str()) == false)
+        {
+            AsmError error(0, "", "Could not load object file");
+            error.fileName = fileName;
+            throw error;
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> sectionSegments(objects.size());
+    std::vector<std::vector<uint32_t>> sectionOffsets(objects.size());
+    AddSegment(baseAddress);
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const ObjectFile &object = *objects[i];
+        for (uint32_t sectionIndex = 0; sectionIndex < object.GetSectionCount(); sectionIndex++)
+        {
+            const ObjectFile::Section &section = object.GetSection(sectionIndex);
+            if (section.isRelocatable == false)
+                AddSegment(section.address);
+
+            Segment &segment = section.isRelocatable ? segments.front() : segments.back();
+            sectionSegments[i].push_back(section.isRelocatable ? 0 : (uint32_t)segments.size() - 1);
+            sectionOffsets[i].push_back((uint32_t)segment.data.size());
+            segment.AddBytes(std::span<const uint8_t>(object.GetSectionData(section), section.size));
+        }
+    }
+
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const ObjectFile &object = *objects[i];
+        for (uint32_t symbolIndex = 0; symbolIndex < object.GetSymbolCount(); symbolIndex++)
+        {
+            const ObjectFile::Symbol &symbol = object.GetSymbol(symbolIndex);
+            if (symbol.isExported == false)
+                continue;
+
+            const std::string_view name = object.GetName(symbol.nameOffset, symbol.nameLength);
+            const uint32_t symbolId = labels.Intern(name, symbol.hash);
+            if (labels.IsDefined(symbolId))
+            {
+                AsmError error(0, "", "Symbol exported by more than one object: " + string(name));
+                error.fileName = objectFiles[i];
+                throw error;
+            }
+            labels.Define(symbolId, symbol.section == ObjectFile::ABSOLUTE ? symbol.value : GetSectionAddress(symbol.section, sectionSegments[i], sectionOffsets[i]) + symbol.value);
+        }
+    }
+
+    {
+        PhaseTimer timer(collectStats ? &stats.fixupSeconds : nullptr);
+        for (size_t i = 0; i < objects.size(); i++)
+            LinkObject(*objects[i], objectFiles[i], sectionSegments[i], sectionOffsets[i]);
+    }
+
+    if (segments.front().data.empty())
+        segments.erase(segments.begin());
+
+    stats.symbols = labels.GetSize();
+    for (const Segment &segment : segments)
+        stats.outputBytes += segment.data.size();
+
+    return &segments;
+}
+
+uint32_t AsmA65k::GetSectionAddress(const uint32_t section, const std::vector<uint32_t> &sectionSegments, const std::vector<uint32_t> &sectionOffsets) const
+{
+    return segments[sectionSegments[section]].address + sectionOffsets[section];
+}
+
+// the expressions are checked before they are evaluated, the evaluation doesn't check the stack
+void AsmA65k::LinkObject(const ObjectFile &object, const std::string &fileName, const std::vector<uint32_t> &sectionSegments, const std::vector<uint32_t> &sectionOffsets)
+{
+    const auto throwInvalidObject = [&fileName]()
+    {
+        AsmError error(0, "", "Invalid object file");
+        error.fileName = fileName;
+        throw error;
+    };
+
+    for (uint32_t relocationIndex = 0; relocationIndex < object.GetRelocationCount(); relocationIndex++)
+    {
+        const ObjectFile::Relocation &relocation = object.GetRelocation(relocationIndex);
+        const uint32_t fieldSize = relocation.isRelative || relocation.opcodeSize == OS_16BIT ? 2 : relocation.opcodeSize == OS_8BIT ? 1 : 4;
+        if (relocation.opcodeSize > OS_8BIT || (uint64_t)relocation.offset + fieldSize > object.GetSection(relocation.section).size)
+            throwInvalidObject();
+
+        // the symbols of the object are replaced by their addresses, the imports by the exports they refer to
+        const ObjectFile::Token *tokens = object.GetTokens(relocation);
+        const uint32_t sectionAddress = GetSectionAddress(relocation.section, sectionSegments, sectionOffsets);
+        uint32_t stackSize = 0;
+        fixupTokens.clear();
+        for (uint32_t i = 0; i < relocation.tokenCount; i++)
+        {
+            ExpressionToken token = {(ExpressionOperator)tokens[i].type, tokens[i].value};
+            if (tokens[i].type == EXPR_ADDRESS)
+                token = ExpressionToken{EXPR_CONSTANT, sectionAddress + tokens[i].value};
+            else if (tokens[i].type == EXPR_SYMBOL)
+            {
+                if (tokens[i].value >= object.GetSymbolCount())
+                    throwInvalidObject();
+
+                const ObjectFile::Symbol &symbol = object.GetSymbol(tokens[i].value);
+                if (symbol.section == ObjectFile::UNDEFINED)
+                    token.value = labels.Intern(object.GetName(symbol.nameOffset, symbol.nameLength), symbol.hash);
+                else if (symbol.section == ObjectFile::ABSOLUTE)
+                    token = ExpressionToken{EXPR_CONSTANT, symbol.value};
+                else
+                    token = ExpressionToken{EXPR_CONSTANT, GetSectionAddress(symbol.section, sectionSegments, sectionOffsets) + symbol.value};
+            }
+
+            if (tokens[i].type <= EXPR_SYMBOL)
+                stackSize++;
+            else if (tokens[i].type >= EXPR_MULTIPLY && tokens[i].type <= EXPR_OR)
+                stackSize--;
+            else if (tokens[i].type > EXPR_OR)
+                throwInvalidObject();
+
+            if (stackSize == 0 || stackSize > MAX_EXPRESSION_STACK)
+                throwInvalidObject();
+            fixupTokens.push_back(token);
+        }
+        if (stackSize != 1)
+            throwInvalidObject();
+
+        Fixup fixup;
+        fixup.firstToken = 0;
+        fixup.tokenCount = relocation.tokenCount;
+        fixup.statementIndex = 0;
+        fixup.segmentIndex = sectionSegments[relocation.section];
+        fixup.offset = sectionOffsets[relocation.section] + relocation.offset;
+        fixup.opcodeSize = (OpcodeSize)relocation.opcodeSize;
+        fixup.isRelative = relocation.isRelative;
+        fixup.lineNumber = relocation.lineNumber;
+        fixup.lineContent = object.GetName(relocation.lineOffset, relocation.lineLength);
+
+        try
+        {
+            PatchFixup(fixup);
+        }
+        catch (AsmError &error)
+        {
+            error.fileName = relocation.fileNameLength != 0 ? string(object.GetName(relocation.fileNameOffset, relocation.fileNameLength)) : string(object.GetSourceName());
+            RecordError(error);
+        }
+        stats.fixups++;
+    }
+}
@@ -0,0 +1,300 @@
+//
+//  AsmA65k-Macros.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+#include <charconv>
+
+using namespace std;
+
+// the body isn't tokenized while it's recorded, so ".endm" is recognized on its own
+bool AsmA65k::IsEndMacroLine(std::string_view line)
+{
+    size_t pos = 0;
+    SkipWhiteSpace(line, pos);
+    if (line.size() - pos < 5 || line[pos] != '.' || EqualsIgnoreCase(line.substr(pos + 1, 4), "endm") == false)
+        return false;
+
+    pos += 5;
+    return pos == line.size() || IsWhiteSpace(line[pos]) || line[pos] == ';';
+}
+
+// a line of the body is split into text pieces and the places of the parameters, so an expansion only
+// copies the pieces and the arguments, see ExpandMacroLine(). a name followed by '@' is a local label,
+// it gets the number of the expansion as a suffix. the comments are dropped.
+// the line is tokenized here, once. if the parameters are all in the operand, the arguments can't move
+// the other fields, and the expansions reuse the tokens instead of tokenizing their lines again
+void AsmA65k::AddMacroLine(std::string_view line)
+{
+    Macro &macro = macros[definedMacro];
+    const uint32_t firstPiece = (uint32_t)macroPieces.size();
+    size_t textStart = 0;
+
+    const auto addText = [this, line, &textStart](const size_t end)
+    {
+        if (end > textStart)
+        {
+            macroPieces.push_back(MacroPiece{MacroPiece::TEXT, (uint32_t)macroText.size(), (uint32_t)(end - textStart)});
+            macroText.append(line.substr(textStart, end - textStart));
+        }
+        textStart = end;
+    };
+
+    size_t pos = 0;
+    while (pos < line.size() && line[pos] != ';')
+    {
+        const char c = line[pos];
+        if (c == '"') // string literals are copied as they are
+        {
+            const size_t end = line.find('"', pos + 1);
+            pos = end == std::string_view::npos ? line.size() : end + 1;
+        }
+        else if (IsIdentifierStart(c))
+        {
+            const size_t start = pos;
+            while (pos < line.size() && IsIdentifierChar(line[pos]))
+                pos++;
+            const std::string_view name = line.substr(start, pos - start);
+
+            uint32_t parameter = 0;
+            while (parameter < macro.parameterCount && EqualsIgnoreCase(name, macroParameters[macro.firstParameter + parameter]) == false)
+                parameter++;
+
+            if (parameter < macro.parameterCount)
+            {
+                addText(start);
+                macroPieces.push_back(MacroPiece{(int32_t)parameter, 0, (uint32_t)(pos - start)});
+                textStart = pos;
+            }
+            else if (pos < line.size() && line[pos] == '@')
+            {
+                addText(pos);
+                macroPieces.push_back(MacroPiece{MacroPiece::LOCAL_SUFFIX, 0, 1});
+                textStart = ++pos;
+            }
+        }
+        else if (c == '$' || c == '%' || (c >= '0' && c <= '9')) // "$ff" is not a name
+        {
+            pos++;
+            while (pos < line.size() && IsIdentifierChar(line[pos]))
+                pos++;
+        }
+        else
+            pos++;
+    }
+    addText(pos);
+
+    MacroLine macroLine{firstPiece, (uint32_t)macroPieces.size() - firstPiece};
+
+    // the '@' of the local labels is tokenized as '_', the offsets stay the same
+    char *body = lineArena.Allocate(pos);
+    memcpy(body, line.data(), pos);
+    for (size_t i = 0; i < pos; i++)
+        if (body[i] == '@')
+            body[i] = '_';
+
+    SourceLine tokens;
+    macroLine.isTokenized = true;
+    try
+    {
+        PhaseTimer timer(GetSizingTimer(stats.lexingSeconds));
+        TokenizeLine(std::string_view(body, pos), tokens);
+    }
+    catch (AsmError &)
+    {
+        // the syntax error is reported by the line of the expansion
+        macroLine.isTokenized = false;
+    }
+
+    const auto toSpan = [body](const std::string_view field)
+    { return field.empty() ? MacroSpan() : MacroSpan{(uint32_t)(field.data() - body), (uint32_t)field.size()}; };
+
+    macroLine.label = toSpan(tokens.label);
+    macroLine.keyword = toSpan(tokens.keyword);
+    macroLine.modifier = toSpan(tokens.modifier);
+    macroLine.operand = toSpan(tokens.operand);
+    macroLine.isDirective = tokens.isDirective;
+
+    uint32_t pieceStart = 0;
+    for (uint32_t i = firstPiece; i < macroPieces.size(); i++)
+    {
+        if (macroPieces[i].parameter >= 0 && (macroLine.operand.length == 0 || pieceStart < macroLine.operand.offset))
+            macroLine.isTokenized = false;
+        pieceStart += macroPieces[i].length;
+    }
+
+    macroLines.push_back(macroLine);
+    macro.lineCount++;
+}
+
+void AsmA65k::EndMacroDefinition(bool isComplete)
+{
+    const Macro &macro = macros[definedMacro];
+    definedMacro = NO_MACRO;
+
+    if (isComplete == false)
+    {
+        AsmError error(macro.definitionLine, macro.line, "Missing .endm");
+        RecordError(error);
+    }
+}
+
+// the arguments are separated by commas outside brackets and string literals: "r0, [r1 + 2]" has two
+bool AsmA65k::ExpandMacro(std::string_view name, std::string_view arguments)
+{
+    const uint32_t macroIndex = macroNames.Find(lineArena.ToLower(name));
+    if (macroIndex == SymbolTable::INVALID_ID)
+        return false;
+
+    if (sourceStack.size() >= MAX_MACRO_DEPTH)
+    {
+        AsmError error(actLineNumber, actLine, "Macros are nested too deeply");
+        throw error;
+    }
+
+    const Macro &macro = macros[macroIndex];
+    const uint32_t firstArgument = (uint32_t)macroArguments.size();
+    if (arguments.empty() == false)
+    {
+        int depth = 0;
+        bool isInString = false;
+        size_t start = 0;
+        for (size_t pos = 0; pos <= arguments.size(); pos++)
+        {
+            const char c = pos < arguments.size() ? arguments[pos] : ',';
+            if (c == '"')
+                isInString = !isInString;
+            else if (isInString == false && (c == '[' || c == '('))
+                depth++;
+            else if (isInString == false && (c == ']' || c == ')'))
+                depth--;
+            else if (isInString == false && depth <= 0 && c == ',')
+            {
+                std::string_view argument = arguments.substr(start, pos - start);
+                while (argument.empty() == false && IsWhiteSpace(argument.front()))
+                    argument.remove_prefix(1);
+                while (argument.empty() == false && IsWhiteSpace(argument.back()))
+                    argument.remove_suffix(1);
+
+                macroArguments.push_back(argument);
+                start = pos + 1;
+            }
+        }
+    }
+
+    if (macroArguments.size() - firstArgument != macro.parameterCount)
+    {
+        macroArguments.resize(firstArgument);
+        AsmError error(actLineNumber, actLine, "Macro '" + string(macroNames.GetName(macroIndex)) + "' expects " +
+                                                   to_string(macro.parameterCount) + " arguments");
+        throw error;
+    }
+
+    // the expansion is numbered like an included file, its lines are the lines of the macro's definition
+    const uint32_t fileIndex = (uint32_t)sourceFiles.size();
+    sourceFiles.push_back(SourceFile{string(), sourceStack.back().fileIndex, sourceStack.back().lineNumber - 1,
+                                     sourceFiles[macro.fileIndex].definitionFile, true});
+
+    SourceCursor cursor;
+    cursor.fileIndex = fileIndex;
+    cursor.lineNumber = macro.lineNumber + 1;
+    cursor.macroIndex = macroIndex;
+    cursor.firstArgument = firstArgument;
+    cursor.expansion = expansionCount++;
+    sourceStack.push_back(cursor);
+    sourceRanges.push_back(SourceRange{actLineNumber + 1, fileIndex, cursor.lineNumber});
+
+    return true;
+}
+
+// the lines are kept in expansionArena until the end of the assembly, the statements point into them.
+// the fields of a tokenized line are moved by the lengths of the arguments before them. an argument can't
+// end the operand early: the invocation's operand ended at its first ';' outside a string, and its
+// arguments are split outside the string literals, see ExpandMacro()
+std::string_view AsmA65k::ExpandMacroLine(const SourceCursor &cursor, uint32_t lineIndex, SourceLine &tokens, bool &isTokenized)
+{
+    const Macro &macro = macros[cursor.macroIndex];
+    const MacroLine &line = macroLines[macro.firstLine + lineIndex];
+
+    char suffix[16] = {'_', '_'};
+    const size_t suffixLength = std::to_chars(suffix + 2, suffix + sizeof(suffix), cursor.expansion).ptr - suffix;
+
+    size_t length = 0;
+    for (uint32_t i = 0; i < line.pieceCount; i++)
+    {
+        const MacroPiece &piece = macroPieces[line.firstPiece + i];
+        if (piece.parameter == MacroPiece::TEXT)
+            length += piece.length;
+        else if (piece.parameter == MacroPiece::LOCAL_SUFFIX)
+            length += suffixLength;
+        else
+            length += macroArguments[cursor.firstArgument + piece.parameter].size();
+    }
+
+    // the starts and the ends of the fields, in the line of the body and then in the expanded line
+    const MacroSpan *fields[4] = {&line.label, &line.keyword, &line.modifier, &line.operand};
+    uint32_t bounds[8];
+    for (int i = 0; i < 4; i++)
+    {
+        bounds[i * 2] = fields[i]->offset;
+        bounds[i * 2 + 1] = fields[i]->offset + fields[i]->length;
+    }
+    uint32_t boundsLeft = line.isTokenized ? 0xff : 0; // a bit per bound that's not moved yet
+
+    char *text = expansionArena.Allocate(length);
+    char *position = text;
+    uint32_t pieceStart = 0;
+    for (uint32_t i = 0; i < line.pieceCount; i++)
+    {
+        const MacroPiece &piece = macroPieces[line.firstPiece + i];
+        std::string_view pieceText;
+        if (piece.parameter == MacroPiece::TEXT)
+            pieceText = std::string_view(macroText).substr(piece.offset, piece.length);
+        else if (piece.parameter == MacroPiece::LOCAL_SUFFIX)
+            pieceText = std::string_view(suffix, suffixLength);
+        else
+            pieceText = macroArguments[cursor.firstArgument + piece.parameter];
+
+        // the bounds inside an argument or a suffix are at its start
+        for (int bound = 0; boundsLeft != 0 && bound < 8; bound++)
+            if ((boundsLeft & (1 << bound)) != 0 && bounds[bound] < pieceStart + piece.length)
+            {
+                bounds[bound] = (uint32_t)(position - text) + (piece.parameter == MacroPiece::TEXT ? bounds[bound] - pieceStart : 0);
+                boundsLeft &= ~(1 << bound);
+            }
+
+        memcpy(position, pieceText.data(), pieceText.size());
+        position += pieceText.size();
+        pieceStart += piece.length;
+    }
+
+    const std::string_view expanded(text, length);
+    isTokenized = line.isTokenized;
+    if (isTokenized)
+    {
+        for (int bound = 0; bound < 8; bound++) // the ones at the end of the line
+            if ((boundsLeft & (1 << bound)) != 0)
+                bounds[bound] = (uint32_t)length;
+
+        tokens = SourceLine();
+        tokens.label = expanded.substr(bounds[0], bounds[1] - bounds[0]);
+        tokens.keyword = expanded.substr(bounds[2], bounds[3] - bounds[2]);
+        tokens.modifier = expanded.substr(bounds[4], bounds[5] - bounds[4]);
+        tokens.isDirective = line.isDirective;
+
+        // an empty argument can leave white space at the ends of the operand
+        std::string_view operand = expanded.substr(bounds[6], bounds[7] - bounds[6]);
+        while (operand.empty() == false && IsWhiteSpace(operand.front()))
+            operand.remove_prefix(1);
+        while (operand.empty() == false && IsWhiteSpace(operand.back()))
+            operand.remove_suffix(1);
+        tokens.operand = operand;
+    }
+
+    return expanded;
+}
@@ -10,93 +10,88 @@
 
 #include <Asm65k.h>
 #include <sstream>
-#include <regex>
 #include <iostream>
+#include <charconv>
+#include <bit>
+#include <cstring>
 
 using namespace std;
 
-int AsmA65k::ConvertStringToInteger(const string& valueStr)
+uint32_t AsmA65k::ConvertStringToInteger(std::string_view valueStr)
 {
-    static const regex rx_checkIfBin(R"(^%([01]+))", regex_constants::icase);
-    static const regex rx_checkIfHex(R"(^\$([0-9a-z]+))", regex_constants::icase);
-    static const regex rx_checkIfDec(R"(^(-?[0-9]+))", regex_constants::icase);
-    static const string table = "0123456789ABCDEF";
-    smatch rxResult;
-    int i;
-    uint64_t result = 0;
-    char actChar;
-    int length;
-    uint64_t baseValue = 1;
-
-    if (regex_search(valueStr, rxResult, rx_checkIfBin))
-    {
-        const string tmpStr = rxResult[1];
-        length = (int)tmpStr.length();
-        for (i = length - 1; i >= 0; i--)
-        {
-            actChar = tmpStr[i];
-            if (actChar == '1')
-                result += baseValue;
-            baseValue *= 2;
-        }
+    const char *first = valueStr.data();
+    const char *last = first + valueStr.size();
+    int base = 10;
 
-        CheckIntegerRange(result);
-        return (int)result;
+    if (first != last && *first == '%')
+    {
+        base = 2;
+        first++;
     }
-
-    if (regex_search(valueStr, rxResult, rx_checkIfHex))
+    else if (first != last && *first == '$')
     {
-        string tmpStr = rxResult[1];
-        length = (int)tmpStr.length();
-        for (i = length - 1; i >= 0; i--)
-        {
-            actChar = tmpStr[i];
-            result += FindChar(table, actChar) * baseValue;
-            baseValue *= 16;
-        }
+        base = 16;
+        first++;
 
-        CheckIntegerRange(result);
-        return (int)result;
+        // full 32 bit constants (addresses, .dword tables) take the SWAR path
+        uint32_t result;
+        if (last - first == 8 && ConvertHex8(first, result))
+            return result;
     }
 
-    if (regex_search(valueStr, rxResult, rx_checkIfDec))
-    {
-        string tmpStr = rxResult[1];
-        length = (int)tmpStr.length();
-        for (i = length - 1; i >= 0; i--)
-        {
-            actChar = tmpStr[i];
-            int charIndex = FindChar(table, actChar);
-            if (charIndex == -1)
-            {
-                result *= -1;
-                continue;
-            }
-            result += FindChar(table, actChar) * baseValue;
-            baseValue *= 10;
-        }
+    // negative numbers are only accepted in decimal
+    if (first == last || (base != 10 && *first == '-'))
+        ThrowException_InvalidNumberFormat();
+
+    int64_t result = 0;
+    const auto [ptr, ec] = std::from_chars(first, last, result, base);
 
-        CheckIntegerRange(result);
-        return (int)result;
+    if (ec == std::errc::invalid_argument || ptr != last)
+        ThrowException_InvalidNumberFormat();
+
+    if (result < INT32_MIN || (ec == std::errc::result_out_of_range && *first == '-'))
+        ThrowException_ValueOutOfRange();
+
+    if (result > (int64_t)UINT32_MAX || ec == std::errc::result_out_of_range)
+    {
+        AsmError error(actLineNumber, actLine, "Value exceeding 32 bit range");
+        throw error;
     }
 
-    ThrowException_InvalidNumberFormat(); // invalid number format
-    return 0;
+    return (uint32_t)result;
 }
 
-int AsmA65k::FindChar(const string& text, char c)
+bool AsmA65k::ConvertHex8(const char *digits, uint32_t& result)
 {
-    const int size = (int)text.size();
-    c = toupper(c);
+    if constexpr (std::endian::native != std::endian::little)
+        return false;
+
+    constexpr uint64_t ones = 0x0101010101010101;
+    constexpr uint64_t highBits = 0x80 * ones;
+
+    uint64_t chars;
+    memcpy(&chars, digits, sizeof(chars)); // the first digit (most significant) lands in the lowest byte
+
+    if (chars & highBits)
+        return false;
+
+    // a byte is in the [low, high] range if adding (0x80 - low) sets its top bit and adding (0x7f - high) doesn't
+    const uint64_t lowerCase = chars | (0x20 * ones);
+    const uint64_t isDigit = (chars + (0x80 - '0') * ones) & ~(chars + (0x7f - '9') * ones) & highBits;
+    const uint64_t isLetter = (lowerCase + (0x80 - 'a') * ones) & ~(lowerCase + (0x7f - 'f') * ones) & highBits;
+
+    if ((isDigit | isLetter) != highBits)
+        return false;
 
-    if (c == '-')
-        return -1;
+    // '0'-'9' and 'a'-'f' both keep their value in the low nibble, letters are just offset by 9
+    uint64_t nibbles = (chars & (0x0f * ones)) + (isLetter >> 7) * 9;
 
-    for (int i = 0; i < size; i++)
-        if (text[i] == c)
-            return i;
+    // merge neighbouring digits: nibbles -> bytes -> 16 bit halves -> 32 bit result
+    nibbles = ((nibbles & 0x000f000f000f000f) << 4) | ((nibbles & 0x0f000f000f000f00) >> 8);
+    nibbles = ((nibbles & 0x000000ff000000ff) << 8) | ((nibbles & 0x00ff000000ff0000) >> 16);
+    result = (uint32_t)(((nibbles & 0xffff) << 16) | ((nibbles >> 32) & 0xffff));
 
-    return 0;
+    return true;
 }
 
 void AsmA65k::ThrowException_ValueOutOfRange()
@@ -117,7 +112,7 @@ void AsmA65k::ThrowException_InvalidNumberFormat()
     throw error;
 }
 
-void AsmA65k::ThrowException_SyntaxError(const string& line)
+void AsmA65k::ThrowException_SyntaxError(std::string_view line)
 {
     AsmError error(actLineNumber, line, "Syntax error");
     throw error;
@@ -135,36 +130,6 @@ void AsmA65k::ThrowException_SymbolOutOfRange()
     throw error;
 }
 
-void AsmA65k::CheckIntegerRange(const int64_t result)
-{
-    if (result < 0)
-    {
-        if (result < -2147483648)
-            ThrowException_ValueOutOfRange();
-        if (result > 2147483647)
-            ThrowException_ValueOutOfRange();
-
-        return;
-    }
-
-    const uint64_t maxInt = 0xffffffff;
-
-    if ((uint64_t)result > maxInt)
-    {
-        AsmError error(actLineNumber, actLine, "Value exceeding 32 bit range");
-        throw error;
-    }
-}
-
-bool AsmA65k::IsCommentLine(const string& line)
-{
-    const static regex rx_isLineComment(R"((^\s*$)|(\s*;.*))"); // empty or comment line
-    if (regex_match(line, rx_isLineComment))
-        return true;
-
-    return false;
-}
-
 void AsmA65k::ThrowException_InvalidMnemonic()
 {
     AsmError error(actLineNumber, actLine, "Invalid opcode");
@@ -177,107 +142,63 @@ void AsmA65k::ThrowException_InvalidOperands()
     throw error;
 }
 
-string AsmA65k::RemoveSquaredBrackets(const string& operand)
+bool AsmA65k::DetectRegisterType(std::string_view registerStr, RegisterType& registerType)
 {
-    const static regex rx_removeSquareBrackets(R"(\[\s*(.*)\s*\][\+\-]?)");
-    smatch result;
-    if (regex_match(operand, result, rx_removeSquareBrackets) == false)
+    if (EqualsIgnoreCase(registerStr, "pc"))
     {
-        ThrowException_InternalError();
+        registerType = REG_PC;
+        return true;
     }
-
-    return result[1].str();
-}
-
-AsmA65k::StringPair AsmA65k::SplitStringByPlusSign(const string& operand)
-{
-    // extract the two parts
-    static const regex rx_matchOperands(R"((\S+)\s*\+\s*(\S+))");
-    smatch operandsMatch;
-    if (regex_match(operand, operandsMatch, rx_matchOperands) == false)
-        ThrowException_InvalidOperands();
-
-    StringPair sp;
-    // put them into their respective strings
-    sp.left = operandsMatch[1].str();  // "r0"
-    sp.right = operandsMatch[2].str(); // "1234"
-
-    return sp;
-}
-
-AsmA65k::StringPair AsmA65k::SplitStringByComma(const string& operand)
-{
-    // extract the two parts
-    static const regex rx_matchOperands(R"((.*)\s*,\s*(.*))");
-    smatch operandsMatch;
-    if (regex_match(operand, operandsMatch, rx_matchOperands) == false)
-        ThrowException_InvalidOperands();
-
-    StringPair sp;
-    // put them into their respective strings
-    sp.left = operandsMatch[1].str();  // "r0"
-    sp.right = operandsMatch[2].str(); // "1234"
-
-    return sp;
-}
-
-AsmA65k::RegisterType AsmA65k::DetectRegisterType(const string& registerStr)
-{
-    if (registerStr == "pc")
-        return REG_PC;
-    if (registerStr == "sp")
-        return REG_SP;
-
-    static const regex rx_detectRegisterIndex(R"(r([0-9]{1,2}))");
-    smatch registerIndexMatch;
-    if (regex_match(registerStr, registerIndexMatch, rx_detectRegisterIndex) == false)
-        ThrowException_InvalidRegister();
-
-    int registerIndex;
-
-    try
+    if (EqualsIgnoreCase(registerStr, "sp"))
     {
-        registerIndex = std::stoi(registerIndexMatch[1].str());
+        registerType = REG_SP;
+        return true;
     }
-    catch (...)
+
+    // r0 - r13
+    const size_t length = registerStr.size();
+    if (length < 2 || length > 3 || ToLower(registerStr[0]) != 'r')
+        return false;
+
+    int registerIndex = 0;
+    for (size_t i = 1; i < length; i++)
     {
-        ThrowException_InvalidRegister();
+        if (registerStr[i] < '0' || registerStr[i] > '9')
+            return false;
+        registerIndex = registerIndex * 10 + (registerStr[i] - '0');
     }
 
     if (registerIndex < REG_R0 || registerIndex > REG_R13)
         ThrowException_InvalidRegister();
 
-    return (RegisterType)registerIndex;
-}
-
-bool AsmA65k::FindAddressingMode(const string& mnemonic, AddressingModes am)
-{
-    return (std::find(opcodes[mnemonic].addressingModesAllowed.begin(), opcodes[mnemonic].addressingModesAllowed.end(), am)) != opcodes[mnemonic].addressingModesAllowed.end();
+    registerType = (RegisterType)registerIndex;
+    return true;
 }
 
-void AsmA65k::CheckIfAddressingModeIsLegalForThisInstruction(const string& mnemonic, const OperandTypes operandType)
+void AsmA65k::CheckIfAddressingModeIsLegalForThisInstruction(const OpcodeAttribute& opcode, const Operand& operand)
 {
-    AddressingModes addressingMode = GetAddressingModeFromOperand(operandType);
+    const AddressingModes addressingMode = GetAddressingModeFromOperand(operand.type);
+    uint32_t addressingModeMask = 1u << addressingMode;
 
     if (addressingMode == AM_AMBIGOUS) // AM_RELATIVE or AM_DIRECT or AM_CONST_IMMEDIATE
+        addressingModeMask = (1u << AM_RELATIVE) | (1u << AM_DIRECT) | (1u << AM_CONST_IMMEDIATE);
+
+    if ((opcode.addressingModesAllowed & addressingModeMask) == 0)
     {
-        if (FindAddressingMode(mnemonic, AM_RELATIVE))
-            return;
-        if (FindAddressingMode(mnemonic, AM_DIRECT))
-            return;
-        if (FindAddressingMode(mnemonic, AM_CONST_IMMEDIATE))
-            return;
+        AsmError error(actLineNumber, actLine, "Invalid addressing mode");
+        throw error;
     }
-    else if (FindAddressingMode(mnemonic, addressingMode))
-        return;
 
-    AsmError error(actLineNumber, actLine, "Invalid addressing mode");
-    throw error;
+    if (operand.postfix != PF_NONE && opcode.isPostfixEnabled == false)
+    {
+        AsmError error(actLineNumber, actLine, "Postfix is not allowed for this instruction");
+        throw error;
+    }
 }
 
-void AsmA65k::CheckIfSizeSpecifierIsAllowed(const string& mnemonic, const OpcodeSize opcodeSize)
+void AsmA65k::CheckIfSizeSpecifierIsAllowed(const OpcodeAttribute& opcode, const OpcodeSize opcodeSize)
 {
-    if ((opcodes[mnemonic].isSizeSpecifierAllowed == false) && (opcodeSize != OS_NONE))
+    if ((opcode.isSizeSpecifierAllowed == false) && (opcodeSize != OS_NONE) && (opcodeSize != OS_DIVSIGN))
     {
         AsmError error(actLineNumber, actLine, "Size specifier is not allowed for this instruction");
         throw error;
@@ -307,39 +228,33 @@ AsmA65k::OpcodeSize AsmA65k::GetOpcodeSizeFromUnsigedInteger(uint64_t value)
     return OS_32BIT;
 }
 
-void AsmA65k::VerifyRangeForConstant(const string& constant, OpcodeSize opcodeSize)
-{
-    if (GetOpcodeSizeFromUnsigedInteger(ConvertStringToInteger(constant)) < opcodeSize)
-        ThrowException_SymbolOutOfRange();
-}
-
 void AsmA65k::VerifyRangeForConstant(const uint32_t constant, OpcodeSize opcodeSize)
 {
     if (GetOpcodeSizeFromUnsigedInteger(constant) < opcodeSize)
         ThrowException_SymbolOutOfRange();
 }
 
-string AsmA65k::DetectAndRemoveLabelDefinition(string line)
+// .u and .s select the signedness of mul and div, the other instructions have no such specifier
+uint8_t AsmA65k::GetOpcodeSize(std::string_view modifierCharacter, const OpcodeAttribute& opcode)
 {
-    const static regex rx_detectLabel(R"(^(\s*[a-z][a-z_0-9]*:\s*)(.*))", regex_constants::icase);
-    // check is there's a label definition at the beginning of the line
-    if (regex_match(line, rx_detectLabel))
-        line = regex_replace(line, rx_detectLabel, "$2");
-
-    return line;
-}
-
-uint8_t AsmA65k::GetOpcodeSize(const string& modifierCharacter)
-{
-    if (modifierCharacter == "b")
-        return OS_8BIT;
-    if (modifierCharacter == "w")
-        return OS_16BIT;
-    if (modifierCharacter == "")
+    if (modifierCharacter.empty())
         return OS_NONE;
 
-    if (modifierCharacter == "u" || modifierCharacter == "s")
-        return OS_DIVSIGN;
+    if (modifierCharacter.size() == 1)
+    {
+        switch (ToLower(modifierCharacter[0]))
+        {
+        case 'b':
+            return OS_8BIT;
+        case 'w':
+            return OS_16BIT;
+        case 'u':
+        case 's':
+            if (opcode.instructionCode == I_MUL || opcode.instructionCode == I_DIV)
+                return OS_DIVSIGN;
+            break;
+        }
+    }
 
     AsmError error(actLineNumber, actLine);
     error.errorMessage = "Invalid size specifier";
@@ -348,26 +263,41 @@ uint8_t AsmA65k::GetOpcodeSize(const string& modifierCharacter)
     return OS_NONE; // never reached. Just to silence warning.
 }
 
+// the sign of mul and div takes the place of the size in the instruction word, their constants are 32 bits
+AsmA65k::OpcodeSize AsmA65k::GetDataSize(const InstructionWord instructionWord)
+{
+    return instructionWord.opcodeSize == OS_DIVSIGN ? OS_32BIT : (OpcodeSize)instructionWord.opcodeSize;
+}
+
 void AsmA65k::AddInstructionWord(const InstructionWord instructionWord)
 {
-    segments.back().AddWord(*(uint16_t *)&instructionWord);
+    if (instructionLength + 2u > sizeof(instructionBytes))
+        ThrowException_InternalError();
+
+    Segment::StoreWord(instructionBytes + instructionLength, *(uint16_t *)&instructionWord);
+    instructionLength += 2;
     PC += 2;
 }
 
 void AsmA65k::AddData(const OpcodeSize size, const uint32_t data)
 {
+    if (instructionLength + 4u > sizeof(instructionBytes))
+        ThrowException_InternalError();
+
     switch (size)
     {
     case OS_32BIT:
-        segments.back().AddDword(data);
+        Segment::StoreDword(instructionBytes + instructionLength, data);
+        instructionLength += 4;
         PC += 4;
         break;
     case OS_16BIT:
-        segments.back().AddWord(data);
+        Segment::StoreWord(instructionBytes + instructionLength, data);
+        instructionLength += 2;
         PC += 2;
         break;
     case OS_8BIT:
-        segments.back().AddByte(data);
+        instructionBytes[instructionLength++] = (uint8_t)data;
         PC++;
         break;
     case OS_DIVSIGN:
@@ -375,63 +305,15 @@ void AsmA65k::AddData(const OpcodeSize size, const uint32_t data)
     }
 }
 
-void AsmA65k::AddData(const string& sizeSpecifier, const uint32_t data)
-{
-    if (sizeSpecifier == "b")
-    {
-        AddData(OS_8BIT, data);
-        return;
-    }
-    if (sizeSpecifier == "w")
-    {
-        AddData(OS_16BIT, data);
-        return;
-    }
-    if (sizeSpecifier == "")
-    {
-        AddData(OS_32BIT, data);
-        return;
-    }
-
-    throw AsmError(actLineNumber, actLine, "Invalid size specifier");
-}
-
-uint32_t AsmA65k::ResolveLabel(const string& label, const uint32_t address, const OpcodeSize size, bool isRelative)
+void AsmA65k::EmitInstruction()
 {
-    static const regex rx_removeSurroundingWhiteSpace(R"(\s*(\S*)\s*)");
-    smatch result;
-    if (regex_match(label, result, rx_removeSurroundingWhiteSpace) == false)
-        ThrowException_InternalError();
-
-    //    log("resolveLabel: '%s'\n", label.c_str());
-    uint32_t effectiveAddress = 0;
-    string cleanLabel = result[1].str();
-
-    if (labels.find(cleanLabel) == labels.end())
-    {
-        LabelLocation labelLocation;
-        labelLocation.address = address;
-        labelLocation.opcodeSize = size;
-        labelLocation.lineContent = actLine;
-        labelLocation.lineNumber = actLineNumber;
-        labelLocation.isRelative = isRelative;
-        unresolvedLabels[cleanLabel].push_back(labelLocation);
-
-        return 0;
-    }
-    else
-    {
-        effectiveAddress = labels[cleanLabel];
-    }
-
-    return effectiveAddress;
+    memcpy(output, instructionBytes, instructionLength);
+    output += instructionLength;
+    instructionLength = 0;
 }
 
-void AsmA65k::HandleDoubleRegisters(const StringPair sp, InstructionWord instructionWord, PostfixType postFix)
+void AsmA65k::HandleDoubleRegisters(const RegisterType regLeft, const RegisterType regRight, InstructionWord instructionWord, PostfixType postFix)
 {
-    RegisterType regLeft = DetectRegisterType(sp.left);
-    RegisterType regRight = DetectRegisterType(sp.right);
-
     uint8_t registerSelector = ((regLeft & 15) << 4) | (regRight & 15);
 
     switch (postFix)
@@ -450,7 +332,7 @@ void AsmA65k::HandleDoubleRegisters(const StringPair sp, InstructionWord instruc
     AddData(OS_8BIT, registerSelector);  // 1 byte
 }
 
-void AsmA65k::AddRegisterConfigurationByte(const string& registerString, InstructionWord instructionWord, const PostfixType postFix)
+void AsmA65k::AddRegisterConfigurationByte(const RegisterType registerIndex, InstructionWord instructionWord, const PostfixType postFix)
 {
     switch (postFix)
     {
@@ -464,27 +346,7 @@ void AsmA65k::AddRegisterConfigurationByte(const string& registerString, Instruc
         instructionWord.registerConfiguration = RC_REGISTER;
         break;
     }
-    RegisterType registerIndex = DetectRegisterType(registerString);
 
     AddInstructionWord(instructionWord); // 2 bytes
     AddData(OS_8BIT, registerIndex);     // 1 byte
 }
-
-AsmA65k::PostfixType AsmA65k::GetPostFixType(const string& operand)
-{
-    static const regex rx_detectPostfixSign(R"((.*\])([\+\-])$)");
-    string sign;
-    smatch result;
-    if (regex_match(operand, result, rx_detectPostfixSign) == true)
-        sign = result[2].str();
-    else
-        return PF_NONE;
-
-    if (sign == "+")
-        return PF_INC;
-
-    if (sign == "-")
-        return PF_DEC;
-
-    return PF_NONE; // "fake" return to silence warning
-}
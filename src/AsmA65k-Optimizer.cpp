@@ -0,0 +1,170 @@
+//
+//  AsmA65k-Optimizer.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+#include <algorithm>
+
+using namespace std;
+
+// the peephole optimizer works on the statements of the sizing pass. the instructions are changed while they
+// are sized, the encoding pass repeats the same changes by ApplyRewrite(), so the existing operand handlers
+// encode the optimized instructions
+
+AsmA65k::Rewrite AsmA65k::FindRewrite(const InstructionWord instructionWord, const Operand &operand) const
+{
+    if (operand.type != OT_REGISTER__CONSTANT)
+        return RW_NONE;
+
+    const uint32_t constant = operand.values[0].constant;
+
+    switch (instructionWord.instructionCode)
+    {
+    case I_MOV: // mov r0, 0
+        return constant == 0 ? RW_CLR : RW_NONE;
+    case I_ADD: // add r0, 1
+        return constant == 1 ? RW_INC : RW_NONE;
+    case I_SUB: // sub r0, 1
+        return constant == 1 ? RW_DEC : RW_NONE;
+    default:
+        return RW_NONE;
+    }
+}
+
+void AsmA65k::ApplyRewrite(const Rewrite rewrite, InstructionWord &instructionWord, Operand &operand)
+{
+    switch (rewrite)
+    {
+    case RW_NONE:
+        break;
+    case RW_BRA:
+        instructionWord.instructionCode = I_BRA;
+        break;
+    case RW_JMP:
+        instructionWord.instructionCode = I_JMP;
+        break;
+    case RW_CLR:
+    case RW_INC:
+    case RW_DEC:
+        instructionWord.instructionCode = rewrite == RW_CLR ? I_CLR : rewrite == RW_INC ? I_INC : I_DEC;
+        operand.type = OT_REGISTER; // the register keeps its place, only the constant is dropped
+        operand.valueCount = 0;
+        break;
+    }
+}
+
+// called by the sizing pass before the instruction is recorded. the statement before it can only be
+// changed if nothing can jump between the two, i.e. no symbol was defined since and they are adjacent
+bool AsmA65k::MergeWithPreviousStatement(const InstructionWord instructionWord, const Operand &operand)
+{
+    if (statements.empty() || isStatementBoundary)
+        return false;
+
+    Statement &previous = statements.back();
+    if (previous.isInstruction == false || previous.segmentIndex != segments.size() - 1 || previous.address + previous.length != PC)
+        return false;
+
+    const uint8_t instruction = instructionWord.instructionCode;
+    const uint8_t previousInstruction = previous.instructionWord.instructionCode;
+
+    // push r0 / pop r0: both are dropped
+    if (instruction == I_POP && previousInstruction == I_PUSH && operand.type == OT_REGISTER && previous.operandType == OT_REGISTER &&
+        operand.registers[0] == previous.operandRegister && instructionWord.opcodeSize == previous.instructionWord.opcodeSize)
+    {
+        PC = previous.address;
+        statements.pop_back();
+        return true;
+    }
+
+    // jsr sub / rts: the subroutine returns to our caller instead
+    if (instruction == I_RTS && previousInstruction == I_JSR)
+    {
+        previous.instructionWord.instructionCode = I_JMP;
+        previous.rewrite = RW_JMP;
+        return true;
+    }
+
+    return false;
+}
+
+// a jump to an unconditional jump is pointed to the final target. branches are only retargeted if
+// the final target is still within their reach. runs after the sizing pass, the sizes don't change
+void AsmA65k::ResolveJumpChains()
+{
+    static constexpr int MAX_JUMP_CHAIN_LENGTH = 16; // also stops jumps that loop into each other
+
+    // the instructions sorted by address, to find the one a label points to
+    std::vector<uint32_t> instructionsByAddress;
+    instructionsByAddress.reserve(statements.size());
+    for (uint32_t i = 0; i < statements.size(); i++)
+    {
+        if (statements[i].isInstruction)
+            instructionsByAddress.push_back(i);
+    }
+    std::stable_sort(instructionsByAddress.begin(), instructionsByAddress.end(), [this](const uint32_t a, const uint32_t b)
+                     { return statements[a].address < statements[b].address; });
+
+    auto findInstructionAt = [this, &instructionsByAddress](const uint32_t address) -> const Statement *
+    {
+        auto it = std::lower_bound(instructionsByAddress.begin(), instructionsByAddress.end(), address, [this](const uint32_t index, const uint32_t value)
+                                   { return statements[index].address < value; });
+        if (it == instructionsByAddress.end() || statements[*it].address != address)
+            return nullptr;
+        if (it + 1 != instructionsByAddress.end() && statements[*(it + 1)].address == address) // overlapping segments
+            return nullptr;
+        return &statements[*it];
+    };
+
+    // the labels defined more than once have no single address to follow
+    auto isFixedLabel = [this](const uint32_t symbolId)
+    {
+        return symbolId != SymbolTable::INVALID_ID && labels.IsDefined(symbolId) &&
+               (symbolId >= symbolDefinitions.size() || symbolDefinitions[symbolId].isRedefined == false);
+    };
+
+    auto isUnconditionalJump = [](const Statement &statement)
+    {
+        const uint8_t instruction = statement.instructionWord.instructionCode;
+        return statement.operandType == OT_LABEL && (instruction == I_BRA || (instruction == I_JMP && statement.instructionWord.opcodeSize == OS_NONE));
+    };
+
+    for (Statement &statement : statements)
+    {
+        if (statement.isInstruction == false || statement.jumpTarget == SymbolTable::INVALID_ID)
+            continue;
+
+        const uint8_t instruction = statement.instructionWord.instructionCode;
+        const bool isBranch = instruction >= I_BRA && instruction <= I_BGE;
+        if (isBranch == false && isUnconditionalJump(statement) == false)
+            continue;
+
+        uint32_t target = statement.jumpTarget;
+        // the addresses of an object's relocatable section and its other segments overlap, the chain stays in the section of the jump
+        for (int i = 0; i < MAX_JUMP_CHAIN_LENGTH && isFixedLabel(target) && IsInSameSection(statement.segmentIndex, target); i++)
+        {
+            const Statement *next = findInstructionAt(labels.GetValue(target));
+            if (next == nullptr || next == &statement || isUnconditionalJump(*next) == false || isFixedLabel(next->jumpTarget) == false ||
+                IsRelocatableSegment(next->segmentIndex) != IsRelocatableSegment(statement.segmentIndex) || IsInSameSection(statement.segmentIndex, next->jumpTarget) == false)
+                break;
+
+            if (isBranch)
+            {
+                const int32_t diff = labels.GetValue(next->jumpTarget) - statement.address - 4; // same as in HandleOperand_Constant()
+                if (diff < -32768 || diff > 32767)
+                    break;
+            }
+            target = next->jumpTarget;
+        }
+
+        if (target != statement.jumpTarget)
+        {
+            statement.jumpTarget = target;
+            statement.isRetargeted = true;
+        }
+    }
+}
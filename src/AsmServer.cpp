@@ -0,0 +1,396 @@
+//
+//  AsmServer.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <AsmServer.h>
+#include <MappedFile.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <cstring>
+
+#ifdef UNIX_HOST
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#endif
+
+using namespace std;
+
+#ifdef UNIX_HOST
+
+namespace
+{
+    constexpr size_t MAX_CONTEXTS = 64; // the least recently used context is dropped for a new file
+
+    struct ServerContext // the assembler of one source file, used by one connection at a time
+    {
+        std::mutex mutex;
+        AsmA65k asm65k;
+        uint64_t lastUse = 0; // guarded by contextsMutex
+    };
+
+    // a dropped context is deleted by the last connection using it
+    std::mutex contextsMutex;
+    std::unordered_map<std::string, std::shared_ptr<ServerContext>> contexts; // by the path of the source file
+    uint64_t useCount = 0;
+
+    std::shared_ptr<ServerContext> GetContext(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(contextsMutex);
+
+        auto context = contexts.find(path);
+        if (context == contexts.end())
+        {
+            if (contexts.size() >= MAX_CONTEXTS)
+            {
+                const auto leastRecent = std::min_element(contexts.begin(), contexts.end(), [](const auto &a, const auto &b)
+                                                          { return a.second->lastUse < b.second->lastUse; });
+                contexts.erase(leastRecent);
+            }
+
+            context = contexts.emplace(path, std::make_shared<ServerContext>()).first;
+            context->second->asm65k.SetLineCache(true);
+        }
+
+        context->second->lastUse = ++useCount;
+        return context->second;
+    }
+
+    // the context of a file that has gone away
+    void DropContext(const std::string &path, const std::shared_ptr<ServerContext> &context)
+    {
+        std::lock_guard<std::mutex> lock(contextsMutex);
+
+        const auto entry = contexts.find(path);
+        if (entry != contexts.end() && entry->second == context)
+            contexts.erase(entry);
+    }
+
+    void AppendBytes(std::vector<uint8_t> &buffer, const void *data, size_t size)
+    {
+        buffer.insert(buffer.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+    }
+
+    void AppendError(std::vector<uint8_t> &buffer, const AsmError &error)
+    {
+        const AsmServer::ResponseError responseError = {error.lineNumber, error.column, (uint32_t)error.errorMessage.size(), (uint32_t)error.lineContent.size(),
+                                                        (uint32_t)error.fileName.size(), (uint32_t)error.includeStack.size()};
+        AppendBytes(buffer, &responseError, sizeof(responseError));
+        AppendBytes(buffer, error.errorMessage.data(), error.errorMessage.size());
+        AppendBytes(buffer, error.lineContent.data(), error.lineContent.size());
+        AppendBytes(buffer, error.fileName.data(), error.fileName.size());
+        for (const AsmSourceLocation &location : error.includeStack)
+        {
+            const AsmServer::ResponseLocation responseLocation = {location.lineNumber, location.isMacro, (uint32_t)location.fileName.size()};
+            AppendBytes(buffer, &responseLocation, sizeof(responseLocation));
+            AppendBytes(buffer, location.fileName.data(), location.fileName.size());
+        }
+    }
+
+    // assembles the file of a request, and builds the response in 'response'
+    void ProcessRequest(const std::string &path, uint32_t options, std::vector<uint8_t> &response)
+    {
+        AsmServer::ResponseHeader header = {};
+        std::optional<AsmError> thrownError;
+        const std::vector<AsmError> *errors = nullptr;
+        const std::vector<Segment> *segments = nullptr;
+
+        const std::shared_ptr<ServerContext> contextPointer = GetContext(path);
+        ServerContext &context = *contextPointer;
+        std::lock_guard<std::mutex> lock(context.mutex);
+
+        MappedFile sourceFile;
+        if (sourceFile.Open(path.c_str()) == false || sourceFile.GetText().empty())
+        {
+            header.status = AsmServer::SS_LOAD_ERROR;
+            DropContext(path, contextPointer);
+        }
+        else
+        {
+            context.asm65k.SetJumpRelaxation((options & AsmServer::SO_RELAX_JUMPS) != 0);
+            context.asm65k.SetOptimization((options & AsmServer::SO_OPTIMIZE) != 0);
+            context.asm65k.SetErrorCollection((options & AsmServer::SO_ALL_ERRORS) != 0);
+            try
+            {
+                segments = context.asm65k.Assemble(sourceFile.GetText(), path);
+                if (context.asm65k.GetErrors().empty())
+                {
+                    header.status = AsmServer::SS_OK;
+                    header.segmentCount = (uint32_t)segments->size();
+                }
+                else
+                {
+                    header.status = AsmServer::SS_ASSEMBLY_ERROR;
+                    header.errorCount = (uint32_t)context.asm65k.GetErrors().size();
+                    errors = &context.asm65k.GetErrors();
+                    segments = nullptr;
+                }
+            }
+            catch (AsmError &error)
+            {
+                header.status = AsmServer::SS_ASSEMBLY_ERROR;
+                header.errorCount = 1;
+                thrownError = std::move(error);
+            }
+        }
+
+        response.clear();
+        AppendBytes(response, &header, sizeof(header));
+        if (thrownError.has_value())
+            AppendError(response, *thrownError);
+        if (errors != nullptr)
+        {
+            for (const AsmError &error : *errors)
+                AppendError(response, error);
+        }
+
+        if (segments != nullptr)
+        {
+            for (const Segment &segment : *segments)
+            {
+                const uint32_t segmentHeader[2] = {segment.address, (uint32_t)segment.data.size()};
+                AppendBytes(response, segmentHeader, sizeof(segmentHeader));
+                AppendBytes(response, segment.data.data(), segment.data.size());
+            }
+        }
+    }
+
+    void ServeConnection(int connection)
+    {
+        std::vector<uint8_t> response;
+        std::string path;
+        AsmServer::RequestHeader request;
+
+        while (AsmServer::ReadFully(connection, &request, sizeof(request)) && request.pathLength < PATH_MAX)
+        {
+            path.resize(request.pathLength);
+            if (AsmServer::ReadFully(connection, path.data(), path.size()) == false)
+                break;
+
+            ProcessRequest(path, request.options, response);
+            if (AsmServer::WriteFully(connection, response.data(), response.size()) == false)
+                break;
+        }
+
+        close(connection);
+    }
+}
+
+int AsmServer::Run(const char *socketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        printf("Socket path is too long: '%s'\n", socketPath);
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        printf("Could not create socket\n");
+        return -1;
+    }
+
+    unlink(socketPath); // left behind by a previous server
+    if (bind(listener, (const sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        printf("Could not listen on '%s'\n", socketPath);
+        close(listener);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN); // a client that went away only ends its own connection
+    printf("Listening on '%s'\n", socketPath);
+    fflush(stdout);
+
+    // every connection is served on its own thread, the contexts are shared between them
+    for (;;)
+    {
+        const int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        std::thread(ServeConnection, connection).detach();
+    }
+
+    close(listener);
+    unlink(socketPath);
+    return -1;
+}
+
+bool AsmServer::ReadFully(int fd, void *buffer, size_t size)
+{
+    uint8_t *position = (uint8_t *)buffer;
+    while (size > 0)
+    {
+        const ssize_t count = read(fd, position, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+
+        position += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+bool AsmServer::WriteFully(int fd, const void *buffer, size_t size)
+{
+    const uint8_t *position = (const uint8_t *)buffer;
+    while (size > 0)
+    {
+        const ssize_t count = write(fd, position, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+
+        position += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+AsmClient::~AsmClient()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool AsmClient::Connect(const char *socketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+        return false;
+    strcpy(address.sun_path, socketPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+
+    if (connect(fd, (const sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+std::optional<AsmServer::Status> AsmClient::Assemble(const char *filename, uint32_t options, std::vector<Segment> &segments, std::vector<AsmError> &errors)
+{
+    // the server has its own working directory, and it keys its contexts by the path
+    char path[PATH_MAX];
+    if (realpath(filename, path) == nullptr)
+        return AsmServer::SS_LOAD_ERROR;
+
+    const AsmServer::RequestHeader request = {options, (uint32_t)strlen(path)};
+    if (AsmServer::WriteFully(fd, &request, sizeof(request)) == false || AsmServer::WriteFully(fd, path, request.pathLength) == false)
+        return std::nullopt;
+
+    AsmServer::ResponseHeader response;
+    if (AsmServer::ReadFully(fd, &response, sizeof(response)) == false)
+        return std::nullopt;
+
+    errors.resize(response.errorCount, AsmError(0, ""));
+    for (AsmError &error : errors)
+    {
+        AsmServer::ResponseError responseError;
+        if (AsmServer::ReadFully(fd, &responseError, sizeof(responseError)) == false)
+            return std::nullopt;
+
+        error.lineNumber = responseError.lineNumber;
+        error.column = responseError.column;
+        error.errorMessage.resize(responseError.messageLength);
+        error.lineContent.resize(responseError.lineLength);
+        error.fileName.resize(responseError.fileNameLength);
+        if (AsmServer::ReadFully(fd, error.errorMessage.data(), responseError.messageLength) == false ||
+            AsmServer::ReadFully(fd, error.lineContent.data(), responseError.lineLength) == false ||
+            AsmServer::ReadFully(fd, error.fileName.data(), responseError.fileNameLength) == false)
+            return std::nullopt;
+
+        error.includeStack.resize(responseError.includeStackLength);
+        for (AsmSourceLocation &location : error.includeStack)
+        {
+            AsmServer::ResponseLocation responseLocation;
+            if (AsmServer::ReadFully(fd, &responseLocation, sizeof(responseLocation)) == false)
+                return std::nullopt;
+
+            location.lineNumber = responseLocation.lineNumber;
+            location.isMacro = responseLocation.isMacro != 0;
+            location.fileName.resize(responseLocation.fileNameLength);
+            if (AsmServer::ReadFully(fd, location.fileName.data(), location.fileName.size()) == false)
+                return std::nullopt;
+        }
+    }
+
+    segments.resize(response.segmentCount);
+    for (Segment &segment : segments)
+    {
+        uint32_t segmentHeader[2];
+        if (AsmServer::ReadFully(fd, segmentHeader, sizeof(segmentHeader)) == false)
+            return std::nullopt;
+
+        segment.address = segmentHeader[0];
+        segment.data.resize(segmentHeader[1]);
+        if (AsmServer::ReadFully(fd, segment.data.data(), segment.data.size()) == false)
+            return std::nullopt;
+    }
+
+    return (AsmServer::Status)response.status;
+}
+
+#else
+
+int AsmServer::Run(const char *socketPath)
+{
+    printf("Server mode is only supported on UNIX hosts\n");
+    return -1;
+}
+
+bool AsmServer::ReadFully(int fd, void *buffer, size_t size)
+{
+    return false;
+}
+
+bool AsmServer::WriteFully(int fd, const void *buffer, size_t size)
+{
+    return false;
+}
+
+AsmClient::~AsmClient()
+{
+}
+
+bool AsmClient::Connect(const char *socketPath)
+{
+    return false;
+}
+
+std::optional<AsmServer::Status> AsmClient::Assemble(const char *filename, uint32_t options, std::vector<Segment> &segments, std::vector<AsmError> &errors)
+{
+    return std::nullopt;
+}
+
+#endif
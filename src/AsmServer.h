@@ -0,0 +1,90 @@
+//
+//  AsmServer.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <Asm65k.h>
+#include <Segment.h>
+#include <string>
+#include <vector>
+
+// a long running assembler process. it keeps an assembler context for the files it has seen most recently (with
+// their line caches), and assembles the files requested over a UNIX domain socket. the file is read by the server,
+// the segments or the errors are sent back to the client. UNIX hosts only
+class AsmServer
+{
+public:
+    enum Options // the assembler options of a request
+    {
+        SO_RELAX_JUMPS = 1,
+        SO_OPTIMIZE = 2,
+        SO_ALL_ERRORS = 4 // the lines with errors are skipped, and every error is sent
+    };
+
+    enum Status
+    {
+        SS_OK,
+        SS_ASSEMBLY_ERROR, // the errors are sent, one without SO_ALL_ERRORS
+        SS_LOAD_ERROR      // the file couldn't be read
+    };
+
+    struct RequestHeader // followed by the absolute path of the source file
+    {
+        uint32_t options;
+        uint32_t pathLength;
+    };
+
+    struct ResponseHeader // followed by the errors, then by the segments
+    {
+        uint32_t status;
+        uint32_t errorCount;
+        uint32_t segmentCount; // each segment is its address and size (32 bits each) followed by its data
+    };
+
+    struct ResponseError // followed by the error message, the line and the file name of the error, then by its include stack
+    {
+        uint32_t lineNumber;
+        uint32_t column;
+        uint32_t messageLength;
+        uint32_t lineLength;
+        uint32_t fileNameLength;     // the included file of the error, empty for the requested file
+        uint32_t includeStackLength; // the number of ResponseLocations
+    };
+
+    struct ResponseLocation // an entry of AsmError::includeStack, followed by its file name
+    {
+        uint32_t lineNumber;
+        uint32_t isMacro;
+        uint32_t fileNameLength;
+    };
+
+    static int Run(const char *socketPath); // serves requests until the process is stopped
+
+    static bool ReadFully(int fd, void *buffer, size_t size);
+    static bool WriteFully(int fd, const void *buffer, size_t size);
+};
+
+// the client side of AsmServer. one connection serves any number of requests
+class AsmClient
+{
+public:
+    AsmClient() = default;
+    AsmClient(const AsmClient &) = delete;
+    AsmClient &operator=(const AsmClient &) = delete;
+    ~AsmClient();
+
+    bool Connect(const char *socketPath);
+
+    // returns the status of the request, or nullopt if the connection failed. the segments are
+    // filled in on success, the errors in line order on SS_ASSEMBLY_ERROR
+    std::optional<AsmServer::Status> Assemble(const char *filename, uint32_t options, std::vector<Segment> &segments, std::vector<AsmError> &errors);
+
+private:
+    int fd = -1;
+};
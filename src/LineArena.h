@@ -0,0 +1,77 @@
+//
+//  LineArena.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// bump allocator for scratch data that lives while a single source line is assembled.
+// Reset() rewinds it without freeing, so once the blocks are warm no heap allocation happens
+class LineArena
+{
+public:
+    char *Allocate(size_t size)
+    {
+        while (blockIndex < blocks.size())
+        {
+            Block &block = blocks[blockIndex];
+            if (used + size <= block.size)
+            {
+                char *result = block.data.get() + used;
+                used += size;
+                return result;
+            }
+            blockIndex++;
+            used = 0;
+        }
+
+        const size_t blockSize = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+        blocks.push_back(Block{std::make_unique<char[]>(blockSize), blockSize});
+        used = size;
+        return blocks.back().data.get();
+    }
+
+    // returns the text in lower case. it's copied into the arena only if it contains upper case characters
+    std::string_view ToLower(std::string_view text)
+    {
+        size_t i = 0;
+        while (i < text.size() && (text[i] < 'A' || text[i] > 'Z'))
+            i++;
+
+        if (i == text.size())
+            return text;
+
+        char *copy = Allocate(text.size());
+        for (i = 0; i < text.size(); i++)
+            copy[i] = (text[i] >= 'A' && text[i] <= 'Z') ? text[i] + ('a' - 'A') : text[i];
+
+        return std::string_view(copy, text.size());
+    }
+
+    void Reset()
+    {
+        blockIndex = 0;
+        used = 0;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t blockIndex = 0;
+    size_t used = 0;
+};
@@ -0,0 +1,120 @@
+//
+//  LineCache.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the encoded bytes of the statements of the previous assembly. an entry is keyed by a hash of the line
+// and everything its bytes depend on (see AsmA65k::GetStatementKey()), and it's only used if the line
+// matches as well. every assembly replaces the whole cache, the entries and their text are kept in flat
+// buffers and indexed by an open addressing hash table, like in SymbolTable
+class LineCache
+{
+public:
+    // returns the cached bytes of the line, or nullptr if they are not known
+    const uint8_t *Find(uint64_t key, std::string_view line, uint32_t length) const
+    {
+        if (slots.empty())
+            return nullptr;
+
+        const size_t mask = slots.size() - 1;
+        for (size_t i = key & mask; slots[i] != EMPTY_SLOT; i = (i + 1) & mask)
+        {
+            const Entry &entry = entries[slots[i]];
+            if (entry.key == key && entry.length == length && entry.lineLength == line.size() &&
+                memcmp(data.data() + entry.dataOffset, line.data(), line.size()) == 0)
+                return (const uint8_t *)data.data() + entry.dataOffset + entry.lineLength;
+        }
+
+        return nullptr;
+    }
+
+    // starts building the next generation of the cache
+    void Begin(size_t entryCount, size_t dataSize)
+    {
+        nextEntries.clear();
+        nextData.clear();
+        nextEntries.reserve(entryCount);
+        nextData.reserve(dataSize);
+    }
+
+    void Add(uint64_t key, std::string_view line, const uint8_t *bytes, uint32_t length)
+    {
+        nextEntries.push_back(Entry{key, nextData.size(), (uint32_t)line.size(), length});
+        nextData.append(line);
+        nextData.append((const char *)bytes, length);
+    }
+
+    // replaces the cache with the generation built by Add()
+    void Commit()
+    {
+        entries.swap(nextEntries);
+        data.swap(nextData);
+        nextEntries = std::vector<Entry>();
+        nextData = std::string();
+
+        size_t slotCount = 64;
+        while (slotCount < entries.size() * 2)
+            slotCount *= 2;
+        slots.assign(slotCount, EMPTY_SLOT);
+
+        // the same line in the same context is indexed once, the duplicates would only lengthen the probe sequences
+        const size_t mask = slotCount - 1;
+        for (uint32_t i = 0; i < entries.size(); i++)
+        {
+            const Entry &entry = entries[i];
+            size_t slot = entry.key & mask;
+            while (slots[slot] != EMPTY_SLOT && IsSameLine(entries[slots[slot]], entry) == false)
+                slot = (slot + 1) & mask;
+            if (slots[slot] == EMPTY_SLOT)
+                slots[slot] = i;
+        }
+    }
+
+    void Clear()
+    {
+        entries = std::vector<Entry>();
+        data = std::string();
+        slots = std::vector<uint32_t>();
+    }
+
+    size_t GetSize() const
+    {
+        return entries.size();
+    }
+
+private:
+    static constexpr uint32_t EMPTY_SLOT = 0xffffffff;
+
+    struct Entry
+    {
+        uint64_t key;
+        size_t dataOffset;   // the line followed by its bytes in 'data'
+        uint32_t lineLength;
+        uint32_t length;     // the number of bytes
+    };
+
+    bool IsSameLine(const Entry &a, const Entry &b) const
+    {
+        return a.key == b.key && a.lineLength == b.lineLength && a.length == b.length &&
+               memcmp(data.data() + a.dataOffset, data.data() + b.dataOffset, a.lineLength + a.length) == 0;
+    }
+
+    std::vector<Entry> entries;
+    std::string data;
+    std::vector<uint32_t> slots; // entry indices, EMPTY_SLOT marks a free slot
+
+    std::vector<Entry> nextEntries;
+    std::string nextData;
+};
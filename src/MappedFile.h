@@ -0,0 +1,114 @@
+//
+//  MappedFile.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifdef UNIX_HOST
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <fstream>
+#include <sstream>
+
+// read-only view of a whole file. memory-mapped on UNIX hosts by Open(), read into a buffer elsewhere or by Read()
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const char *filename)
+    {
+        Close();
+#ifdef UNIX_HOST
+        const int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        size = (size_t)fileStat.st_size;
+
+        if (size > 0)
+        {
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(fd);
+                size = 0;
+                return false;
+            }
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            data = (const char *)mapping;
+            isMapped = true;
+        }
+
+        close(fd);
+        return true;
+#else
+        return Read(filename);
+#endif
+    }
+
+    // for the files kept after they may have changed: a mapping would show the new content, and a read past
+    // the end of a truncated file is a SIGBUS
+    bool Read(const char *filename)
+    {
+        Close();
+        std::ifstream fs(filename, std::ifstream::binary);
+        if (!fs)
+            return false;
+
+        std::stringstream buffer;
+        buffer << fs.rdbuf();
+        contents = buffer.str();
+        data = contents.data();
+        size = contents.size();
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef UNIX_HOST
+        if (isMapped)
+            munmap((void *)data, size);
+#endif
+        contents.clear();
+        data = nullptr;
+        size = 0;
+        isMapped = false;
+    }
+
+    std::string_view GetText() const
+    {
+        return std::string_view(data, size);
+    }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool isMapped = false;
+    std::string contents;
+};
@@ -0,0 +1,113 @@
+//
+//  ObjectFile.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <ObjectFile.h>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static const char signature[4] = {'A', 'O', 'B', 'J'};
+
+bool ObjectFile::Write(const char *filename, const Contents &contents)
+{
+    Header header;
+    memcpy(header.signature, signature, sizeof(signature));
+    header.version = VERSION;
+    header.sectionCount = (uint32_t)contents.sections.size();
+    header.symbolCount = (uint32_t)contents.symbols.size();
+    header.relocationCount = (uint32_t)contents.relocations.size();
+    header.tokenCount = (uint32_t)contents.tokens.size();
+    header.dataSize = (uint32_t)contents.data.size();
+    header.sourceNameOffset = (uint32_t)contents.names.size();
+    header.sourceNameLength = (uint32_t)contents.sourceName.size();
+    header.namesSize = (uint32_t)(contents.names.size() + contents.sourceName.size());
+
+    ofstream outfile(filename, ofstream::binary);
+    if (!outfile)
+        return false;
+
+    outfile.write((const char *)&header, sizeof(header));
+    outfile.write((const char *)contents.sections.data(), contents.sections.size() * sizeof(Section));
+    outfile.write((const char *)contents.symbols.data(), contents.symbols.size() * sizeof(Symbol));
+    outfile.write((const char *)contents.relocations.data(), contents.relocations.size() * sizeof(Relocation));
+    outfile.write((const char *)contents.tokens.data(), contents.tokens.size() * sizeof(Token));
+    outfile.write(contents.data.data(), contents.data.size());
+    outfile.write(contents.names.data(), contents.names.size());
+    outfile.write(contents.sourceName.data(), contents.sourceName.size());
+    outfile.close();
+
+    return (bool)outfile;
+}
+
+bool ObjectFile::Open(const char *filename)
+{
+    header = nullptr;
+    if (file.Open(filename) == false)
+        return false;
+
+    // the tables are used in place, so everything they refer to is checked up front. the expressions and the sizes of the fields are checked by the linker
+    const std::string_view text = file.GetText();
+    if (text.size() < sizeof(Header))
+        return false;
+
+    const Header *fileHeader = (const Header *)text.data();
+    if (memcmp(fileHeader->signature, signature, sizeof(signature)) != 0 || fileHeader->version != VERSION)
+        return false;
+
+    const uint64_t sectionsStart = sizeof(Header);
+    const uint64_t symbolsStart = sectionsStart + (uint64_t)fileHeader->sectionCount * sizeof(Section);
+    const uint64_t relocationsStart = symbolsStart + (uint64_t)fileHeader->symbolCount * sizeof(Symbol);
+    const uint64_t tokensStart = relocationsStart + (uint64_t)fileHeader->relocationCount * sizeof(Relocation);
+    const uint64_t dataStart = tokensStart + (uint64_t)fileHeader->tokenCount * sizeof(Token);
+    const uint64_t namesStart = dataStart + fileHeader->dataSize;
+    if (text.size() != namesStart + fileHeader->namesSize)
+        return false;
+
+    sections = (const Section *)(text.data() + sectionsStart);
+    symbols = (const Symbol *)(text.data() + symbolsStart);
+    relocations = (const Relocation *)(text.data() + relocationsStart);
+    tokens = (const Token *)(text.data() + tokensStart);
+    data = (const uint8_t *)(text.data() + dataStart);
+    names = text.data() + namesStart;
+
+    const auto isInNames = [fileHeader](const uint32_t offset, const uint32_t length)
+    { return (uint64_t)offset + length <= fileHeader->namesSize; };
+
+    if (isInNames(fileHeader->sourceNameOffset, fileHeader->sourceNameLength) == false)
+        return false;
+
+    for (uint32_t i = 0; i < fileHeader->sectionCount; i++)
+    {
+        if ((uint64_t)sections[i].dataOffset + sections[i].size > fileHeader->dataSize)
+            return false;
+    }
+
+    for (uint32_t i = 0; i < fileHeader->symbolCount; i++)
+    {
+        const Symbol &symbol = symbols[i];
+        if (isInNames(symbol.nameOffset, symbol.nameLength) == false ||
+            (symbol.section >= fileHeader->sectionCount && symbol.section != UNDEFINED && symbol.section != ABSOLUTE) ||
+            (symbol.isExported && symbol.section == UNDEFINED))
+            return false;
+    }
+
+    for (uint32_t i = 0; i < fileHeader->relocationCount; i++)
+    {
+        const Relocation &relocation = relocations[i];
+        if (relocation.section >= fileHeader->sectionCount || relocation.offset >= sections[relocation.section].size ||
+            (uint64_t)relocation.firstToken + relocation.tokenCount > fileHeader->tokenCount || relocation.tokenCount == 0 ||
+            isInNames(relocation.lineOffset, relocation.lineLength) == false ||
+            isInNames(relocation.fileNameOffset, relocation.fileNameLength) == false)
+            return false;
+    }
+
+    header = fileHeader;
+    return true;
+}
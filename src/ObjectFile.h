@@ -0,0 +1,120 @@
+//
+//  ObjectFile.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <MappedFile.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// relocatable object files (.o), written by AsmA65k::WriteObjectFile() and merged into an .rsb image by AsmA65k::Link().
+// a section is the bytes of a segment. the relocatable section starts at 0, the linker decides its address, the
+// others were placed by .pc. a relocation is a fixup kept for the linker: a field and the expression of its value.
+// the file is a build artifact in the byte order of the host: the header, the sections, the symbols, the
+// relocations, the expression tokens, then the section data and the names back to back
+class ObjectFile
+{
+public:
+    static constexpr uint32_t UNDEFINED = 0xffffffff; // Symbol::section of an imported symbol
+    static constexpr uint32_t ABSOLUTE = 0xfffffffe;  // Symbol::section of a symbol whose value doesn't move, eg. a .def
+
+    struct Header
+    {
+        char signature[4]; // "AOBJ"
+        uint32_t version;
+        uint32_t sectionCount;
+        uint32_t symbolCount;
+        uint32_t relocationCount;
+        uint32_t tokenCount;
+        uint32_t dataSize;
+        uint32_t namesSize;
+        uint32_t sourceNameOffset; // the source file the object was assembled from, in the names
+        uint32_t sourceNameLength;
+    };
+
+    struct Section
+    {
+        uint32_t address;       // the offsets of the relocatable section start at 0
+        uint32_t dataOffset;
+        uint32_t size;
+        uint32_t isRelocatable;
+    };
+
+    struct Symbol // the IDs of the symbols in the expressions are their indices
+    {
+        uint32_t hash;       // SymbolTable::Hash() of the name, so the linker doesn't hash it again
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t value;      // the offset in its section, or the value itself for ABSOLUTE
+        uint32_t section;    // an index, UNDEFINED or ABSOLUTE
+        uint32_t isExported; // .export, visible to the other objects
+    };
+
+    struct Relocation
+    {
+        uint32_t section;
+        uint32_t offset;         // of the field in the section
+        uint32_t firstToken;     // the expression of the value
+        uint32_t tokenCount;
+        uint32_t opcodeSize;     // the size of the field, as AsmA65k::OpcodeSize
+        uint32_t isRelative;     // branches store the distance from the field's address + 2
+        uint32_t lineNumber;     // where the expression was, for the errors of the linker
+        uint32_t lineOffset;     // the line in the names
+        uint32_t lineLength;
+        uint32_t fileNameOffset; // the file in the names, empty for the source of the object
+        uint32_t fileNameLength;
+    };
+
+    struct Token // AsmA65k::ExpressionToken
+    {
+        uint32_t type;
+        uint32_t value; // a symbol index for the symbols, an offset in the section for '*' of the relocatable section
+    };
+
+    // the contents of an object, assembled by the writer
+    struct Contents
+    {
+        std::vector<Section> sections;
+        std::vector<Symbol> symbols;
+        std::vector<Relocation> relocations;
+        std::vector<Token> tokens;
+        std::string data;
+        std::string names;
+        std::string_view sourceName;
+    };
+
+    static bool Write(const char *filename, const Contents &contents);
+
+    bool Open(const char *filename); // maps the file, returns false if it's missing or not a valid object file
+
+    std::string_view GetSourceName() const { return GetName(header->sourceNameOffset, header->sourceNameLength); }
+    uint32_t GetSectionCount() const { return header->sectionCount; }
+    const Section &GetSection(uint32_t index) const { return sections[index]; }
+    const uint8_t *GetSectionData(const Section &section) const { return data + section.dataOffset; }
+    uint32_t GetSymbolCount() const { return header->symbolCount; }
+    const Symbol &GetSymbol(uint32_t index) const { return symbols[index]; }
+    uint32_t GetRelocationCount() const { return header->relocationCount; }
+    const Relocation &GetRelocation(uint32_t index) const { return relocations[index]; }
+    const Token *GetTokens(const Relocation &relocation) const { return tokens + relocation.firstToken; }
+    std::string_view GetName(uint32_t offset, uint32_t length) const { return std::string_view(names + offset, length); }
+
+private:
+    static constexpr uint32_t VERSION = 1;
+
+    MappedFile file;
+    const Header *header = nullptr;
+    const Section *sections = nullptr;
+    const Symbol *symbols = nullptr;
+    const Relocation *relocations = nullptr;
+    const Token *tokens = nullptr;
+    const uint8_t *data = nullptr;
+    const char *names = nullptr;
+};
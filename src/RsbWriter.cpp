@@ -0,0 +1,98 @@
+//
+//  RsbWriter.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <RsbWriter.h>
+
+#ifdef UNIX_HOST
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#else
+#include <fstream>
+#endif
+
+using namespace std;
+
+struct RsbSegmentHeader
+{
+    uint8_t address[4];
+    uint8_t length[4];
+};
+
+bool RsbWriter::Write(const std::vector<Segment>& segments, const char *filename)
+{
+    static const char signature[4] = {'R', 'S', 'X', '0'};
+
+    // the headers are built up front, so the whole file can be described as a list of (pointer, length) pieces
+    vector<RsbSegmentHeader> headers(segments.size());
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        Segment::StoreDword(headers[i].address, segments[i].address);
+        Segment::StoreDword(headers[i].length, (uint32_t)segments[i].data.size());
+    }
+
+#ifdef UNIX_HOST
+    vector<iovec> pieces;
+    pieces.reserve(segments.size() * 2 + 1);
+    pieces.push_back(iovec{(void *)signature, sizeof(signature)});
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        pieces.push_back(iovec{&headers[i], sizeof(RsbSegmentHeader)});
+        if (segments[i].data.empty() == false)
+            pieces.push_back(iovec{(void *)segments[i].data.data(), segments[i].data.size()});
+    }
+
+    const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    // gather-write the pieces, at most IOV_MAX at a time, resuming after short writes
+    size_t first = 0;
+    while (first < pieces.size())
+    {
+        const int count = (int)min(pieces.size() - first, (size_t)IOV_MAX);
+        ssize_t written = writev(fd, &pieces[first], count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            close(fd);
+            return false;
+        }
+
+        while (first < pieces.size() && (size_t)written >= pieces[first].iov_len)
+            written -= pieces[first++].iov_len;
+
+        if (written > 0)
+        {
+            pieces[first].iov_base = (uint8_t *)pieces[first].iov_base + written;
+            pieces[first].iov_len -= written;
+        }
+    }
+
+    return close(fd) == 0;
+#else
+    ofstream outfile(filename, ofstream::binary);
+    if (!outfile)
+        return false;
+
+    outfile.write(signature, sizeof(signature));
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        outfile.write((const char *)&headers[i], sizeof(RsbSegmentHeader));
+        outfile.write((const char *)segments[i].data.data(), segments[i].data.size());
+    }
+
+    outfile.close();
+    return (bool)outfile;
+#endif
+}
@@ -0,0 +1,22 @@
+//
+//  RsbWriter.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <Segment.h>
+#include <vector>
+
+// writes the assembled segments into a RetroSim binary (.rsb) file:
+// "RSX0", then for each segment its address and length (32 bit little endian) followed by its data
+class RsbWriter
+{
+public:
+    // the segment data is written straight from the segments, without copying it into a staging buffer
+    static bool Write(const std::vector<Segment>& segments, const char *filename);
+};
@@ -12,10 +12,29 @@
 
 #include <iostream>
 #include <vector>
+#include <span>
 
 class Segment
 {
 public:
+    // appends 'length' bytes to the end of the segment and returns where to write them
+    uint8_t *Extend(size_t length)
+    {
+        const size_t oldSize = data.size();
+        data.resize(oldSize + length);
+        return data.data() + oldSize;
+    }
+
+    void Reserve(size_t capacity)
+    {
+        data.reserve(capacity);
+    }
+
+    void AddBytes(std::span<const uint8_t> bytes)
+    {
+        data.insert(data.end(), bytes.begin(), bytes.end());
+    }
+
     void AddByte(uint8_t byteToBeAdded)
     {
         data.push_back(byteToBeAdded);
@@ -23,16 +42,12 @@ public:
 
     void AddWord(uint16_t wordToBeAdded)
     {
-        data.push_back(wordToBeAdded & 0xff);
-        data.push_back((wordToBeAdded & 0xff00) >> 8);
+        StoreWord(Extend(2), wordToBeAdded);
     }
 
     void AddDword(uint32_t dwordToBeAdded)
     {
-        data.push_back(dwordToBeAdded & 0xff);
-        data.push_back((dwordToBeAdded & 0xff00) >> 8);
-        data.push_back((dwordToBeAdded & 0xff0000) >> 16);
-        data.push_back((dwordToBeAdded & 0xff000000) >> 24);
+        StoreDword(Extend(4), dwordToBeAdded);
     }
 
     void WriteByte(uint32_t address, uint8_t value)
@@ -42,18 +57,27 @@ public:
 
     void WriteWord(uint32_t address, uint16_t value)
     {
-        uint32_t index = address - this->address;
-        data[index++] = (uint8_t)(value & 0xff);
-        data[index] = (uint8_t)((value & 0xff00) >> 8);
+        StoreWord(&data[address - this->address], value);
     }
 
     void WriteDword(uint32_t address, uint32_t value)
     {
-        uint32_t index = address - this->address;
-        data[index++] = (uint8_t)(value & 0xff);
-        data[index++] = (uint8_t)((value & 0xff00) >> 8);
-        data[index++] = (uint8_t)((value & 0xff0000) >> 16);
-        data[index] = (uint8_t)((value & 0xff000000) >> 24);
+        StoreDword(&data[address - this->address], value);
+    }
+
+    // little endian stores, the compiler merges them into a single move
+    static void StoreWord(uint8_t *destination, uint16_t value)
+    {
+        destination[0] = (uint8_t)(value & 0xff);
+        destination[1] = (uint8_t)((value & 0xff00) >> 8);
+    }
+
+    static void StoreDword(uint8_t *destination, uint32_t value)
+    {
+        destination[0] = (uint8_t)(value & 0xff);
+        destination[1] = (uint8_t)((value & 0xff00) >> 8);
+        destination[2] = (uint8_t)((value & 0xff0000) >> 16);
+        destination[3] = (uint8_t)((value & 0xff000000) >> 24);
     }
 
     std::vector<uint8_t> data;
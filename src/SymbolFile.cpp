@@ -0,0 +1,91 @@
+//
+//  SymbolFile.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <SymbolFile.h>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char signature[4] = {'A', 'S', 'Y', 'M'};
+
+bool SymbolFile::Write(const char *filename, uint64_t sourceHash, const SymbolTable &symbols)
+{
+    vector<Entry> entries;
+    string names;
+    for (uint32_t id = 0; id < symbols.GetSize(); id++)
+    {
+        if (symbols.IsDefined(id) == false)
+            continue;
+
+        const std::string_view name = symbols.GetName(id);
+        entries.push_back(Entry{SymbolTable::Hash(name), (uint32_t)names.size(), (uint32_t)name.size(), symbols.GetValue(id)});
+        names.append(name);
+    }
+
+    Header header;
+    memcpy(header.signature, signature, sizeof(signature));
+    header.version = VERSION;
+    header.sourceHash = sourceHash;
+    header.symbolCount = (uint32_t)entries.size();
+    header.namesSize = (uint32_t)names.size();
+
+    ofstream outfile(filename, ofstream::binary);
+    if (!outfile)
+        return false;
+
+    outfile.write((const char *)&header, sizeof(header));
+    outfile.write((const char *)entries.data(), entries.size() * sizeof(Entry));
+    outfile.write(names.data(), names.size());
+    outfile.close();
+
+    return (bool)outfile;
+}
+
+// FNV-1a
+uint64_t SymbolFile::HashSource(std::string_view source)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char c : source)
+    {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+bool SymbolFile::Open(const char *filename)
+{
+    header = nullptr;
+    if (file.Read(filename) == false) // kept in the cache of LoadSymbolFile(), a mapping would change with the file
+        return false;
+
+    // the entries and the names are used in place, so everything they refer to is checked up front
+    const std::string_view data = file.GetText();
+    if (data.size() < sizeof(Header))
+        return false;
+
+    const Header *fileHeader = (const Header *)data.data();
+    if (memcmp(fileHeader->signature, signature, sizeof(signature)) != 0 || fileHeader->version != VERSION ||
+        data.size() != sizeof(Header) + (uint64_t)fileHeader->symbolCount * sizeof(Entry) + fileHeader->namesSize)
+        return false;
+
+    entries = (const Entry *)(data.data() + sizeof(Header));
+    names = data.data() + sizeof(Header) + fileHeader->symbolCount * sizeof(Entry);
+    for (uint32_t i = 0; i < fileHeader->symbolCount; i++)
+    {
+        if ((uint64_t)entries[i].nameOffset + entries[i].nameLength > fileHeader->namesSize)
+            return false;
+    }
+
+    header = fileHeader;
+    return true;
+}
@@ -0,0 +1,58 @@
+//
+//  SymbolFile.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <MappedFile.h>
+#include <SymbolTable.h>
+#include <cstdint>
+#include <string_view>
+
+// precompiled symbols (.sym): the resolved symbols of a source that only has .def directives, eg. a header of
+// hardware registers. .include "regs.s" loads "regs.sym" instead of assembling regs.s if the file was written from
+// the same content. the file is a build cache in the byte order of the host:
+// the header, then an Entry for each symbol, then the names back to back
+class SymbolFile
+{
+public:
+    struct Header
+    {
+        char signature[4];   // "ASYM"
+        uint32_t version;
+        uint64_t sourceHash; // HashSource() of the source it was written from
+        uint32_t symbolCount;
+        uint32_t namesSize;
+    };
+
+    struct Entry
+    {
+        uint32_t hash;       // SymbolTable::Hash() of the name, so interning doesn't hash it again
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t value;
+    };
+
+    static bool Write(const char *filename, uint64_t sourceHash, const SymbolTable &symbols); // writes the defined symbols
+    static uint64_t HashSource(std::string_view source);
+
+    bool Open(const char *filename); // reads the file, returns false if it's missing or not a valid symbol file
+
+    uint64_t GetSourceHash() const { return header->sourceHash; }
+    uint32_t GetCount() const { return header->symbolCount; }
+    const Entry &GetEntry(uint32_t index) const { return entries[index]; }
+    std::string_view GetName(const Entry &entry) const { return std::string_view(names + entry.nameOffset, entry.nameLength); }
+
+private:
+    static constexpr uint32_t VERSION = 1;
+
+    MappedFile file;
+    const Header *header = nullptr;
+    const Entry *entries = nullptr;
+    const char *names = nullptr;
+};
@@ -0,0 +1,156 @@
+//
+//  SymbolTable.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// interned symbol names. every name gets a dense 32 bit ID on its first appearance, the IDs index
+// flat vectors, and the name -> ID mapping is an open addressing hash table with linear probing
+class SymbolTable
+{
+public:
+    static constexpr uint32_t INVALID_ID = 0xffffffff;
+
+    // returns the ID of the name, adding it to the table if it's not known yet
+    uint32_t Intern(std::string_view name)
+    {
+        return Intern(name, Hash(name));
+    }
+
+    // the same with the hash of the name already known, eg. from a precompiled symbol file
+    uint32_t Intern(std::string_view name, uint32_t hash)
+    {
+        if ((symbols.size() + 1) * 2 > slots.size())
+            Grow();
+
+        const size_t mask = slots.size() - 1;
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            Slot &slot = slots[i];
+            if (slot.id == INVALID_ID)
+            {
+                slot.id = (uint32_t)symbols.size();
+                slot.hash = hash;
+                symbols.push_back(Symbol{(uint32_t)names.size(), (uint32_t)name.size(), 0, false});
+                names.append(name);
+                return slot.id;
+            }
+
+            if (slot.hash == hash && GetName(slot.id) == name)
+                return slot.id;
+        }
+    }
+
+    // returns the ID of the name, or INVALID_ID if it has never been interned
+    uint32_t Find(std::string_view name) const
+    {
+        if (slots.empty())
+            return INVALID_ID;
+
+        const uint32_t hash = Hash(name);
+        const size_t mask = slots.size() - 1;
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const Slot &slot = slots[i];
+            if (slot.id == INVALID_ID)
+                return INVALID_ID;
+
+            if (slot.hash == hash && GetName(slot.id) == name)
+                return slot.id;
+        }
+    }
+
+    void Define(uint32_t id, uint32_t value)
+    {
+        symbols[id].value = value;
+        symbols[id].isDefined = true;
+    }
+
+    bool IsDefined(uint32_t id) const
+    {
+        return symbols[id].isDefined;
+    }
+
+    uint32_t GetValue(uint32_t id) const
+    {
+        return symbols[id].value;
+    }
+
+    std::string_view GetName(uint32_t id) const
+    {
+        return std::string_view(names).substr(symbols[id].nameOffset, symbols[id].nameLength);
+    }
+
+    uint32_t GetSize() const
+    {
+        return (uint32_t)symbols.size();
+    }
+
+    void Clear()
+    {
+        symbols.clear();
+        names.clear();
+        slots.assign(slots.size(), Slot());
+    }
+
+    // FNV-1a
+    static uint32_t Hash(std::string_view name)
+    {
+        uint64_t hash = 0xcbf29ce484222325;
+        for (const char c : name)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 0x100000001b3;
+        }
+        return (uint32_t)(hash ^ (hash >> 32));
+    }
+
+private:
+    struct Symbol
+    {
+        uint32_t nameOffset; // position of the name in 'names'
+        uint32_t nameLength;
+        uint32_t value;
+        bool isDefined;
+    };
+
+    struct Slot
+    {
+        uint32_t hash = 0;
+        uint32_t id = INVALID_ID;
+    };
+
+    // doubles the number of slots (keeping the load factor below 1/2) and reinserts the IDs
+    void Grow()
+    {
+        std::vector<Slot> oldSlots(slots.empty() ? 64 : slots.size() * 2);
+        oldSlots.swap(slots);
+
+        const size_t mask = slots.size() - 1;
+        for (const Slot &oldSlot : oldSlots)
+        {
+            if (oldSlot.id == INVALID_ID)
+                continue;
+
+            size_t i = oldSlot.hash & mask;
+            while (slots[i].id != INVALID_ID)
+                i = (i + 1) & mask;
+            slots[i] = oldSlot;
+        }
+    }
+
+    std::vector<Symbol> symbols; // indexed by ID
+    std::string names;           // all names, back to back
+    std::vector<Slot> slots;
+};
@@ -0,0 +1,229 @@
+//
+//  Bench.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+#include <bench/SourceGenerator.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef UNIX_HOST
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    // the settings of a run, see PrintUsage()
+    struct BenchOptions
+    {
+        std::vector<SourceGenerator::Scenario> scenarios;
+        size_t minLines = 10000;
+        size_t maxLines = 1000000;
+        uint64_t seed = 1;
+        unsigned int repeat = 3;
+        unsigned int threadCount = 0;
+        bool relaxJumps = false;
+        bool optimize = false;
+    };
+
+    void PrintUsage()
+    {
+        printf("Usage: AsmA65k-bench [options]\n");
+        printf("  --scenario <name>     instructions, data, defines, branches or mixed (default: all of them)\n");
+        printf("  --min-lines <count>   the smallest source (default: 10000)\n");
+        printf("  --max-lines <count>   the largest source, the sizes grow tenfold (default: 1000000)\n");
+        printf("  --seed <number>       the seed of the generator (default: 1)\n");
+        printf("  --repeat <count>      assemblies per source, the fastest one is reported (default: 3)\n");
+        printf("  -j <count>            encoder threads (default: one per hardware thread)\n");
+        printf("  --relax, -O           the same as for AsmA65k\n");
+        printf("  --emit <scenario> <lines> <file>  writes a generated source and exits\n");
+        printf("Prints one JSON object per line for every scenario and size.\n");
+    }
+
+    bool ParseCount(const char *text, size_t &count)
+    {
+        char *end;
+        const unsigned long long value = strtoull(text, &end, 10);
+        if (end == text || *end != 0 || value == 0)
+            return false;
+
+        count = (size_t)value;
+        return true;
+    }
+
+    long GetPeakRss() // in kilobytes, -1 if unknown
+    {
+#ifdef UNIX_HOST
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return -1;
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return -1;
+#endif
+    }
+
+    // generates and assembles one source, and prints its results. returns false on an assembly error
+    bool RunBenchmark(const BenchOptions &options, SourceGenerator::Scenario scenario, size_t lineCount)
+    {
+        const std::string source = SourceGenerator::Generate(scenario, lineCount, options.seed);
+
+        AsmA65k asm65k;
+        asm65k.SetEncoderThreadCount(options.threadCount);
+        asm65k.SetJumpRelaxation(options.relaxJumps);
+        asm65k.SetOptimization(options.optimize);
+
+        double bestSeconds = 0;
+        size_t outputBytes = 0;
+        for (unsigned int i = 0; i < options.repeat; i++)
+        {
+            std::vector<Segment> *segments;
+            const auto start = std::chrono::steady_clock::now();
+            try
+            {
+                segments = asm65k.Assemble(source);
+            }
+            catch (const AsmError &error)
+            {
+                fprintf(stderr, "%s, %zu lines: assembly error in line %u: \"%s\"\nin line: %s\n", SourceGenerator::GetScenarioName(scenario), lineCount,
+                        error.lineNumber, error.errorMessage.c_str(), error.lineContent.c_str());
+                return false;
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (i == 0 || seconds < bestSeconds)
+                bestSeconds = seconds;
+
+            outputBytes = 0;
+            for (const Segment &segment : *segments)
+                outputBytes += segment.data.size();
+        }
+
+        printf("{\"scenario\": \"%s\", \"lines\": %zu, \"source_bytes\": %zu, \"output_bytes\": %zu, \"seconds\": %.6f, "
+               "\"lines_per_sec\": %.0f, \"bytes_per_sec\": %.0f, \"peak_rss_kb\": %ld}\n",
+               SourceGenerator::GetScenarioName(scenario), lineCount, source.size(), outputBytes, bestSeconds,
+               lineCount / bestSeconds, source.size() / bestSeconds, GetPeakRss());
+        fflush(stdout);
+        return true;
+    }
+
+    // the peak RSS of a process never goes down, so every benchmark gets a process of its own where possible
+    bool RunIsolated(const BenchOptions &options, SourceGenerator::Scenario scenario, size_t lineCount)
+    {
+#ifdef UNIX_HOST
+        fflush(stdout);
+        const pid_t child = fork();
+        if (child == 0)
+            _exit(RunBenchmark(options, scenario, lineCount) ? 0 : 1);
+        if (child < 0)
+            return RunBenchmark(options, scenario, lineCount);
+
+        int status;
+        if (waitpid(child, &status, 0) != child)
+            return false;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+        return RunBenchmark(options, scenario, lineCount);
+#endif
+    }
+
+    int Emit(const char *scenarioName, const char *lineText, const char *filename, uint64_t seed)
+    {
+        SourceGenerator::Scenario scenario;
+        size_t lineCount;
+        if (SourceGenerator::FindScenario(scenarioName, scenario) == false || ParseCount(lineText, lineCount) == false)
+        {
+            PrintUsage();
+            return -1;
+        }
+
+        const std::string source = SourceGenerator::Generate(scenario, lineCount, seed);
+        FILE *file = fopen(filename, "wb");
+        if (file == nullptr || fwrite(source.data(), 1, source.size(), file) != source.size())
+        {
+            printf("Could not write file '%s'\n", filename);
+            if (file != nullptr)
+                fclose(file);
+            return -1;
+        }
+
+        fclose(file);
+        return 0;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+        const bool hasValue = i + 1 < argc;
+        size_t count;
+
+        if (strcmp(option, "--scenario") == 0 && hasValue)
+        {
+            SourceGenerator::Scenario scenario;
+            if (SourceGenerator::FindScenario(argv[++i], scenario) == false)
+            {
+                printf("Unknown scenario: '%s'\n", argv[i]);
+                return -1;
+            }
+            options.scenarios.push_back(scenario);
+        }
+        else if (strcmp(option, "--min-lines") == 0 && hasValue && ParseCount(argv[i + 1], count))
+            options.minLines = count, i++;
+        else if (strcmp(option, "--max-lines") == 0 && hasValue && ParseCount(argv[i + 1], count))
+            options.maxLines = count, i++;
+        else if (strcmp(option, "--seed") == 0 && hasValue && ParseCount(argv[i + 1], count))
+            options.seed = count, i++;
+        else if (strcmp(option, "--repeat") == 0 && hasValue && ParseCount(argv[i + 1], count))
+            options.repeat = (unsigned int)count, i++;
+        else if (strcmp(option, "-j") == 0 && hasValue && ParseCount(argv[i + 1], count))
+            options.threadCount = (unsigned int)count, i++;
+        else if (strcmp(option, "--relax") == 0)
+            options.relaxJumps = true;
+        else if (strcmp(option, "-O") == 0)
+            options.optimize = true;
+        else if (strcmp(option, "--emit") == 0 && i + 3 < argc)
+            return Emit(argv[i + 1], argv[i + 2], argv[i + 3], options.seed);
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if (options.scenarios.empty())
+    {
+        for (int i = 0; i < SourceGenerator::SCENARIO_COUNT; i++)
+            options.scenarios.push_back((SourceGenerator::Scenario)i);
+    }
+
+    bool succeeded = true;
+    for (SourceGenerator::Scenario scenario : options.scenarios)
+    {
+        for (size_t lineCount = options.minLines; lineCount <= options.maxLines; lineCount *= 10)
+            succeeded &= RunIsolated(options, scenario, lineCount);
+    }
+
+    return succeeded ? 0 : -1;
+}
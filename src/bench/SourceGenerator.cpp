@@ -0,0 +1,447 @@
+//
+//  SourceGenerator.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <bench/SourceGenerator.h>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    const char *scenarioNames[] = {"instructions", "data", "defines", "branches", "mixed"};
+
+    const char *impliedMnemonics[] = {"nop", "sei", "cli", "sec", "clc", "sev", "clv", "pusha", "popa"};
+    const char *unaryMnemonics[] = {"inc", "dec", "clr", "push", "pop"};
+    const char *binaryMnemonics[] = {"mov", "add", "sub", "and", "or", "xor", "cmp", "shl", "shr", "rol", "ror"};
+    const char *branchMnemonics[] = {"bra", "beq", "bne", "bcc", "bcs", "bpl", "bmi", "bvc", "bvs", "blt", "bgt", "ble", "bge"};
+    const char *sizeModifiers[] = {"", ".w", ".b"};
+
+    constexpr int OPERAND_FORM_COUNT = 38;
+    constexpr uint32_t DEFINE_CHAIN_LENGTH = 256; // keeps the .def values within 16 bits
+}
+
+const char *SourceGenerator::GetScenarioName(Scenario scenario)
+{
+    return scenarioNames[scenario];
+}
+
+bool SourceGenerator::FindScenario(const char *name, Scenario &scenario)
+{
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+    {
+        if (strcmp(name, scenarioNames[i]) == 0)
+        {
+            scenario = (Scenario)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string SourceGenerator::Generate(Scenario scenario, size_t lineCount, uint64_t seed)
+{
+    SourceGenerator generator(scenario, seed);
+    std::string &text = generator.text;
+    text.reserve(lineCount * 28);
+
+    text += "; generated by AsmA65k-bench, scenario: ";
+    text += scenarioNames[scenario];
+    text += ", seed: " + to_string(seed) + "\n";
+    text += ".def d0 = $1000\n";
+    text += ".pc = $1000\n";
+    generator.defineCount = 1;
+
+    for (size_t i = 3; i < lineCount; i++)
+        generator.AddLine();
+
+    // the forward branches of the last block refer to the labels after it
+    const uint32_t lastLine = (generator.lineIndex / LINES_PER_BLOCK + 1) * LINES_PER_BLOCK;
+    for (uint32_t i = generator.lineIndex; i <= lastLine; i++)
+    {
+        if (i % 8 == 0)
+        {
+            generator.AddBlockLabel(i / LINES_PER_BLOCK, (i % LINES_PER_BLOCK) / 8);
+            text += "rts\n";
+        }
+    }
+
+    return std::move(text);
+}
+
+uint32_t SourceGenerator::Random(uint32_t range)
+{
+    state += 0x9e3779b97f4a7c15;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z ^= z >> 31;
+
+    return range == 0 ? (uint32_t)z : (uint32_t)(z % range);
+}
+
+// every line of the code gets a position in a block. the first line of every 8 gets a label,
+// these are the targets of the forward branches
+void SourceGenerator::AddLine()
+{
+    const uint32_t block = lineIndex / LINES_PER_BLOCK;
+    const uint32_t position = lineIndex % LINES_PER_BLOCK;
+    const bool hasLabel = position % 8 == 0;
+
+    if (hasLabel)
+        AddBlockLabel(block, position / 8);
+    else
+        text += "        ";
+
+    const uint32_t choice = Random(100);
+    switch (scenario)
+    {
+    case SCENARIO_INSTRUCTIONS:
+        AddOperandForm();
+        break;
+
+    case SCENARIO_DATA:
+        if (choice < 90 && hasLabel == false)
+            AddData();
+        else
+            AddOperandForm();
+        break;
+
+    case SCENARIO_DEFINES:
+        if (choice < 50)
+            AddDefine();
+        else
+            AddInstruction();
+        break;
+
+    case SCENARIO_BRANCHES:
+        if (choice < 70)
+            AddBranch();
+        else
+            AddOperandForm();
+        break;
+
+    default:
+        if (choice < 50)
+            AddOperandForm();
+        else if (choice < 65 && hasLabel == false)
+            AddData();
+        else if (choice < 75)
+            AddDefine();
+        else
+            AddBranch();
+        break;
+    }
+
+    text += '\n';
+    lineIndex++;
+}
+
+// an instruction using the .def symbols
+void SourceGenerator::AddInstruction()
+{
+    switch (Random(4))
+    {
+    case 0: // mov r0, d12
+        text += binaryMnemonics[Random(sizeof(binaryMnemonics) / sizeof(binaryMnemonics[0]))];
+        text += ".w ";
+        AddRegister();
+        text += ", ";
+        AddDefineLabel();
+        break;
+    case 1: // inc [d12 + r0]
+        text += unaryMnemonics[Random(sizeof(unaryMnemonics) / sizeof(unaryMnemonics[0]))];
+        text += " [";
+        AddDefineLabel();
+        text += " + ";
+        AddRegister();
+        text += "]";
+        break;
+    case 2: // sys d12, $10
+        text += "sys ";
+        AddDefineLabel();
+        text += ", ";
+        AddConstant(0);
+        break;
+    default: // mov r0, [r1 + d12]
+        text += "mov ";
+        AddRegister();
+        text += ", [";
+        AddRegister();
+        text += " + ";
+        AddDefineLabel();
+        text += "]";
+        break;
+    }
+}
+
+// one of the forms of OperandTypes, with a random instruction that allows it
+void SourceGenerator::AddOperandForm()
+{
+    const uint32_t form = Random(OPERAND_FORM_COUNT);
+    const char *unary = unaryMnemonics[Random(sizeof(unaryMnemonics) / sizeof(unaryMnemonics[0]))];
+    const char *binary = binaryMnemonics[Random(sizeof(binaryMnemonics) / sizeof(binaryMnemonics[0]))];
+    int sizeIndex = 0;
+
+    if (form == 0) // nop
+    {
+        text += impliedMnemonics[Random(sizeof(impliedMnemonics) / sizeof(impliedMnemonics[0]))];
+        return;
+    }
+
+    if (form == 1) // push.w $1234
+    {
+        text += "push";
+        sizeIndex = AddSizeModifier();
+        text += ' ';
+        AddConstant(sizeIndex);
+        return;
+    }
+
+    if (form >= 34) // sys
+    {
+        text += "sys ";
+        if (form == 34 || form == 35)
+            AddConstant(1);
+        else
+            AddDefineLabel();
+        text += ", ";
+        if (form == 34 || form == 37)
+            AddTableLabel();
+        else
+            AddConstant(0);
+        return;
+    }
+
+    if (form <= 9) // unary
+    {
+        text += unary;
+        sizeIndex = AddSizeModifier();
+        text += ' ';
+        switch (form)
+        {
+        case 2: AddRegister(); break;                                                               // r0
+        case 3: text += '['; AddConstant(0); text += ']'; break;                                    // [$1234]
+        case 4: text += '['; AddRegister(); text += ']'; break;                                     // [r0]
+        case 5: text += '['; AddTableLabel(); text += ']'; break;                                   // [t12]
+        case 6: text += '['; AddRegister(); text += " + "; AddConstant(1); text += ']'; break;      // [r0 + 10]
+        case 7: text += '['; AddConstant(0); text += " + "; AddRegister(); text += ']'; break;      // [$1000 + r0]
+        case 8: text += '['; AddRegister(); text += " + "; AddTableLabel(); text += ']'; break;     // [r0 + t12]
+        default: text += '['; AddTableLabel(); text += " + "; AddRegister(); text += ']'; break;    // [t12 + r0]
+        }
+        return;
+    }
+
+    // binary. a label as immediate value has 32 bits, so it goes without a size modifier
+    text += binary;
+    if (form != 12 && form != 28 && form != 30 && form != 32)
+        sizeIndex = AddSizeModifier();
+    text += ' ';
+
+    switch (form)
+    {
+    case 10: AddRegister(); text += ", "; AddRegister(); break;                                          // r0, r1
+    case 11: AddRegister(); text += ", "; AddConstant(sizeIndex); break;                                // r0, 1234
+    case 12: AddRegister(); text += ", "; AddTableLabel(); break;                                       // r0, t12
+    case 13:                                                                                            // r0, [r1]+
+        AddRegister();
+        text += ", [";
+        AddRegister();
+        text += ']';
+        if (Random(4) == 0)
+            text += Random(2) ? '+' : '-';
+        break;
+    case 14: AddRegister(); text += ", ["; AddTableLabel(); text += ']'; break;                          // r0, [t12]
+    case 15: AddRegister(); text += ", ["; AddConstant(0); text += ']'; break;                           // r0, [$1234]
+    case 16: AddRegister(); text += ", ["; AddRegister(); text += " + "; AddConstant(1); text += ']'; break;   // r0, [r1 + 10]
+    case 17: AddRegister(); text += ", ["; AddRegister(); text += " + "; AddTableLabel(); text += ']'; break;  // r0, [r1 + t12]
+    case 18: AddRegister(); text += ", ["; AddConstant(0); text += " + "; AddRegister(); text += ']'; break;   // r0, [$1000 + r1]
+    case 19: AddRegister(); text += ", ["; AddTableLabel(); text += " + "; AddRegister(); text += ']'; break;  // r0, [t12 + r1]
+    case 20: text += '['; AddRegister(); text += "], "; AddRegister(); break;                                 // [r0], r1
+    case 21: text += '['; AddTableLabel(); text += "], "; AddRegister(); break;                               // [t12], r0
+    case 22: text += '['; AddConstant(0); text += "], "; AddRegister(); break;                                // [$1234], r0
+    case 23: text += '['; AddRegister(); text += " + "; AddTableLabel(); text += "], "; AddRegister(); break;  // [r0 + t12], r1
+    case 24: text += '['; AddRegister(); text += " + "; AddConstant(1); text += "], "; AddRegister(); break;   // [r0 + 10], r1
+    case 25: text += '['; AddTableLabel(); text += " + "; AddRegister(); text += "], "; AddRegister(); break;  // [t12 + r0], r1
+    case 26: text += '['; AddConstant(0); text += " + "; AddRegister(); text += "], "; AddRegister(); break;   // [$1000 + r0], r1
+    case 27: text += '['; AddRegister(); text += "], "; AddConstant(sizeIndex); break;                        // [r0], 64
+    case 28: text += '['; AddTableLabel(); text += "], "; AddConstant(sizeIndex); break;                      // [t12], 64
+    case 29: text += '['; AddConstant(0); text += "], "; AddConstant(sizeIndex); break;                       // [$1234], 64
+    case 30: text += '['; AddRegister(); text += " + "; AddTableLabel(); text += "], "; AddConstant(sizeIndex); break;   // [r0 + t12], 64
+    case 31: text += '['; AddRegister(); text += " + "; AddConstant(1); text += "], "; AddConstant(sizeIndex); break;    // [r0 + 10], 64
+    case 32: text += '['; AddTableLabel(); text += " + "; AddRegister(); text += "], "; AddConstant(sizeIndex); break;   // [t12 + r0], 64
+    default: text += '['; AddConstant(0); text += " + "; AddRegister(); text += "], "; AddConstant(sizeIndex); break;    // [$1000 + r0], 64
+    }
+}
+
+// a labelled data table between the instructions
+void SourceGenerator::AddData()
+{
+    text.resize(text.size() - 8); // the label takes the place of the indentation
+    text += "t" + to_string(tableCount++) + ": ";
+
+    const uint32_t kind = Random(4);
+    const int count = 1 + (int)Random(8);
+    switch (kind)
+    {
+    case 0: // .byte 1, $ff, %101
+        text += ".byte ";
+        for (int i = 0; i < count; i++)
+        {
+            if (i > 0)
+                text += ", ";
+            AddConstant(2);
+        }
+        break;
+    case 1: // .word $1234, d12
+        text += ".word ";
+        for (int i = 0; i < count; i++)
+        {
+            if (i > 0)
+                text += ", ";
+            if (Random(2))
+                AddDefineLabel();
+            else
+                AddConstant(1);
+        }
+        break;
+    case 2: // .dword $12345678, t12, b34_1
+        text += ".dword ";
+        for (int i = 0; i < count; i++)
+        {
+            if (i > 0)
+                text += ", ";
+            const uint32_t element = Random(3);
+            if (element == 0)
+                AddConstant(0);
+            else if (element == 1)
+                AddTableLabel();
+            else // forward reference
+            {
+                AddBlockLabel(lineIndex / LINES_PER_BLOCK + 1, 0);
+                text.resize(text.size() - 2);
+            }
+        }
+        break;
+    default:
+        text += Random(2) ? ".text \"" : ".textz \"";
+        for (int i = 0; i < count * 3; i++)
+            text += (char)('a' + Random(26));
+        text += '"';
+        break;
+    }
+}
+
+// the .def symbols form chains, each refers to the one before it
+void SourceGenerator::AddDefine()
+{
+    text += ".def d" + to_string(defineCount) + " = ";
+    if (defineCount % DEFINE_CHAIN_LENGTH == 0)
+        text += "$1000";
+    else
+        text += "d" + to_string(defineCount - 1) + " + " + to_string(1 + Random(4));
+    defineCount++;
+}
+
+void SourceGenerator::AddBranch()
+{
+    const uint32_t block = lineIndex / LINES_PER_BLOCK;
+    const uint32_t position = lineIndex % LINES_PER_BLOCK;
+    const uint32_t choice = Random(10);
+
+    if (choice < 7) // forward branch to the next label
+    {
+        text += branchMnemonics[Random(sizeof(branchMnemonics) / sizeof(branchMnemonics[0]))];
+        text += ' ';
+    }
+    else if (choice < 9) // call of an earlier block
+    {
+        text += "jsr ";
+        AddBlockLabel(Random(block + 1), 0);
+        text.resize(text.size() - 2);
+        return;
+    }
+    else
+        text += "jmp ";
+
+    if (position / 8 + 1 < LINES_PER_BLOCK / 8)
+        AddBlockLabel(block, position / 8 + 1);
+    else
+        AddBlockLabel(block + 1, 0);
+    text.resize(text.size() - 2); // the ": "
+}
+
+void SourceGenerator::AddRegister()
+{
+    text += 'r';
+    text += to_string(Random(14));
+}
+
+void SourceGenerator::AddConstant(int sizeIndex)
+{
+    static constexpr uint32_t masks[] = {0xffffffff, 0xffff, 0xff};
+    const uint32_t value = Random(0) & masks[sizeIndex];
+    char buffer[40];
+
+    switch (Random(3))
+    {
+    case 0:
+        snprintf(buffer, sizeof(buffer), "%u", value);
+        break;
+    case 1:
+        snprintf(buffer, sizeof(buffer), "$%x", value);
+        break;
+    default: // binary, kept short
+    {
+        const uint32_t small = value & 0xff;
+        int length = 0;
+        buffer[length++] = '%';
+        for (int bit = 7; bit >= 0; bit--)
+            buffer[length++] = (small >> bit) & 1 ? '1' : '0';
+        buffer[length] = 0;
+        break;
+    }
+    }
+
+    text += buffer;
+}
+
+void SourceGenerator::AddTableLabel()
+{
+    if (tableCount == 0) // no table yet, the .def symbols are labels too
+    {
+        AddDefineLabel();
+        return;
+    }
+
+    const uint32_t first = tableCount > TABLE_HISTORY ? tableCount - TABLE_HISTORY : 0;
+    text += 't';
+    text += to_string(first + Random(tableCount - first));
+}
+
+void SourceGenerator::AddDefineLabel()
+{
+    text += 'd';
+    text += to_string(Random(defineCount));
+}
+
+int SourceGenerator::AddSizeModifier()
+{
+    const int sizeIndex = (int)Random(3);
+    text += sizeModifiers[sizeIndex];
+    return sizeIndex;
+}
+
+void SourceGenerator::AddBlockLabel(uint32_t block, uint32_t index)
+{
+    text += 'b';
+    text += to_string(block);
+    text += '_';
+    text += to_string(index);
+    text += ": ";
+}
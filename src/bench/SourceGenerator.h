@@ -0,0 +1,62 @@
+//
+//  SourceGenerator.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// generates valid A65000 sources of any size for the benchmarks. the output only depends on the
+// scenario, the line count and the seed, so the runs of different builds can be compared
+class SourceGenerator
+{
+public:
+    enum Scenario
+    {
+        SCENARIO_INSTRUCTIONS, // every operand form of the instruction set
+        SCENARIO_DATA,         // .byte/.word/.dword tables and .text
+        SCENARIO_DEFINES,      // chains of .def symbols and their uses
+        SCENARIO_BRANCHES,     // forward branches, jsr and jmp
+        SCENARIO_MIXED,        // all of the above
+        SCENARIO_COUNT
+    };
+
+    static const char *GetScenarioName(Scenario scenario);
+    static bool FindScenario(const char *name, Scenario &scenario);
+
+    static std::string Generate(Scenario scenario, size_t lineCount, uint64_t seed);
+
+private:
+    SourceGenerator(Scenario scenario, uint64_t seed) : scenario(scenario), state(seed) {}
+
+    static constexpr int LINES_PER_BLOCK = 32; // code is generated in blocks, with a label every 8 lines
+    static constexpr int TABLE_HISTORY = 64;   // instructions refer to the last this many data tables
+
+    uint32_t Random(uint32_t range); // splitmix64, in [0, range)
+    void AddLine();
+    void AddInstruction();
+    void AddOperandForm();
+    void AddData();
+    void AddDefine();
+    void AddBranch();
+
+    void AddRegister();
+    void AddConstant(int sizeIndex); // fits into the size: 0 = 32 bits, 1 = 16 bits, 2 = 8 bits
+    void AddTableLabel();
+    void AddDefineLabel();
+    int AddSizeModifier();           // returns the size index of the modifier it added
+    void AddBlockLabel(uint32_t block, uint32_t index);
+
+    Scenario scenario;
+    uint64_t state;
+    std::string text;
+    uint32_t lineIndex = 0; // within the code, for the block labels
+    uint32_t tableCount = 0;
+    uint32_t defineCount = 0;
+};
@@ -0,0 +1,119 @@
+//
+//  Link.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+#include <RsbWriter.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    void PrintUsage()
+    {
+        printf("Usage: AsmA65k-link [--base <address>] [-o <output.rsb>] [--all-errors] <object.o> ...\n");
+        printf("       --base: the address of the relocatable sections, $hex or decimal. 0 by default\n");
+        printf("       -o: the output file, the first object with .rsb by default\n");
+        printf("       --all-errors: report every unresolved relocation instead of stopping at the first one\n");
+    }
+
+    // "Link error in prog.s:12: "Undefined label: print"" followed by the line, or the object file for errors of the whole file
+    void PrintLinkError(const AsmError &error)
+    {
+        if (error.lineNumber == 0)
+        {
+            printf("Link error in %s: \"%s\"\n", error.fileName.c_str(), error.errorMessage.c_str());
+            return;
+        }
+
+        printf("Link error in %s:%u: \"%s\"\n", error.fileName.c_str(), error.lineNumber, error.errorMessage.c_str());
+        printf("in line: %s\n", error.lineContent.c_str());
+    }
+
+    bool ParseAddress(const char *text, uint32_t &address)
+    {
+        const bool isHex = text[0] == '$';
+        char *end = nullptr;
+        const unsigned long long value = strtoull(text + isHex, &end, isHex ? 16 : 0);
+        if (end == text + isHex || *end != '\0' || value > 0xffffffffull)
+            return false;
+
+        address = (uint32_t)value;
+        return true;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    vector<string> objectFiles;
+    string outfilename;
+    uint32_t baseAddress = 0;
+    bool collectErrors = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc)
+        {
+            if (ParseAddress(argv[++i], baseAddress) == false)
+            {
+                printf("Invalid base address '%s'\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outfilename = argv[++i];
+        else if (strcmp(argv[i], "--all-errors") == 0)
+            collectErrors = true;
+        else
+            objectFiles.push_back(argv[i]);
+    }
+
+    if (objectFiles.empty())
+    {
+        PrintUsage();
+        return -1;
+    }
+    if (outfilename.empty())
+        outfilename = filesystem::path(objectFiles[0]).replace_extension(".rsb").string();
+
+    AsmA65k linker;
+    linker.SetErrorCollection(collectErrors);
+    vector<Segment> *segments;
+    try
+    {
+        segments = linker.Link(objectFiles, baseAddress);
+    }
+    catch (const AsmError &error)
+    {
+        PrintLinkError(error);
+        return 1;
+    }
+
+    if (linker.GetErrors().empty() == false)
+    {
+        for (const AsmError &error : linker.GetErrors())
+            PrintLinkError(error);
+        printf("%zu errors\n", linker.GetErrors().size());
+        return 1;
+    }
+
+    if (RsbWriter::Write(*segments, outfilename.c_str()) == false)
+    {
+        printf("Could not write file '%s'\n", outfilename.c_str());
+        return 1;
+    }
+
+    printf("Output: '%s'\n", outfilename.c_str());
+    return 0;
+}
@@ -9,12 +9,44 @@
 //
 
 #include <Asm65k.h>
+#include <MappedFile.h>
+#include <RsbWriter.h>
+#include <AsmServer.h>
 #include <iostream>
-#include <sstream>
-#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <new>
+#include <cstdlib>
+#include <cstring>
 
 using namespace std;
 
+// every allocation of the process is counted for --stats
+static std::atomic<uint64_t> allocationCount = 0;
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = malloc(size != 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
 void logger(const char *format, ...)
 {
     va_list args;
@@ -23,75 +55,431 @@ void logger(const char *format, ...)
     va_end(args);
 }
 
-void WriteFile(std::vector<Segment> *segments, const char *filename)
+std::string GetOutputFilename(const char *filename)
 {
     std::string outfilename = filename;
     size_t lastindex = outfilename.find_last_of(".");
     outfilename = outfilename.substr(0, lastindex);
     outfilename += ".rsb"; // RetroSim binary
-    std::ofstream outfile(outfilename, std::ofstream::binary);
 
-    outfile.write("RSX0", 4);
+    return outfilename;
+}
 
-    for (int i = 0; i < segments->size(); i++)
+void WriteFile(std::vector<Segment> *segments, const char *filename)
+{
+    const std::string outfilename = GetOutputFilename(filename);
+
+    if (RsbWriter::Write(*segments, outfilename.c_str()) == false)
     {
-        Segment actSegment = (*segments)[i];
-        uint32_t address = actSegment.address;
-        uint32_t length = actSegment.data.size();
-        outfile.write((char *)&address, 4);
-        outfile.write((char *)&length, 4);
-        outfile.write((char *)&actSegment.data[0], actSegment.data.size());
+        printf("Could not write file '%s'\n", outfilename.c_str());
+        return;
     }
 
-    outfile.close();
+    printf("Output: '%s'\n", outfilename.c_str());
+}
+
+// "prog.o" for "prog.s", the relocatable object written with -c
+std::string GetObjectFilename(const char *filename)
+{
+    return std::filesystem::path(filename).replace_extension(".o").string();
+}
+
+// "Assembly error in line 12, column 5: "Invalid opcode"" followed by the line. an error in an included
+// file gives the file ("in regs.s:12") and the lines that included it or expanded the macro
+std::string FormatAsmError(const AsmError &error)
+{
+    std::string text = "Assembly error in ";
+    text += error.fileName.empty() ? "line " + std::to_string(error.lineNumber) : error.fileName + ":" + std::to_string(error.lineNumber);
+    if (error.column != 0)
+        text += ", column " + std::to_string(error.column);
+    text += ": \"" + error.errorMessage + "\"\n";
+    text += "in line: " + error.lineContent + "\n";
+    for (const AsmSourceLocation &location : error.includeStack)
+        text += (location.isMacro ? "expanded from " : "included from ") + location.fileName + ":" + std::to_string(location.lineNumber) + "\n";
+
+    return text;
+}
+
+// writes the symbols of an assembled header next to it, "regs.sym" for "regs.s"
+int WriteSymbolFile(const AsmA65k &asm65k, std::string_view source, const char *filename)
+{
+    if (asm65k.IsSymbolOnly() == false)
+    {
+        printf("Symbols can't be precompiled from '%s', it may only have .def directives without '*', no .include and no .macro\n", filename);
+        return 1;
+    }
+
+    const std::string outfilename = std::filesystem::path(filename).replace_extension(".sym").string();
+    if (asm65k.WriteSymbolFile(outfilename.c_str(), source) == false)
+    {
+        printf("Could not write file '%s'\n", outfilename.c_str());
+        return 1;
+    }
 
     printf("Output: '%s'\n", outfilename.c_str());
+    return 0;
+}
+
+// prints the statistics of an assembly as a single JSON object to stderr, keeping stdout for the usual output
+void PrintStats(const AsmStats &stats, double outputSeconds, uint64_t allocations)
+{
+    fprintf(stderr, "{\"phases\": {\"sizing\": %.6f, \"lexing\": %.6f, \"directives\": %.6f, \"operands\": %.6f, \"optimizer\": %.6f, "
+                    "\"encoding\": %.6f, \"fixups\": %.6f, \"output\": %.6f}, ",
+            stats.sizingSeconds, stats.lexingSeconds, stats.directiveSeconds, stats.operandSeconds, stats.optimizerSeconds,
+            stats.encodingSeconds, stats.fixupSeconds, outputSeconds);
+    fprintf(stderr, "\"sizing_passes\": %u, \"lines\": %llu, \"instructions\": %llu, \"directives\": %llu, \"symbols\": %llu, "
+                    "\"fixups\": %llu, \"cached_statements\": %llu, \"output_bytes\": %llu, \"allocations\": %llu, \"operand_types\": {",
+            stats.sizingPasses, (unsigned long long)stats.lines, (unsigned long long)stats.instructions, (unsigned long long)stats.directives,
+            (unsigned long long)stats.symbols, (unsigned long long)stats.fixups, (unsigned long long)stats.cachedStatements,
+            (unsigned long long)stats.outputBytes, (unsigned long long)allocations);
+
+    bool isFirst = true;
+    for (int i = 0; i < AsmStats::OPERAND_TYPE_COUNT; i++)
+    {
+        if (stats.operandTypes[i] == 0)
+            continue;
+        fprintf(stderr, "%s\"%s\": %llu", isFirst ? "" : ", ", AsmA65k::GetOperandTypeName(i), (unsigned long long)stats.operandTypes[i]);
+        isFirst = false;
+    }
+    fprintf(stderr, "}}\n");
+}
+
+// one input of a batch run. the messages are collected and printed in input order once all files are done
+struct BatchJob
+{
+    std::string filename;
+    std::string log;
+    bool relaxJumps = false;
+    bool optimize = false;
+    bool collectErrors = false;
+    bool writeObject = false;
+    bool succeeded = false;
+};
+
+void AssembleBatchJob(BatchJob &job, AsmA65k &asm65k)
+{
+    MappedFile sourceFile;
+    if (sourceFile.Open(job.filename.c_str()) == false || sourceFile.GetText().empty())
+    {
+        job.log = "Could not load file '" + job.filename + "'\n";
+        return;
+    }
+
+    asm65k.SetJumpRelaxation(job.relaxJumps);
+    asm65k.SetOptimization(job.optimize);
+    asm65k.SetErrorCollection(job.collectErrors);
+    asm65k.SetRelocatable(job.writeObject);
+    std::vector<Segment> *segments;
+    try
+    {
+        segments = asm65k.Assemble(sourceFile.GetText(), job.filename);
+    }
+    catch (const AsmError &error)
+    {
+        job.log = job.filename + ": " + FormatAsmError(error);
+        return;
+    }
+
+    if (asm65k.GetErrors().empty() == false)
+    {
+        for (const AsmError &error : asm65k.GetErrors())
+            job.log += job.filename + ": " + FormatAsmError(error);
+        return;
+    }
+
+    const std::string outfilename = job.writeObject ? GetObjectFilename(job.filename.c_str()) : GetOutputFilename(job.filename.c_str());
+    const bool isWritten = job.writeObject ? asm65k.WriteObjectFile(outfilename.c_str()) : RsbWriter::Write(*segments, outfilename.c_str());
+    if (isWritten == false)
+    {
+        job.log = "Could not write file '" + outfilename + "'\n";
+        return;
+    }
+
+    job.log = "Output: '" + outfilename + "'\n";
+    job.succeeded = true;
+}
+
+// a response file lists one input file per line
+bool ReadResponseFile(const char *filename, std::vector<BatchJob> &jobs)
+{
+    MappedFile responseFile;
+    if (responseFile.Open(filename) == false)
+        return false;
+
+    const std::string_view text = responseFile.GetText();
+    size_t lineStart = 0;
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string_view::npos)
+            lineEnd = text.size();
+
+        std::string_view line = text.substr(lineStart, lineEnd - lineStart);
+        while (line.empty() == false && isspace((unsigned char)line.front()))
+            line.remove_prefix(1);
+        while (line.empty() == false && isspace((unsigned char)line.back()))
+            line.remove_suffix(1);
+
+        if (line.empty() == false)
+            jobs.push_back(BatchJob{std::string(line)});
+
+        lineStart = lineEnd + 1;
+    }
+
+    return true;
+}
+
+int RunBatch(std::vector<BatchJob> &jobs, unsigned int threadCount)
+{
+    threadCount = std::max(1u, std::min(threadCount, (unsigned int)jobs.size()));
+
+    // the workers pull the next unprocessed job until the list runs out
+    std::atomic<size_t> nextJob = 0;
+    // every thread has its own assembler context, reused for all of its jobs. only the constant opcode table is
+    // shared between the threads. the files are already assembled in parallel, so each of them is encoded on a single thread
+    auto worker = [&jobs, &nextJob]()
+    {
+        AsmA65k asm65k;
+        asm65k.SetEncoderThreadCount(1);
+
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+            AssembleBatchJob(jobs[i], asm65k);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread &thread : threads)
+        thread.join();
+
+    size_t succeeded = 0;
+    for (const BatchJob &job : jobs)
+    {
+        fputs(job.log.c_str(), stdout);
+        succeeded += job.succeeded;
+    }
+    printf("\nAssembled %zu of %zu files\n", succeeded, jobs.size());
+
+    return succeeded == jobs.size() ? 0 : 1;
+}
+
+// assembles the files in a running server, the output is written by the client
+int RunClient(const char *socketPath, std::vector<BatchJob> &jobs)
+{
+    AsmClient client;
+    if (client.Connect(socketPath) == false)
+    {
+        printf("Could not connect to server '%s'\n", socketPath);
+        return -1;
+    }
+
+    size_t succeeded = 0;
+    std::vector<Segment> segments;
+    std::vector<AsmError> errors;
+    for (const BatchJob &job : jobs)
+    {
+        const uint32_t options = (job.relaxJumps ? AsmServer::SO_RELAX_JUMPS : 0) | (job.optimize ? AsmServer::SO_OPTIMIZE : 0) |
+                                 (job.collectErrors ? AsmServer::SO_ALL_ERRORS : 0);
+
+        const std::optional<AsmServer::Status> status = client.Assemble(job.filename.c_str(), options, segments, errors);
+        if (status.has_value() == false)
+        {
+            printf("Connection to server '%s' lost\n", socketPath);
+            return -1;
+        }
+
+        if (*status == AsmServer::SS_LOAD_ERROR)
+        {
+            printf("Could not load file '%s'\n", job.filename.c_str());
+            continue;
+        }
+
+        if (*status == AsmServer::SS_ASSEMBLY_ERROR)
+        {
+            for (const AsmError &error : errors)
+                printf("%s: %s", job.filename.c_str(), FormatAsmError(error).c_str());
+            continue;
+        }
+
+        const std::string outfilename = GetOutputFilename(job.filename.c_str());
+        if (RsbWriter::Write(segments, outfilename.c_str()) == false)
+        {
+            printf("Could not write file '%s'\n", outfilename.c_str());
+            continue;
+        }
+
+        printf("Output: '%s'\n", outfilename.c_str());
+        succeeded++;
+    }
+
+    return succeeded == jobs.size() ? 0 : 1;
 }
 
 int main(int argc, const char *argv[])
 {
-    if (argc != 2)
+    if (argc < 2)
     {
         printf("Please specify an argument.\n");
+        printf("Usage: AsmA65k <source.s>\n");
+        printf("       AsmA65k [-O] [--relax] [--all-errors] [--stats] <source.s>\n");
+        printf("       AsmA65k [-O] [--relax] [--all-errors] [-c] [-j <threads>] <source.s | @responsefile> ...\n");
+        printf("       AsmA65k --symbols <header.s>\n");
+        printf("       AsmA65k --server <socket>\n");
+        printf("       AsmA65k --client <socket> [-O] [--relax] <source.s | @responsefile> ...\n");
+        printf("       -O: peephole optimization\n");
+        printf("       --all-errors: report every error instead of stopping at the first one\n");
+        printf("       --relax: encode jmp as bra where the target is in reach\n");
+        printf("       -c: assemble into a relocatable object file, source.o, to be linked by AsmA65k-link\n");
+        printf("       --symbols: precompile the .def directives of a header into header.sym, used by .include \"header.s\"\n");
+        printf("       --stats: print the phase times and counters of the assembly as JSON to stderr\n");
         return -1;
     }
     printf("AsmA65K alpha version. Copyright (c) 2013 Zoltán Majoros. (zoltan@arcanelab.com)\n\n");
 
-    // load source file into 'buffer'
-    ifstream fs(argv[1]);
-    stringstream buffer;
-    buffer << fs.rdbuf();
+    // more than one input, a response file or a thread count selects batch mode
+    std::vector<BatchJob> jobs;
+    unsigned int threadCount = std::thread::hardware_concurrency();
+    bool isBatch = false;
+    bool relaxJumps = false;
+    bool optimize = false;
+    bool collectErrors = false;
+    bool printStats = false;
+    bool precompileSymbols = false;
+    bool writeObject = false;
+    const char *clientSocket = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+            return AsmServer::Run(argv[i + 1]);
+        else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc)
+            clientSocket = argv[++i];
+        else if (strcmp(argv[i], "--relax") == 0)
+            relaxJumps = true;
+        else if (strcmp(argv[i], "-O") == 0)
+            optimize = true;
+        else if (strcmp(argv[i], "--all-errors") == 0)
+            collectErrors = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            printStats = true;
+        else if (strcmp(argv[i], "--symbols") == 0)
+            precompileSymbols = true;
+        else if (strcmp(argv[i], "-c") == 0)
+            writeObject = true;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            threadCount = (unsigned int)atoi(argv[++i]);
+            isBatch = true;
+        }
+        else if (argv[i][0] == '@')
+        {
+            if (ReadResponseFile(argv[i] + 1, jobs) == false)
+            {
+                printf("Could not load response file '%s'\n", argv[i] + 1);
+                return -1;
+            }
+            isBatch = true;
+        }
+        else
+            jobs.push_back(BatchJob{argv[i]});
+    }
+
+    if (jobs.empty())
+    {
+        printf("No input files.\n");
+        return -1;
+    }
+
+    for (BatchJob &job : jobs)
+    {
+        job.relaxJumps = relaxJumps;
+        job.optimize = optimize;
+        job.collectErrors = collectErrors;
+        job.writeObject = writeObject;
+    }
+
+    if (clientSocket != nullptr)
+    {
+        if (writeObject)
+        {
+            printf("Object files can't be written by the server\n");
+            return -1;
+        }
+        return RunClient(clientSocket, jobs);
+    }
+
+    if (isBatch || jobs.size() > 1)
+        return RunBatch(jobs, threadCount);
+
+    // map source file into memory, it's assembled in place
+    MappedFile sourceFile;
 
-    if (buffer.str().empty())
+    if (sourceFile.Open(jobs[0].filename.c_str()) == false || sourceFile.GetText().empty())
     {
-        printf("Could not load file '%s'\n", argv[1]);
+        printf("Could not load file '%s'\n", jobs[0].filename.c_str());
         return -1;
     }
 
     // instantiate assembler and pass source code for processing
     AsmA65k asm65k;
+    asm65k.SetJumpRelaxation(relaxJumps);
+    asm65k.SetOptimization(optimize);
+    asm65k.SetErrorCollection(collectErrors);
+    asm65k.SetRelocatable(writeObject);
+    asm65k.SetStatistics(printStats);
+    const uint64_t firstAllocation = allocationCount;
     std::vector<Segment> *segments;
     try
     {
-        segments = asm65k.Assemble(buffer);
+        segments = asm65k.Assemble(sourceFile.GetText(), jobs[0].filename);
     }
-    catch (AsmError error)
+    catch (const AsmError &error)
     {
-        logger("Assembly error in line %d: \"%s\"\n", error.lineNumber, error.errorMessage.c_str());
-        logger("in line: %s\n", error.lineContent.c_str());
+        logger("%s", FormatAsmError(error).c_str());
+        if (printStats)
+            PrintStats(asm65k.GetStatistics(), 0, allocationCount - firstAllocation);
         return 1;
     }
 
-    WriteFile(segments, argv[1]);
+    if (asm65k.GetErrors().empty() == false)
+    {
+        for (const AsmError &error : asm65k.GetErrors())
+            logger("%s", FormatAsmError(error).c_str());
+        logger("%zu errors\n", asm65k.GetErrors().size());
+        if (printStats)
+            PrintStats(asm65k.GetStatistics(), 0, allocationCount - firstAllocation);
+        return 1;
+    }
 
-    // dump machine code
-    for (int i = 0; i < segments->size(); i++)
+    if (precompileSymbols)
+        return WriteSymbolFile(asm65k, sourceFile.GetText(), jobs[0].filename.c_str());
+
+    if (writeObject)
     {
-        Segment actSegment = (*segments)[i];
+        const std::string outfilename = GetObjectFilename(jobs[0].filename.c_str());
+        if (asm65k.WriteObjectFile(outfilename.c_str()) == false)
+        {
+            printf("Could not write file '%s'\n", outfilename.c_str());
+            return 1;
+        }
+
+        printf("Output: '%s'\n", outfilename.c_str());
+        return 0;
+    }
+
+    const auto outputStart = std::chrono::steady_clock::now();
+    WriteFile(segments, jobs[0].filename.c_str());
+    if (printStats)
+        PrintStats(asm65k.GetStatistics(), std::chrono::duration<double>(std::chrono::steady_clock::now() - outputStart).count(),
+                   allocationCount - firstAllocation);
 
+    // dump machine code
+    for (const Segment &actSegment : *segments)
+    {
         printf("\n$%.8X:\n", actSegment.address);
 
-        for (int j = 0; j < actSegment.data.size(); j++)
+        for (size_t j = 0; j < actSegment.data.size(); j++)
         {
             printf("%.2X ", actSegment.data[j]);
             //            printf("%.8X %.2X  ", actSegment.address+j, actSegment.data[j]);
@@ -0,0 +1,16 @@
+//
+//  AllocationCounter.h
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#pragma once
+
+#include <cstdint>
+
+// the number of allocations of the process so far. operator new is replaced in its own translation unit, so the
+// compiler doesn't inline it next to the standard operator delete of the callers
+uint64_t GetAllocationCount();
@@ -0,0 +1,430 @@
+//
+//  Test.cpp
+//  AsmA65k - The assembler for the A65000 microprocessor
+//
+//  Copyright (c) 2013 Zoltán Majoros. All rights reserved.
+//
+//  C++20
+//
+
+#include <Asm65k.h>
+#include <MappedFile.h>
+#include <RsbWriter.h>
+#include <bench/SourceGenerator.h>
+#include <test/AllocationCounter.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    enum TestOptions
+    {
+        TO_RELAX_JUMPS = 1,
+        TO_OPTIMIZE = 2,
+        TO_LINE_CACHE = 4,
+        TO_COMBINATION_COUNT = 8
+    };
+
+    void SetOptions(AsmA65k &asm65k, const unsigned int options)
+    {
+        asm65k.SetJumpRelaxation((options & TO_RELAX_JUMPS) != 0);
+        asm65k.SetOptimization((options & TO_OPTIMIZE) != 0);
+        asm65k.SetLineCache((options & TO_LINE_CACHE) != 0);
+    }
+
+    // the allocations of an assembly by a context that has assembled the source before
+    bool CountWarmAllocations(const std::string &source, const unsigned int options, uint64_t &count)
+    {
+        AsmA65k asm65k;
+        asm65k.SetEncoderThreadCount(1); // the threads of the encoders allocate per assembly
+        SetOptions(asm65k, options);
+
+        try
+        {
+            asm65k.Assemble(source);
+            asm65k.Assemble(source);
+
+            const uint64_t firstAllocation = GetAllocationCount();
+            asm65k.Assemble(source);
+            count = GetAllocationCount() - firstAllocation;
+        }
+        catch (const AsmError &error)
+        {
+            printf("assembly error in line %u: \"%s\"\nin line: %s\n", error.lineNumber, error.errorMessage.c_str(), error.lineContent.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // a warm context may allocate a few times per assembly, but not per line: a source four times longer has to
+    // make the same number of allocations
+    int RunAllocationTests()
+    {
+        static constexpr size_t SHORT_SOURCE_LINES = 1000;
+        static constexpr size_t LONG_SOURCE_LINES = 4 * SHORT_SOURCE_LINES;
+
+        int failures = 0;
+        for (int scenario = 0; scenario < SourceGenerator::SCENARIO_COUNT; scenario++)
+        {
+            const char *scenarioName = SourceGenerator::GetScenarioName((SourceGenerator::Scenario)scenario);
+            const std::string shortSource = SourceGenerator::Generate((SourceGenerator::Scenario)scenario, SHORT_SOURCE_LINES, 1);
+            const std::string longSource = SourceGenerator::Generate((SourceGenerator::Scenario)scenario, LONG_SOURCE_LINES, 1);
+
+            for (unsigned int options = 0; options < TO_COMBINATION_COUNT; options++)
+            {
+                uint64_t shortCount = 0;
+                uint64_t longCount = 0;
+                if (CountWarmAllocations(shortSource, options, shortCount) == false || CountWarmAllocations(longSource, options, longCount) == false)
+                {
+                    printf("FAILED allocations/%s/%u\n", scenarioName, options);
+                    failures++;
+                    continue;
+                }
+
+                if (shortCount != longCount)
+                {
+                    printf("FAILED allocations/%s/%u: %llu allocations for %zu lines, %llu for %zu lines\n", scenarioName, options,
+                           (unsigned long long)shortCount, SHORT_SOURCE_LINES, (unsigned long long)longCount, LONG_SOURCE_LINES);
+                    failures++;
+                }
+            }
+        }
+        return failures;
+    }
+
+    bool ParseAddress(std::string_view text, uint32_t &address)
+    {
+        const bool isHex = text.starts_with('$');
+        const std::string digits(text.substr(isHex));
+        char *end = nullptr;
+        const unsigned long long value = strtoull(digits.c_str(), &end, isHex ? 16 : 10);
+        if (digits.empty() || *end != '\0' || value > 0xffffffffull)
+            return false;
+
+        address = (uint32_t)value;
+        return true;
+    }
+
+    // the first line of a regression source may set the options of its assembly: "; options: -O --relax". the
+    // link tests also take the address of the relocatable sections: "; options: --base $2000"
+    bool GetSourceOptions(std::string_view source, unsigned int &options, uint32_t &baseAddress)
+    {
+        static constexpr std::string_view OPTIONS_PREFIX = "; options:";
+
+        options = 0;
+        baseAddress = 0;
+        const std::string_view firstLine = source.substr(0, source.find('\n'));
+        if (firstLine.starts_with(OPTIONS_PREFIX) == false)
+            return true;
+
+        size_t pos = OPTIONS_PREFIX.size();
+        while (pos < firstLine.size())
+        {
+            const size_t start = firstLine.find_first_not_of(" \t\r", pos);
+            if (start == std::string_view::npos)
+                break;
+            pos = std::min(firstLine.find_first_of(" \t\r", start), firstLine.size());
+
+            const std::string_view option = firstLine.substr(start, pos - start);
+            if (option == "-O")
+                options |= TO_OPTIMIZE;
+            else if (option == "--relax")
+                options |= TO_RELAX_JUMPS;
+            else if (option == "--base")
+            {
+                const size_t addressStart = firstLine.find_first_not_of(" \t\r", pos);
+                if (addressStart == std::string_view::npos)
+                    return false;
+                pos = std::min(firstLine.find_first_of(" \t\r", addressStart), firstLine.size());
+                if (ParseAddress(firstLine.substr(addressStart, pos - addressStart), baseAddress) == false)
+                    return false;
+            }
+            else
+                return false;
+        }
+        return true;
+    }
+
+    bool ReadFile(const std::filesystem::path &path, std::string &contents)
+    {
+        MappedFile file;
+        if (file.Read(path.string().c_str()) == false)
+            return false;
+
+        contents = file.GetText();
+        return true;
+    }
+
+    bool WriteFile(const std::filesystem::path &path, std::string_view contents)
+    {
+        std::ofstream file(path, std::ofstream::binary);
+        file.write(contents.data(), contents.size());
+        file.close();
+        return (bool)file;
+    }
+
+    // the .rsb file of the segments, as the assembler writes it
+    bool GetImage(const std::vector<Segment> &segments, std::string &image)
+    {
+        const std::filesystem::path imagePath = std::filesystem::temp_directory_path() / "AsmA65k-test.rsb";
+        return RsbWriter::Write(segments, imagePath.string().c_str()) && ReadFile(imagePath, image);
+    }
+
+    std::string FormatError(const AsmError &error)
+    {
+        return "line " + std::to_string(error.lineNumber) + ": " + error.errorMessage + "\n";
+    }
+
+    // the first difference of two images, for the report of a failed test
+    std::string DescribeDifference(const std::string &expected, const std::string &actual)
+    {
+        const auto difference = std::mismatch(expected.begin(), expected.end(), actual.begin(), actual.end());
+        return "the output differs from offset " + std::to_string(difference.first - expected.begin()) + " of the .rsb (" +
+               std::to_string(expected.size()) + " bytes expected, " + std::to_string(actual.size()) + " bytes assembled)";
+    }
+
+    // assembles 'name.s' and compares the output with 'name.rsb', or the error with 'name.err' for the sources that
+    // have to fail. a context with the line cache assembles it a second time, the cached lines must give the same
+    // result. --update writes the expected files instead
+    bool RunRegressionTest(const std::filesystem::path &sourcePath, const bool update)
+    {
+        const std::string name = sourcePath.stem().string();
+        const std::filesystem::path imagePath = std::filesystem::path(sourcePath).replace_extension(".rsb");
+        const std::filesystem::path errorPath = std::filesystem::path(sourcePath).replace_extension(".err");
+
+        std::string source;
+        unsigned int options;
+        uint32_t baseAddress;
+        if (ReadFile(sourcePath, source) == false || GetSourceOptions(source, options, baseAddress) == false)
+        {
+            printf("FAILED %s: could not load the source or its options\n", name.c_str());
+            return false;
+        }
+
+        AsmA65k asm65k;
+        SetOptions(asm65k, options | TO_LINE_CACHE);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            std::string image;
+            std::string error;
+            try
+            {
+                const std::vector<Segment> *segments = asm65k.Assemble(source, sourcePath.string());
+                if (GetImage(*segments, image) == false)
+                {
+                    printf("FAILED %s: could not write the output\n", name.c_str());
+                    return false;
+                }
+            }
+            catch (const AsmError &asmError)
+            {
+                error = FormatError(asmError);
+            }
+
+            if (update)
+            {
+                std::filesystem::remove(error.empty() ? errorPath : imagePath);
+                return error.empty() ? WriteFile(imagePath, image) : WriteFile(errorPath, error);
+            }
+
+            std::string expected;
+            const bool hasExpectedError = ReadFile(errorPath, expected);
+            if (hasExpectedError == false && ReadFile(imagePath, expected) == false)
+            {
+                printf("FAILED %s: no %s.rsb or %s.err, run with --update to create it\n", name.c_str(), name.c_str(), name.c_str());
+                return false;
+            }
+
+            const char *passName = pass == 0 ? "" : " (line cache)";
+            if (hasExpectedError && error != expected)
+            {
+                printf("FAILED %s%s: expected the error %sgot %s\n", name.c_str(), passName, expected.c_str(), error.empty() ? "no error\n" : error.c_str());
+                return false;
+            }
+            if (hasExpectedError == false && error.empty() == false)
+            {
+                printf("FAILED %s%s: %s", name.c_str(), passName, error.c_str());
+                return false;
+            }
+            if (hasExpectedError == false && image != expected)
+            {
+                printf("FAILED %s%s: %s\n", name.c_str(), passName, DescribeDifference(expected, image).c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // every .s file of the directory is a test, the files they include and the link tests are in its subdirectories
+    int RunRegressionTests(const std::filesystem::path &directory, const bool update)
+    {
+        std::vector<std::filesystem::path> sources;
+        std::error_code errorCode;
+        for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory, errorCode))
+        {
+            if (entry.is_regular_file() && entry.path().extension() == ".s")
+                sources.push_back(entry.path());
+        }
+        if (errorCode || sources.empty())
+        {
+            printf("FAILED no regression sources in '%s'\n", directory.string().c_str());
+            return 1;
+        }
+
+        std::sort(sources.begin(), sources.end());
+        int failures = 0;
+        for (const std::filesystem::path &source : sources)
+            failures += RunRegressionTest(source, update) ? 0 : 1;
+        return failures;
+    }
+
+    // tests/link/<name>/flat.s has the sources of the test in one file. the other sources of the directory are
+    // assembled into objects and linked in the order of their names at the --base of flat.s. with every combination
+    // of -O and --relax, the linked output has to be the same as the assembly of flat.s. flat.rsb is the expected
+    // output of flat.s with its own options
+    bool RunLinkTest(const std::filesystem::path &directory, const bool update)
+    {
+        const std::string name = "link/" + directory.filename().string();
+        const std::filesystem::path flatPath = directory / "flat.s";
+        const std::filesystem::path flatImagePath = directory / "flat.rsb";
+
+        std::vector<std::filesystem::path> objectSources;
+        for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory))
+        {
+            if (entry.is_regular_file() && entry.path().extension() == ".s" && entry.path().filename() != "flat.s")
+                objectSources.push_back(entry.path());
+        }
+        std::sort(objectSources.begin(), objectSources.end());
+
+        std::string flatSource;
+        unsigned int flatOptions;
+        uint32_t baseAddress;
+        if (objectSources.empty() || ReadFile(flatPath, flatSource) == false || GetSourceOptions(flatSource, flatOptions, baseAddress) == false)
+        {
+            printf("FAILED %s: could not load flat.s, its options or the sources of the objects\n", name.c_str());
+            return false;
+        }
+
+        for (unsigned int options = 0; options < TO_LINE_CACHE; options++)
+        {
+            const auto fail = [&name, options](const std::string &message)
+            {
+                printf("FAILED %s/%u: %s\n", name.c_str(), options, message.c_str());
+                return false;
+            };
+
+            std::string flatImage;
+            std::vector<std::string> objectFiles;
+            std::string linkedImage;
+            try
+            {
+                AsmA65k asm65k;
+                SetOptions(asm65k, options);
+                if (GetImage(*asm65k.Assemble(flatSource, flatPath.string()), flatImage) == false)
+                    return fail("could not write the output of flat.s");
+
+                asm65k.SetRelocatable(true);
+                for (const std::filesystem::path &sourcePath : objectSources)
+                {
+                    std::string source;
+                    if (ReadFile(sourcePath, source) == false)
+                        return fail("could not load " + sourcePath.filename().string());
+
+                    objectFiles.push_back((std::filesystem::temp_directory_path() / ("AsmA65k-test-" + sourcePath.stem().string() + ".o")).string());
+                    asm65k.Assemble(source, sourcePath.string());
+                    if (asm65k.WriteObjectFile(objectFiles.back().c_str()) == false)
+                        return fail("could not write the object of " + sourcePath.filename().string());
+                }
+
+                AsmA65k linker;
+                if (GetImage(*linker.Link(objectFiles, baseAddress), linkedImage) == false)
+                    return fail("could not write the linked output");
+            }
+            catch (const AsmError &error)
+            {
+                return fail(std::filesystem::path(error.fileName).filename().string() + " " + FormatError(error));
+            }
+
+            if (options == flatOptions)
+            {
+                std::string expected;
+                if (update && WriteFile(flatImagePath, flatImage) == false)
+                    return fail("could not write flat.rsb");
+                if (update == false && ReadFile(flatImagePath, expected) == false)
+                    return fail("no flat.rsb, run with --update to create it");
+                if (update == false && flatImage != expected)
+                    return fail("flat.s: " + DescribeDifference(expected, flatImage));
+            }
+
+            if (linkedImage != flatImage)
+                return fail("the linked objects and flat.s differ: " + DescribeDifference(flatImage, linkedImage));
+        }
+        return true;
+    }
+
+    int RunLinkTests(const std::filesystem::path &directory, const bool update)
+    {
+        std::vector<std::filesystem::path> tests;
+        std::error_code errorCode;
+        for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory, errorCode))
+        {
+            if (entry.is_directory())
+                tests.push_back(entry.path());
+        }
+        if (errorCode || tests.empty())
+        {
+            printf("FAILED no link tests in '%s'\n", directory.string().c_str());
+            return 1;
+        }
+
+        std::sort(tests.begin(), tests.end());
+        int failures = 0;
+        for (const std::filesystem::path &test : tests)
+            failures += RunLinkTest(test, update) ? 0 : 1;
+        return failures;
+    }
+
+    void PrintUsage()
+    {
+        printf("Usage: AsmA65k-test [--update] [<tests directory>]\n");
+        printf("       runs the allocation tests, the regression sources of the directory, 'tests' by default, and its link tests\n");
+        printf("       --update: writes the expected output of the regression sources instead of checking it\n");
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    std::filesystem::path directory = "tests";
+    bool update = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (argv[i][0] != '-')
+            directory = argv[i];
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    const int failures = (update ? 0 : RunAllocationTests()) + RunRegressionTests(directory, update) + RunLinkTests(directory / "link", update);
+
+    if (failures != 0)
+    {
+        printf("%d tests failed\n", failures);
+        return 1;
+    }
+
+    printf(update ? "Expected files updated\n" : "All tests passed\n");
+    return 0;
+}
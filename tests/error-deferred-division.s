@@ -0,0 +1,5 @@
+; a division by zero found when the forward reference is resolved
+.pc = $1000
+        nop
+        .dword  100 / (later - $1006)
+later:  rts
@@ -0,0 +1,4 @@
+; only mul and div have .u and .s
+.pc = $1000
+        mul.s   r1, r2
+        mov.u   r0, 5
@@ -0,0 +1,21 @@
+; the operators of the expressions and their precedence, the forward references evaluated by the fixups, and '*'
+.def    BASE = $1000
+.def    MASK = %1111 << 4
+.def    COUNT = (BASE >> 8) * 3 + 1
+.pc = BASE
+start:  .dword  1 + 2 * 3, (1 + 2) * 3, 100 / 7, 100 - 10 - 1
+        .dword  -5, ~0, -(2 + 3) * 4, 1 << 4 + 1
+        .dword  $ff & MASK | 3, $f0 ^ $ff, 6 & 3 ^ 1 | 8, COUNT
+        .byte   <$1234, >$1234, <end, >end
+        .word   end - start, (end - start) / 2
+        .dword  *, * + 4, end - *, later * 2 + 1
+        mov     r0, later - start       ; defined after its use
+        mov.w   r1, <(later + $100)
+        mov     r2, [r3 + later - 2]
+        mov     r4, [BASE + 4 * 2 + r5]
+        add     r6, ~MASK & $ffff
+        bra     * + 4
+.def    COUNT = COUNT + 1               ; the lines after it see the new value
+        .byte   COUNT
+later:  rts
+end:
@@ -0,0 +1,6 @@
+; macros defined in an included file
+.def    STACK_TOP = $8000
+
+.macro  setup
+        mov     sp, STACK_TOP
+.endm
@@ -0,0 +1,13 @@
+; imports the symbols of 2-lib.s, and uses them and its own labels in every kind of field
+.export start
+start:  mov     r0, msg
+        jsr     print
+        bra     done
+        bne     print
+        mov     r1, [table + r2]
+        mov.b   r3, count
+        .dword  table, count, *, print + 4, done - start
+        .word   <print, >print
+        jmp     done
+done:   rts
+msg:    .text   "hi"
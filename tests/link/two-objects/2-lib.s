@@ -0,0 +1,11 @@
+; a relocatable section, an absolute one, and a .def exported to 1-main.s
+.export print, table, count
+.def    count = 3
+print:  mov     r3, [table]
+        beq     out
+        jmp     print
+out:    rts
+table:  .byte   1, 2, 3
+.pc = $8000
+vec:    .dword  print, vec
+        mov     r0, table
@@ -0,0 +1,23 @@
+; options: --base $2000
+; 1-main.s and 2-lib.s in one source, at the address the linker places them
+.pc = $2000
+start:  mov     r0, msg
+        jsr     print
+        bra     done
+        bne     print
+        mov     r1, [table + r2]
+        mov.b   r3, count
+        .dword  table, count, *, print + 4, done - start
+        .word   <print, >print
+        jmp     done
+done:   rts
+msg:    .text   "hi"
+.def    count = 3
+print:  mov     r3, [table]
+        beq     out
+        jmp     print
+out:    rts
+table:  .byte   1, 2, 3
+.pc = $8000
+vec:    .dword  print, vec
+        mov     r0, table
@@ -0,0 +1,30 @@
+; macros with parameters, local labels and nested invocations, and one defined in an included file
+.pc = $1000
+.include "include/macros.s"
+
+.macro  copy    source, target, count
+        mov     r0, source
+        mov     r1, target
+        mov     r2, count
+loop@:  mov.b   r3, [r0]+
+        mov.b   [r1]+, r3
+        dec     r2
+        bne     loop@
+.endm
+
+.macro  clear2  first, second
+        mov     first, 0
+        mov     second, 0
+.endm
+
+.macro  init    target
+        setup
+        clear2  r4, r5
+        copy    text, target, 4
+.endm
+
+start:  init    $2000
+        copy    text, buffer + 2, 4 ; a second expansion gets a loop label of its own
+        rts
+text:   .text   "Test"
+buffer: .byte   0, 0, 0, 0, 0, 0
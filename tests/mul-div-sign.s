@@ -0,0 +1,13 @@
+; the .u and .s specifiers of mul and div select their signedness, their constants stay 32 bits
+.pc = $1000
+        mul     r0, r1
+        mul.u   r1, r2
+        mul.s   r1, r2
+        mul.s   r3, 5
+        mul.u   r4, [r5]
+        div     r0, 7
+        div.u   r0, r1
+        div.s   r0, 5
+        div.s   r6, [data + r2]
+        div.u   r7, data
+data:   .dword  100
@@ -0,0 +1,83 @@
+; every operand form of the instruction set, with the size specifiers and the postfixes
+.def BASE = $f000
+.def OFF = BASE + 16
+.pc = $1000
+start:  nop
+        sei
+        inc r3
+        inc [r4]
+        inc [r4]+
+        dec [r5]-
+        inc [$2000]
+        inc [data]
+        inc.b [r0 + 12]
+        inc.w [r0 + data]
+        inc [$10 + r1]
+        inc [data + r2]+
+        push $ff
+        push.b 12
+        push.w data
+        jmp $4000
+        jsr start
+        jmp later
+        bra start
+        beq later
+        mov r0, r1
+        mov r0, 123
+        mov.b r0, 12
+        mov r0, data
+        mov.w r0, BASE
+        mov r0, [r1]
+        mov r0, [r1]+
+        mov r0, [$f000 + r1]
+        mov r0, [data + r1]
+        mov r0, [r1 + data]
+        mov r0, [r1 + 100]
+        mov [r0], r1
+        mov [r0]-, r1
+        mov [r0 + data], r1
+        mov [r0 + 10], r1
+        mov [data + r0], r1
+        mov [1234 + r0], r1
+        mov [data], r0
+        mov [$6660], r0
+        mov r0, [data]
+        mov r0, [$4434]
+        sys 5, data
+        sys 5, $1234
+        sys OFF, 5
+        sys OFF, data
+        mov [r0], 64
+        mov.b [r0], 64
+        mov [data], 64
+        mov [$1234], 64
+        mov [r0 + data], 64
+        mov [r0 + 10], 64
+        mov [data + r0], 64
+        add sp, r1
+        add pc, [data + r10]
+        mov.b [r3 + later], 1
+        div r0, r1
+        mul r0, 5 ; comment
+        MOV     R1, R5
+        MOV     R6, PC
+        MOV.w   [$3948], R5
+        mov     r0, [r13]-
+        mov     [r1]+, 5
+        mov.w   [r2]-, $1234
+        mov.b   [r3 + 4]+, 9
+        pop.b   [r6]
+        push    [r5]
+        push    $12345678
+        pusha
+        popa
+        or      r1, $ff76
+        sub     sp, 8
+        cmp     r0, [r1]+
+        add     r1, [BASE + r2]
+later:  rts
+data:   .byte 1, 2, $3, %101
+        .word $ffff, 7
+        .dword later, 3
+        .text "Hello"
+        .textz "Hi"
@@ -0,0 +1,29 @@
+; options: -O
+; the rewrites of the peephole optimizer, and the cases it has to leave alone
+.pc = $1000
+start:  mov     r0, 0           ; clr r0
+        mov.b   r1, 0           ; clr.b r1
+        add     r2, 1           ; inc r2
+        sub     r3, 1           ; dec r3
+        mov     r0, 5
+        add     r2, 2
+        sub     [r3], 1         ; not a register
+        push    r4              ; dropped with the pop
+        pop     r4
+        push    r4
+        pop     r5
+        push    r6
+keep:   pop     r6              ; a label between them: kept
+        push.b  r7
+        pop     r7              ; different sizes: kept
+        jsr     sub             ; jmp sub, the rts is dropped
+        rts
+        bra     hop             ; bra last
+        beq     hop             ; beq last
+        jmp     hop             ; jmp last
+        jmp.w   hop             ; a sized jmp is not followed
+sub:    rts
+hop:    jmp     next
+next:   bra     last
+        nop
+last:   rts                     ; the end of the chain
@@ -0,0 +1,116 @@
+; options: --relax
+; a jmp to a label becomes a bra if the label is in the reach of a bra
+.macro fill32
+        .dword  0, 0, 0, 0, 0, 0, 0, 0
+.endm
+.macro fill1k
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+.endm
+.pc = $1000
+back:   nop
+        jmp     back            ; in reach backwards: bra
+        jmp     ahead           ; in reach forwards: bra
+        jmp     $1000           ; not a label: jmp
+ahead:  jmp     far             ; out of reach: jmp
+        jsr     back            ; only jmp is relaxed
+; 'first' is only in reach of a bra once 'near' is a bra
+first:  jmp     over
+        jmp     near
+near:
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill1k
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        fill32
+        .byte   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+over:   rts
+.pc = $30000
+far:    rts
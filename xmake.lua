@@ -34,7 +34,10 @@ end
 Target =
 {
     standalone = 1,
-    library = 2
+    library = 2,
+    bench = 3,
+    link = 4,
+    test = 5
 }
 
 local _target = Target.library
@@ -45,6 +48,15 @@ function AddCommon()
     add_files("src/AsmA65k-Assembly.cpp")
     add_files("src/AsmA65k-Directives.cpp")
     add_files("src/AsmA65k-Misc.cpp")
+    add_files("src/AsmA65k-Lexer.cpp")
+    add_files("src/AsmA65k-Expressions.cpp")
+    add_files("src/AsmA65k-Include.cpp")
+    add_files("src/AsmA65k-Macros.cpp")
+    add_files("src/AsmA65k-Optimizer.cpp")
+    add_files("src/AsmA65k-Link.cpp")
+    add_files("src/RsbWriter.cpp")
+    add_files("src/SymbolFile.cpp")
+    add_files("src/ObjectFile.cpp")
     set_targetdir("bin")
 end
 
@@ -52,9 +64,38 @@ if _target == Target.standalone then
     target("AsmA65k")
         AddCommon()
         add_files("src/main.cpp")
+        add_files("src/AsmServer.cpp")
         set_kind("binary")
+        if is_plat("linux") or is_plat("mingw") then
+            add_syslinks("pthread")
+        end
 elseif _target == Target.library then
     target("AsmA65k-lib")
         AddCommon()
         set_kind("static")
+elseif _target == Target.bench then
+    target("AsmA65k-bench")
+        AddCommon()
+        add_files("src/bench/*.cpp")
+        set_kind("binary")
+        if is_plat("linux") or is_plat("mingw") then
+            add_syslinks("pthread")
+        end
+elseif _target == Target.link then
+    target("AsmA65k-link")
+        AddCommon()
+        add_files("src/link/*.cpp")
+        set_kind("binary")
+        if is_plat("linux") or is_plat("mingw") then
+            add_syslinks("pthread")
+        end
+elseif _target == Target.test then
+    target("AsmA65k-test")
+        AddCommon()
+        add_files("src/bench/SourceGenerator.cpp")
+        add_files("src/test/*.cpp")
+        set_kind("binary")
+        if is_plat("linux") or is_plat("mingw") then
+            add_syslinks("pthread")
+        end
 end